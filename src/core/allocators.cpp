@@ -0,0 +1,194 @@
+#include "../pch.hpp"
+#include "allocators.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iterator>
+
+#ifndef VULKAT_COUNT_ALLOCATIONS
+#define VULKAT_COUNT_ALLOCATIONS 1
+#endif
+
+namespace vulkat {
+	namespace {
+		size_t AlignUp(size_t value, size_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	// LinearArena
+	LinearArena::LinearArena(size_t capacity)
+		: m_pBlock{ capacity > 0 ? static_cast<uint8_t*>(::operator new(capacity)) : nullptr }
+		, m_Capacity{ capacity }
+		, m_Head{ 0 }
+		, m_HighWater{ 0 }
+		, m_OverflowSize{ 0 }
+	{}
+
+	LinearArena::~LinearArena() {
+		for (void* pOverflow : m_Overflow) ::operator delete(pOverflow);
+		::operator delete(m_pBlock);
+	}
+
+	void* LinearArena::Allocate(size_t size, size_t alignment) {
+		// The block comes from operator new, aligned for anything up to max_align_t
+		size_t offset{ AlignUp(m_Head, alignment) };
+
+		if (offset + size <= m_Capacity) {
+			m_Head = offset + size;
+			m_HighWater = std::max(m_HighWater, GetUsed());
+			return m_pBlock + offset;
+		}
+
+		m_Overflow.push_back(::operator new(size));
+		m_OverflowSize += AlignUp(size, alignment);
+		m_HighWater = std::max(m_HighWater, GetUsed());
+		return m_Overflow.back();
+	}
+
+	void LinearArena::Reset() {
+		if (!m_Overflow.empty()) {
+			for (void* pOverflow : m_Overflow) ::operator delete(pOverflow);
+			m_Overflow.clear();
+			m_OverflowSize = 0;
+
+			// Grow once to what was needed, with some headroom so a slowly growing load doesn't grow every frame
+			::operator delete(m_pBlock);
+			m_Capacity = AlignUp(m_HighWater + m_HighWater / 4, 4096);
+			m_pBlock = static_cast<uint8_t*>(::operator new(m_Capacity));
+		}
+
+		m_Head = 0;
+	}
+
+	void LinearArena::Rewind(size_t marker) {
+		// Overflow allocations can't be rewound, they stay until Reset()
+		m_Head = std::min(marker, m_Head);
+	}
+
+	// FixedPool
+	FixedPool::FixedPool(size_t blockSize, size_t blocksPerChunk)
+		: m_BlockSize{ AlignUp(std::max(blockSize, sizeof(FreeBlock)), alignof(std::max_align_t)) }
+		, m_BlocksPerChunk{ std::max<size_t>(blocksPerChunk, 1) }
+		, m_pFreeList{ nullptr }
+		, m_Live{ 0 }
+	{}
+
+	FixedPool::~FixedPool() {
+		for (void* pChunk : m_Chunks) ::operator delete(pChunk);
+	}
+
+	void* FixedPool::Allocate() {
+		if (!m_pFreeList) AddChunk();
+
+		FreeBlock* pBlock{ m_pFreeList };
+		m_pFreeList = pBlock->pNext;
+		++m_Live;
+
+		return pBlock;
+	}
+
+	void FixedPool::Free(void* pBlock) {
+		if (!pBlock) return;
+
+		FreeBlock* pFree{ static_cast<FreeBlock*>(pBlock) };
+		pFree->pNext = m_pFreeList;
+		m_pFreeList = pFree;
+		--m_Live;
+	}
+
+	void FixedPool::AddChunk() {
+		uint8_t* pChunk{ static_cast<uint8_t*>(::operator new(m_BlockSize * m_BlocksPerChunk)) };
+		m_Chunks.push_back(pChunk);
+
+		// Thread the new blocks onto the free list, in address order
+		for (size_t i{ m_BlocksPerChunk }; i-- > 0;) {
+			FreeBlock* pBlock{ reinterpret_cast<FreeBlock*>(pChunk + i * m_BlockSize) };
+			pBlock->pNext = m_pFreeList;
+			m_pFreeList = pBlock;
+		}
+	}
+
+	// RangeAllocator
+	RangeAllocator::RangeAllocator(uint64_t size)
+		: m_Size{ size }
+		, m_Used{ 0 }
+		, m_FreeRanges{}
+	{
+		if (size > 0) m_FreeRanges.push_back({ 0, size });
+	}
+
+	uint64_t RangeAllocator::Allocate(uint64_t size) {
+		if (size == 0) return m_InvalidOffset;
+
+		auto it{ std::find_if(m_FreeRanges.begin(), m_FreeRanges.end(), [size](const Range& range) { return range.size >= size; }) };
+		if (it == m_FreeRanges.end()) return m_InvalidOffset;
+
+		// Taken from the front, the rest of the range stays where it is in the list
+		uint64_t offset{ it->offset };
+		it->offset += size;
+		it->size -= size;
+		if (it->size == 0) m_FreeRanges.erase(it);
+
+		m_Used += size;
+		return offset;
+	}
+
+	void RangeAllocator::Free(uint64_t offset, uint64_t size) {
+		if (size == 0) return;
+
+		auto next{ std::lower_bound(m_FreeRanges.begin(), m_FreeRanges.end(), offset, [](const Range& range, uint64_t value) { return range.offset < value; }) };
+		m_Used -= size;
+
+		const bool mergePrevious{ next != m_FreeRanges.begin() && std::prev(next)->offset + std::prev(next)->size == offset };
+		const bool mergeNext{ next != m_FreeRanges.end() && offset + size == next->offset };
+
+		if (mergePrevious && mergeNext) {
+			std::prev(next)->size += size + next->size;
+			m_FreeRanges.erase(next);
+		}
+		else if (mergePrevious) {
+			std::prev(next)->size += size;
+		}
+		else if (mergeNext) {
+			next->offset = offset;
+			next->size += size;
+		}
+		else {
+			m_FreeRanges.insert(next, { offset, size });
+		}
+	}
+
+	// AllocationCounter
+	namespace {
+		std::atomic<uint64_t> g_AllocationCount{ 0 };
+	}
+
+	bool AllocationCounter::IsEnabled() {
+		return VULKAT_COUNT_ALLOCATIONS != 0;
+	}
+
+	uint64_t AllocationCounter::Get() {
+		return g_AllocationCount.load(std::memory_order_relaxed);
+	}
+}
+
+#if VULKAT_COUNT_ALLOCATIONS
+// Replacing the plain forms is enough, the nothrow and array forms forward to them
+void* operator new(size_t size) {
+	vulkat::g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (size == 0) size = 1;
+	if (void* p{ std::malloc(size) }) return p;
+
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+#endif
@@ -0,0 +1,173 @@
+#ifndef ALLOCATORS_HPP
+#define ALLOCATORS_HPP
+
+#include <cstddef>
+#include <new>
+
+namespace vulkat {
+	// Bump allocator for data that lives until a known point, eg. the end of a frame.
+	// Running out doesn't fail, the overflow is malloc'ed and the next Reset() grows the
+	// block to the high water mark, so after a warm up frame nothing is allocated anymore
+	class LinearArena final {
+	public:
+		explicit LinearArena(size_t capacity = 0);
+
+		LinearArena(const LinearArena& other) = delete;
+		LinearArena(LinearArena&& other) = delete;
+		LinearArena& operator=(const LinearArena& other) = delete;
+		LinearArena& operator=(LinearArena&& other) = delete;
+
+		~LinearArena();
+
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		// Everything allocated so far is gone, destructors aren't run
+		void Reset();
+
+		// Scratch use inside a longer lived arena: everything after the marker is freed by Rewind()
+		size_t GetMarker() const { return m_Head; }
+		void Rewind(size_t marker);
+
+		size_t GetUsed() const { return m_Head + m_OverflowSize; }
+		size_t GetCapacity() const { return m_Capacity; }
+		size_t GetHighWater() const { return m_HighWater; }
+
+	private:
+		uint8_t* m_pBlock;
+		size_t m_Capacity;
+		size_t m_Head;
+		size_t m_HighWater; // Largest GetUsed() since construction
+
+		std::vector<void*> m_Overflow; // Freed and folded into the block on Reset()
+		size_t m_OverflowSize;
+	};
+
+	// STL adapter, deallocate is a no-op: the memory comes back with the arena's Reset()
+	template<typename T>
+	class ArenaAllocator {
+	public:
+		using value_type = T;
+
+		explicit ArenaAllocator(LinearArena& arena) noexcept : m_pArena{ &arena } {}
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_pArena{ other.m_pArena } {}
+
+		T* allocate(size_t count) { return static_cast<T*>(m_pArena->Allocate(count * sizeof(T), alignof(T))); }
+		void deallocate(T*, size_t) noexcept {}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const noexcept { return m_pArena == other.m_pArena; }
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const noexcept { return m_pArena != other.m_pArena; }
+
+	private:
+		template<typename U> friend class ArenaAllocator;
+
+		LinearArena* m_pArena;
+	};
+
+	// Fixed size blocks from a free list, chunks are only ever added.
+	// For objects that come and go one at a time, eg. the nodes of a map
+	class FixedPool final {
+	public:
+		FixedPool(size_t blockSize, size_t blocksPerChunk = 256);
+
+		FixedPool(const FixedPool& other) = delete;
+		FixedPool(FixedPool&& other) = delete;
+		FixedPool& operator=(const FixedPool& other) = delete;
+		FixedPool& operator=(FixedPool&& other) = delete;
+
+		~FixedPool();
+
+		void* Allocate();
+		void Free(void* pBlock);
+
+		size_t GetBlockSize() const { return m_BlockSize; }
+		size_t GetLiveCount() const { return m_Live; }
+		size_t GetChunkCount() const { return m_Chunks.size(); }
+
+	private:
+		struct FreeBlock {
+			FreeBlock* pNext;
+		};
+
+		size_t m_BlockSize;
+		size_t m_BlocksPerChunk;
+		std::vector<void*> m_Chunks;
+		FreeBlock* m_pFreeList;
+		size_t m_Live;
+
+		void AddChunk();
+	};
+
+	// STL adapter over a FixedPool. Single objects that fit a block come from the pool,
+	// anything else (eg. the bucket array of an unordered_map) goes to operator new
+	template<typename T>
+	class PoolAllocator {
+	public:
+		using value_type = T;
+
+		explicit PoolAllocator(FixedPool& pool) noexcept : m_pPool{ &pool } {}
+		template<typename U>
+		PoolAllocator(const PoolAllocator<U>& other) noexcept : m_pPool{ other.m_pPool } {}
+
+		T* allocate(size_t count) {
+			if (FromPool(count)) return static_cast<T*>(m_pPool->Allocate());
+			return static_cast<T*>(::operator new(count * sizeof(T)));
+		}
+
+		void deallocate(T* p, size_t count) noexcept {
+			if (FromPool(count)) m_pPool->Free(p);
+			else ::operator delete(p);
+		}
+
+		template<typename U>
+		bool operator==(const PoolAllocator<U>& other) const noexcept { return m_pPool == other.m_pPool; }
+		template<typename U>
+		bool operator!=(const PoolAllocator<U>& other) const noexcept { return m_pPool != other.m_pPool; }
+
+	private:
+		template<typename U> friend class PoolAllocator;
+
+		FixedPool* m_pPool;
+
+		bool FromPool(size_t count) const {
+			return count == 1 && sizeof(T) <= m_pPool->GetBlockSize() && alignof(T) <= alignof(std::max_align_t);
+		}
+	};
+
+	// Offsets into a range of fixed size that isn't CPU memory, eg. a GPU buffer. First fit from a free list
+	// sorted by offset, freed ranges merge with their neighbours so mixed sizes coming and going don't fragment it
+	class RangeAllocator final {
+	public:
+		static constexpr uint64_t m_InvalidOffset{ UINT64_MAX };
+
+		explicit RangeAllocator(uint64_t size = 0);
+
+		// m_InvalidOffset if no free range is large enough
+		uint64_t Allocate(uint64_t size);
+		void Free(uint64_t offset, uint64_t size);
+
+		uint64_t GetSize() const { return m_Size; }
+		uint64_t GetUsed() const { return m_Used; }
+		size_t GetFreeRangeCount() const { return m_FreeRanges.size(); }
+
+	private:
+		struct Range {
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		uint64_t m_Size;
+		uint64_t m_Used;
+		std::vector<Range> m_FreeRanges; // Sorted by offset, never touching each other
+	};
+
+	// Calls to the global operator new since startup, on every thread.
+	// Counted unless built with COUNT_ALLOCATIONS=0, then it always returns 0
+	namespace AllocationCounter {
+		bool IsEnabled();
+		uint64_t Get();
+	}
+}
+#endif // ALLOCATORS_HPP
@@ -0,0 +1,204 @@
+#include "../pch.hpp"
+#include "benchmark.hpp"
+#include "allocators.hpp"
+
+#include <sstream>
+
+namespace vulkat {
+	Benchmark::Benchmark()
+		: m_pScenario{ nullptr }
+		, m_Work{ 0.0 }
+		, m_WorkSeconds{ 0.0 }
+		, m_Allocations{ 0 }
+		, m_Thresholds{ { "", 15.0 }, { "cpu_p95_ms", 30.0 } } // Tail latency is noisier than the mean
+	{}
+
+	const std::vector<BenchmarkScenario>& Benchmark::GetScenarios() {
+		// Small enough to finish in well under a minute on lavapipe
+		static const std::vector<BenchmarkScenario> scenarios{
+			{ "triangles", BenchmarkLoad::Triangles, 250000, 120, "tris/s" },
+			{ "draws_1k", BenchmarkLoad::Draws, 1000, 240, "draws/s" },
+			{ "draws_10k", BenchmarkLoad::Draws, 10000, 120, "draws/s" },
+			{ "pipelines", BenchmarkLoad::Pipelines, 64, 120, "pipelines/s" },
+			{ "uploads", BenchmarkLoad::Uploads, 768, 240, "MiB/s" },
+			{ "resizes", BenchmarkLoad::Resizes, 1, 40, "resizes/s", false }, // Recreating the swapchain allocates by design
+			{ "spatial_query", BenchmarkLoad::SpatialQueries, 100000, 120, "queries/s" },
+			{ "spatial_churn", BenchmarkLoad::SpatialChurn, 100000, 120, "moves/s" },
+			{ "particles_1m", BenchmarkLoad::Particles, 1000000, 120, "particles/s" },
+			{ "occlusion", BenchmarkLoad::Occlusion, 16384, 120, "objects/s" },
+		};
+
+		return scenarios;
+	}
+
+	float Benchmark::Random(uint32_t& state) {
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return float(state >> 8) / float(1u << 24);
+	}
+
+	void Benchmark::Begin(const BenchmarkScenario& scenario) {
+		m_pScenario = &scenario;
+		m_FrameTimes.clear();
+		m_FrameTimes.reserve(scenario.frames);
+		m_Work = 0.0;
+		m_WorkSeconds = 0.0;
+		m_Allocations = 0;
+	}
+
+	void Benchmark::AddFrame(double cpuMs, double work, uint64_t allocations) {
+		m_FrameTimes.push_back(cpuMs);
+		m_Allocations += allocations;
+		AddWork(work, cpuMs / 1000.0);
+	}
+
+	void Benchmark::AddWork(double work, double seconds) {
+		m_Work += work;
+		m_WorkSeconds += seconds;
+	}
+
+	void Benchmark::End(double gpuMs) {
+		BenchmarkResult result{};
+		result.scenario = m_pScenario->name;
+		result.unit = m_pScenario->unit;
+		result.gpuMs = gpuMs;
+		result.throughput = m_WorkSeconds > 0.0 ? m_Work / m_WorkSeconds : 0.0;
+		result.allocations = m_FrameTimes.empty() ? 0.0 : double(m_Allocations) / double(m_FrameTimes.size());
+		result.allocationFree = m_pScenario->allocationFree;
+
+		if (!m_FrameTimes.empty()) {
+			double sum{};
+			for (double time : m_FrameTimes) sum += time;
+			result.cpuMs = sum / double(m_FrameTimes.size());
+
+			std::sort(m_FrameTimes.begin(), m_FrameTimes.end());
+			result.cpuP95Ms = m_FrameTimes[std::min(m_FrameTimes.size() - 1, m_FrameTimes.size() * 95 / 100)];
+		}
+
+		m_Results.push_back(result);
+		m_pScenario = nullptr;
+	}
+
+	bool Benchmark::LoadBaseline(const std::string& path) {
+		std::ifstream file{ path };
+		if (!file.is_open()) return false;
+
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.rfind("# device: ", 0) == 0) m_BaselineDevice = line.substr(10);
+			if (line.empty() || line[0] == '#') continue;
+
+			std::istringstream stream{ line };
+			std::string first, second;
+			stream >> first >> second;
+
+			if (first == "threshold") {
+				double percent;
+				if (stream >> percent) m_Thresholds[second] = percent; // "threshold <metric> <percent>"
+				else m_Thresholds[""] = std::stod(second);
+			}
+			else {
+				double value;
+				if (!(stream >> value)) {
+					throw std::runtime_error("Failed to parse benchmark baseline line: " + line + "!");
+				}
+				m_Baseline[first + " " + second] = value;
+			}
+		}
+
+		return true;
+	}
+
+	void Benchmark::SaveBaseline(const std::string& path, const std::string& device) const {
+		std::ofstream file{ path };
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open file: " + path + "!");
+		}
+
+		file << "# vulkat benchmark baseline, regenerate with BENCH_UPDATE=1 make bench\n";
+		file << "# device: " << device << '\n';
+		for (const auto& threshold : m_Thresholds) {
+			if (threshold.first.empty()) file << "threshold " << threshold.second << '\n';
+			else file << "threshold " << threshold.first << ' ' << threshold.second << '\n';
+		}
+
+		file << std::fixed << std::setprecision(4);
+		for (const auto& result : m_Results) {
+			file << result.scenario << " cpu_ms " << result.cpuMs << '\n';
+			file << result.scenario << " cpu_p95_ms " << result.cpuP95Ms << '\n';
+			if (result.gpuMs > 0.0) file << result.scenario << " gpu_ms " << result.gpuMs << '\n';
+			file << result.scenario << " throughput " << result.throughput << '\n';
+		}
+	}
+
+	bool Benchmark::Compare(std::ostream& os) const {
+		bool passed{ true };
+
+		auto check = [&](const BenchmarkResult& result, const std::string& metric, double value, bool higherIsBetter) {
+			auto it{ m_Baseline.find(result.scenario + " " + metric) };
+			if (it == m_Baseline.end() || it->second <= 0.0 || value <= 0.0) return;
+
+			// Positive is worse, whichever way the metric goes
+			double change{ (higherIsBetter ? it->second - value : value - it->second) / it->second * 100.0 };
+			bool regressed{ change > GetThreshold(metric) };
+			passed = passed && !regressed;
+
+			os << '\t' << std::left << std::setw(12) << result.scenario << std::setw(12) << metric << std::right
+				<< std::fixed << std::setprecision(3) << std::setw(14) << value << " vs " << std::setw(14) << it->second
+				<< std::showpos << std::setprecision(1) << std::setw(8) << -change << std::noshowpos << "%"
+				<< (regressed ? "  REGRESSED" : "") << '\n';
+		};
+
+		os << "Compared with the baseline";
+		if (!m_BaselineDevice.empty()) os << " of " << m_BaselineDevice;
+		os << ":\n";
+
+		for (const auto& result : m_Results) {
+			check(result, "cpu_ms", result.cpuMs, false);
+			check(result, "cpu_p95_ms", result.cpuP95Ms, false);
+			check(result, "gpu_ms", result.gpuMs, false);
+			check(result, "throughput", result.throughput, true);
+		}
+		os.unsetf(std::ios::floatfield);
+
+		os << (passed ? "No regressions\n" : "Performance regressed past the threshold\n");
+		return passed;
+	}
+
+	bool Benchmark::CheckAllocations(std::ostream& os) const {
+		if (!AllocationCounter::IsEnabled()) return true;
+
+		bool passed{ true };
+		for (const auto& result : m_Results) {
+			if (!result.allocationFree || result.allocations == 0.0) continue;
+
+			os << '\t' << std::left << std::setw(12) << result.scenario << std::right << std::fixed << std::setprecision(1)
+				<< result.allocations << " allocs/frame  ALLOCATED\n";
+			passed = false;
+		}
+		os.unsetf(std::ios::floatfield);
+
+		if (!passed) os << "Steady state frames allocated\n";
+		return passed;
+	}
+
+	void Benchmark::Print(std::ostream& os) const {
+		os << "Benchmark results:\n";
+		for (const auto& result : m_Results) {
+			os << '\t' << std::left << std::setw(12) << result.scenario << std::right << std::fixed << std::setprecision(3)
+				<< "CPU " << std::setw(9) << result.cpuMs << " ms (p95 " << std::setw(9) << result.cpuP95Ms << " ms)"
+				<< " | GPU " << std::setw(9) << result.gpuMs << " ms | "
+				<< std::setprecision(1) << result.throughput << ' ' << result.unit;
+			if (AllocationCounter::IsEnabled()) os << " | " << result.allocations << " allocs/frame";
+			os << '\n';
+		}
+		os.unsetf(std::ios::floatfield);
+	}
+
+	double Benchmark::GetThreshold(const std::string& metric) const {
+		auto it{ m_Thresholds.find(metric) };
+		return it != m_Thresholds.end() ? it->second : m_Thresholds.at("");
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <map>
+
+namespace vulkat {
+	// Synthetic load a scenario puts on the renderer
+	enum class BenchmarkLoad {
+		Triangles, // One draw of count triangles
+		Draws, // count draws of the quad
+		Pipelines, // count distinct pipelines compiled, then one draw with each
+		Uploads, // count KiB copied through the upload ring every frame
+		Resizes, // Swapchain recreated every frame
+		SpatialQueries, // Frustum, ray and overlap queries on an AABB tree of count objects, timed on their own
+		SpatialChurn, // A tenth of count objects moved every frame, timed on their own
+		Particles, // count GPU simulated particles, emitted as fast as they die
+		Occlusion // count objects, all but one hidden behind it, culled on the GPU with -x
+	};
+
+	struct BenchmarkScenario {
+		const char* name;
+		BenchmarkLoad load;
+		uint32_t count;
+		uint32_t frames; // Measured, after the warm up
+		const char* unit; // Of the throughput
+		bool allocationFree{ true }; // Measured frames must not call operator new, checked unless built with COUNT_ALLOCATIONS=0
+	};
+
+	// What a scenario measured, cpu and gpu time per frame and load pushed per second
+	struct BenchmarkResult {
+		std::string scenario;
+		const char* unit;
+		double cpuMs{ 0.0 }; // Mean
+		double cpuP95Ms{ 0.0 };
+		double gpuMs{ 0.0 }; // 0 without timestamp queries
+		double throughput{ 0.0 };
+		double allocations{ 0.0 }; // operator new calls per measured frame
+		bool allocationFree{ true };
+	};
+
+	// Collects frame times per scenario and compares them with a stored baseline.
+	// The baseline is plain text, one "<scenario> <metric> <value>" per line, so it diffs well and can be edited by hand.
+	// "threshold <percent>" sets how far any metric may get worse, "threshold <metric> <percent>" overrides it per metric
+	class Benchmark final {
+	public:
+		Benchmark();
+
+		Benchmark(const Benchmark& other) = delete;
+		Benchmark(Benchmark&& other) = delete;
+		Benchmark& operator=(const Benchmark& other) = delete;
+		Benchmark& operator=(Benchmark&& other) = delete;
+
+		~Benchmark() = default;
+
+		static const std::vector<BenchmarkScenario>& GetScenarios();
+		static const uint32_t m_WarmupFrames{ 16 };
+
+		// Deterministic [0, 1), so every run loads the renderer the same way
+		static float Random(uint32_t& state);
+
+		void Begin(const BenchmarkScenario& scenario);
+		void AddFrame(double cpuMs, double work, uint64_t allocations); // work: load units the frame pushed
+		void AddWork(double work, double seconds); // Load measured outside the frames, eg. pipeline compiles
+		void End(double gpuMs);
+
+		// False if there is no baseline yet
+		bool LoadBaseline(const std::string& path);
+		void SaveBaseline(const std::string& path, const std::string& device) const;
+
+		// Prints every metric next to its baseline, false if any regressed past its threshold
+		bool Compare(std::ostream& os) const;
+
+		// False if a scenario that must not allocate did, baseline or not
+		bool CheckAllocations(std::ostream& os) const;
+		void Print(std::ostream& os) const;
+
+	private:
+		const BenchmarkScenario* m_pScenario;
+		std::vector<double> m_FrameTimes; // Of the running scenario, kept to avoid allocating between scenarios
+		double m_Work;
+		double m_WorkSeconds;
+		uint64_t m_Allocations; // Over the measured frames
+
+		std::vector<BenchmarkResult> m_Results;
+
+		std::map<std::string, double> m_Baseline; // "<scenario> <metric>" -> value
+		std::map<std::string, double> m_Thresholds; // Metric -> percent, "" is the default
+		std::string m_BaselineDevice;
+
+		double GetThreshold(const std::string& metric) const;
+	};
+}
+#endif // BENCHMARK_HPP
@@ -0,0 +1,280 @@
+#include "../pch.hpp"
+#include "clusteredlighting.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	// Matches the Light struct in light.comp and lit.frag
+	constexpr VkDeviceSize g_LightSize{ 2 * sizeof(glm::vec4) };
+
+	ClusteredLighting::ClusteredLighting()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pMemoryTracker{ nullptr }
+		, m_pDeletionQueue{ nullptr }
+		, m_Debug{ false }
+		, m_LightCount{ 0 }
+		, m_ClusterCount{ 0 }
+		, m_Constants{}
+		, m_LightBuffer{ VK_NULL_HANDLE }
+		, m_LightMemory{ VK_NULL_HANDLE }
+		, m_ClusterCountBuffer{ VK_NULL_HANDLE }
+		, m_ClusterCountMemory{ VK_NULL_HANDLE }
+		, m_ClusterLightBuffer{ VK_NULL_HANDLE }
+		, m_ClusterLightMemory{ VK_NULL_HANDLE }
+		, m_SetLayout{ VK_NULL_HANDLE }
+		, m_PipelineLayout{ VK_NULL_HANDLE }
+		, m_Pipelines{}
+		, m_DescriptorPool{ VK_NULL_HANDLE }
+		, m_DescriptorSet{ VK_NULL_HANDLE }
+	{}
+
+	void ClusteredLighting::Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+		VkShaderModule lightShader, uint32_t lightCount, bool debug) {
+		m_Device = device;
+		m_pMemoryTracker = pMemoryTracker;
+		m_pDeletionQueue = pDeletionQueue;
+		m_Debug = debug;
+
+		// One animate thread per light, in a single row of groups
+		m_LightCount = std::min(lightCount, 65535 * m_GroupSize);
+
+		m_Constants.lightCount = m_LightCount;
+		m_Constants.ambient = m_Ambient;
+		m_Constants.seed = 0x6b43a9b5u;
+
+		m_LightBuffer = CreateBuffer(VkDeviceSize(m_LightCount) * g_LightSize, m_LightMemory);
+
+		CreatePipelines(lightShader);
+
+		if (m_Debug) std::cout << m_LightCount << " clustered lights\n";
+	}
+
+	void ClusteredLighting::Cleanup() {
+		for (auto pipeline : m_Pipelines) {
+			vkDestroyPipeline(m_Device, pipeline, nullptr);
+		}
+		m_Pipelines.fill(VK_NULL_HANDLE);
+
+		vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr); // Frees the set with it
+		vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, nullptr);
+
+		DestroyClusters(false);
+
+		vkDestroyBuffer(m_Device, m_LightBuffer, nullptr);
+		m_pMemoryTracker->Free(m_LightMemory);
+
+		m_DescriptorPool = VK_NULL_HANDLE;
+		m_LightCount = 0;
+	}
+
+	void ClusteredLighting::Configure(VkExtent2D extent) {
+		const uint32_t tilesX{ (std::max(extent.width, 1u) + m_TileSize - 1) / m_TileSize };
+		const uint32_t tilesY{ (std::max(extent.height, 1u) + m_TileSize - 1) / m_TileSize };
+
+		m_Constants.viewportSize = glm::vec2{ float(std::max(extent.width, 1u)), float(std::max(extent.height, 1u)) };
+		m_Constants.tileSize = float(m_TileSize);
+		m_Constants.aspect = m_Constants.viewportSize.x / m_Constants.viewportSize.y;
+		m_Constants.grid = glm::uvec4{ tilesX, tilesY, m_SliceCount, m_MaxLightsPerCluster };
+
+		// Same grid, the buffers and set can stay
+		const uint32_t clusterCount{ tilesX * tilesY * m_SliceCount };
+		if (clusterCount == m_ClusterCount) return;
+
+		DestroyClusters(true);
+
+		m_ClusterCount = clusterCount;
+		m_ClusterCountBuffer = CreateBuffer(VkDeviceSize(m_ClusterCount) * sizeof(uint32_t), m_ClusterCountMemory);
+		m_ClusterLightBuffer = CreateBuffer(VkDeviceSize(m_ClusterCount) * m_MaxLightsPerCluster * sizeof(uint32_t), m_ClusterLightMemory);
+
+		CreateDescriptors();
+
+		if (m_Debug) {
+			std::cout << "Light grid " << tilesX << "x" << tilesY << "x" << m_SliceCount << ", "
+				<< (VkDeviceSize(m_ClusterCount) * (m_MaxLightsPerCluster + 1) * sizeof(uint32_t)) / 1024 << " KiB\n";
+		}
+	}
+
+	VkPushConstantRange ClusteredLighting::GetPushConstantRange() const {
+		return VkPushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Constants) };
+	}
+
+	void ClusteredLighting::Assign(VkCommandBuffer commandBuffer, float deltaTime) {
+		TRACE_SCOPE("AssignLights");
+
+		// Clamped so the lights don't jump across the screen after a stall
+		m_Constants.time += std::min(deltaTime, 0.1f);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
+
+		// Last frame's assign stage and main pass read what is written below
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		Dispatch(commandBuffer, Stage::Animate, m_LightCount);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		Dispatch(commandBuffer, Stage::Assign, m_ClusterCount);
+
+		// The main pass reads the lights and the clusters in lit.frag
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void ClusteredLighting::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+		// Stays bound across the pass's pipeline switches, they all share the layout
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Constants), &m_Constants);
+	}
+
+	void ClusteredLighting::DestroyClusters(bool deferred) {
+		if (m_ClusterCountBuffer == VK_NULL_HANDLE) return;
+
+		auto destroy{ [device = m_Device, pMemoryTracker = m_pMemoryTracker,
+			buffers = std::array<VkBuffer, 2>{ m_ClusterCountBuffer, m_ClusterLightBuffer },
+			memory = std::array<VkDeviceMemory, 2>{ m_ClusterCountMemory, m_ClusterLightMemory }]{
+			for (auto buffer : buffers) vkDestroyBuffer(device, buffer, nullptr);
+			for (auto block : memory) pMemoryTracker->Free(block);
+		} };
+
+		if (deferred) m_pDeletionQueue->Push(std::move(destroy));
+		else destroy();
+
+		m_ClusterCountBuffer = m_ClusterLightBuffer = VK_NULL_HANDLE;
+		m_ClusterCountMemory = m_ClusterLightMemory = VK_NULL_HANDLE;
+		m_ClusterCount = 0;
+	}
+
+	void ClusteredLighting::CreateDescriptors() {
+		// Frames in flight may still bind the old set
+		if (m_DescriptorPool != VK_NULL_HANDLE) {
+			m_pDeletionQueue->Push([device = m_Device, pool = m_DescriptorPool]{
+				vkDestroyDescriptorPool(device, pool, nullptr);
+			});
+		}
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = 3;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create light descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = m_DescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &m_SetLayout;
+
+		if (vkAllocateDescriptorSets(m_Device, &allocateInfo, &m_DescriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate light descriptor set!");
+		}
+
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos{ {
+			{ m_LightBuffer, 0, VK_WHOLE_SIZE },
+			{ m_ClusterCountBuffer, 0, VK_WHOLE_SIZE },
+			{ m_ClusterLightBuffer, 0, VK_WHOLE_SIZE },
+		} };
+
+		std::array<VkWriteDescriptorSet, 3> writes{};
+		for (uint32_t i{}; i < writes.size(); ++i) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_DescriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(m_Device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void ClusteredLighting::CreatePipelines(VkShaderModule module) {
+		TRACE_SCOPE("CreateLightPipelines");
+
+		// 0: lights, 1: cluster counts, 2: cluster light indices. Written by the compute stages, read by lit.frag
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		for (uint32_t i{}; i < bindings.size(); ++i) {
+			bindings[i] = { i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = uint32_t(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_SetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create light descriptor set layout!");
+		}
+
+		VkPushConstantRange pushConstantRange{ GetPushConstantRange() };
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &m_SetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create light pipeline layout!");
+		}
+
+		// One module, a pipeline per stage
+		const uint32_t stageCount{ uint32_t(Stage::StageCount) };
+		std::array<uint32_t, stageCount> stages{};
+		std::array<VkSpecializationInfo, stageCount> specializations{};
+		std::array<VkComputePipelineCreateInfo, stageCount> pipelineInfos{};
+
+		VkSpecializationMapEntry entry{};
+		entry.constantID = 0;
+		entry.offset = 0;
+		entry.size = sizeof(uint32_t);
+
+		for (uint32_t i{}; i < stageCount; ++i) {
+			stages[i] = i;
+
+			specializations[i].mapEntryCount = 1;
+			specializations[i].pMapEntries = &entry;
+			specializations[i].dataSize = sizeof(uint32_t);
+			specializations[i].pData = &stages[i];
+
+			pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineInfos[i].stage.module = module;
+			pipelineInfos[i].stage.pName = "main";
+			pipelineInfos[i].stage.pSpecializationInfo = &specializations[i];
+			pipelineInfos[i].layout = m_PipelineLayout;
+			pipelineInfos[i].basePipelineIndex = -1;
+		}
+
+		if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, stageCount, pipelineInfos.data(), nullptr, m_Pipelines.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create light compute pipelines!");
+		}
+	}
+
+	void ClusteredLighting::Dispatch(VkCommandBuffer commandBuffer, Stage stage, uint32_t count) {
+		if (count == 0) return;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipelines[size_t(stage)]);
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(Constants), &m_Constants);
+		vkCmdDispatch(commandBuffer, (count + m_GroupSize - 1) / m_GroupSize, 1, 1);
+	}
+
+	VkBuffer ClusteredLighting::CreateBuffer(VkDeviceSize size, VkDeviceMemory& memory) {
+		// No lights still needs a valid buffer
+		return m_pMemoryTracker->CreateBuffer(std::max(size, VkDeviceSize(16)), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Storage, memory);
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef CLUSTEREDLIGHTING_HPP
+#define CLUSTEREDLIGHTING_HPP
+
+#include <array>
+
+#include "memorytracker.hpp"
+#include "deletionqueue.hpp"
+
+namespace vulkat {
+	// Clustered forward lighting. The viewport is split into a froxel grid of screen tiles times depth slices,
+	// a compute pass bins every light into the clusters its sphere touches, and lit.frag only loops over the
+	// lights of its own cluster, so shading cost follows the local light density rather than the light count.
+	// Stages of shaders/light.comp, in recording order: animate -> assign
+	class ClusteredLighting final {
+	public:
+		ClusteredLighting();
+
+		ClusteredLighting(const ClusteredLighting& other) = delete;
+		ClusteredLighting(ClusteredLighting&& other) = delete;
+		ClusteredLighting& operator=(const ClusteredLighting& other) = delete;
+		ClusteredLighting& operator=(ClusteredLighting&& other) = delete;
+
+		~ClusteredLighting() = default;
+
+		// lightShader is light.comp
+		void Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+			VkShaderModule lightShader, uint32_t lightCount, bool debug);
+		void Cleanup();
+
+		// After every swapchain recreation, the grid follows the extent. The old clusters outlive the frames using them
+		void Configure(VkExtent2D extent);
+
+		// Set 0 and the push constants of every pipeline that shades with lit.frag
+		VkDescriptorSetLayout GetSetLayout() const { return m_SetLayout; }
+		VkPushConstantRange GetPushConstantRange() const;
+
+		// Compute passes, outside any render pass, before the main pass
+		void Assign(VkCommandBuffer commandBuffer, float deltaTime);
+
+		// Inside the main pass, before its draws. pipelineLayout has GetSetLayout() as set 0
+		void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+		uint32_t GetLightCount() const { return m_LightCount; }
+
+	private:
+		enum class Stage : uint32_t {
+			Animate,
+			Assign,
+			StageCount
+		};
+
+		// Same block in light.comp and lit.frag
+		struct Constants {
+			glm::vec2 viewportSize;
+			float tileSize;
+			float aspect;
+			glm::uvec4 grid;
+			uint32_t lightCount;
+			float time;
+			float ambient;
+			uint32_t seed;
+		};
+
+		static constexpr uint32_t m_GroupSize{ 64 }; // local_size_x of light.comp
+		static constexpr uint32_t m_TileSize{ 64 }; // Pixels per cluster, in x and y
+		static constexpr uint32_t m_SliceCount{ 16 }; // Depth slices
+		static constexpr uint32_t m_MaxLightsPerCluster{ 128 }; // More are dropped, the grid stays a fixed size
+		static constexpr float m_Ambient{ 0.1f };
+
+		VkDevice m_Device;
+		MemoryTracker* m_pMemoryTracker;
+		DeletionQueue* m_pDeletionQueue;
+		bool m_Debug;
+
+		uint32_t m_LightCount;
+		uint32_t m_ClusterCount;
+		Constants m_Constants; // Pushed by both the compute passes and Bind()
+
+		VkBuffer m_LightBuffer; // Written by the animate stage every frame
+		VkDeviceMemory m_LightMemory;
+		VkBuffer m_ClusterCountBuffer;
+		VkDeviceMemory m_ClusterCountMemory;
+		VkBuffer m_ClusterLightBuffer; // m_MaxLightsPerCluster indices per cluster
+		VkDeviceMemory m_ClusterLightMemory;
+
+		VkDescriptorSetLayout m_SetLayout;
+		VkPipelineLayout m_PipelineLayout;
+		std::array<VkPipeline, size_t(Stage::StageCount)> m_Pipelines;
+		VkDescriptorPool m_DescriptorPool; // Replaced with the cluster buffers, sets in use are never updated
+		VkDescriptorSet m_DescriptorSet;
+
+		void DestroyClusters(bool deferred);
+		void CreateDescriptors();
+		void CreatePipelines(VkShaderModule module);
+
+		void Dispatch(VkCommandBuffer commandBuffer, Stage stage, uint32_t count);
+		VkBuffer CreateBuffer(VkDeviceSize size, VkDeviceMemory& memory);
+	};
+}
+#endif // CLUSTEREDLIGHTING_HPP
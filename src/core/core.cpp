@@ -2,6 +2,11 @@
 #include "core.hpp"
 #include <vulkan/vulkan_core.h>
 
+#include <cctype> // Device name matching
+#include <cstdlib> // std::getenv
+
+#include <glm/gtc/matrix_transform.hpp> // Benchmark frustums
+
 namespace debug {
 	// CreateDebugUtilsMessengerEXT Proxy function (GLOBAL FUNCTION, maybe throw this in wrapper class "Validation")
 	VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
@@ -43,19 +48,56 @@ namespace vulkat{
 		0, 1, 2, 2, 3, 0
 	};
 
-	const int Core::m_MaxFramesInFlight{ 2 };
+	const VkDeviceSize Core::m_UploadSliceSize{ 1024 * 1024 };
 
 	// Public functions
-	Core::Core(const Window& window, bool debug)
+	Core::Core(const Window& window, const Settings& settings)
 		: m_WindowProperties{ window }
-		, m_Debug{ debug }
+		, m_Settings{ settings }
+		, m_Debug{ settings.debug }
+		, m_LatencyMode{ !settings.benchmarkBaseline.empty() ? LatencyMode::Uncapped // Vsync would measure the display
+			: settings.latencyMode != LatencyMode::FromWindow ? settings.latencyMode
+			: window.isVsyncOn ? LatencyMode::Vsync : LatencyMode::Uncapped }
+		, m_OcclusionCulling{ settings.occlusionCulling }
+		, m_DepthPrepass{ settings.depthPrepass || settings.occlusionCulling } // The early cull pass feeds it
+		, m_LitShading{ settings.lightCount > 0 || settings.shadows } // The sun is added in lit.frag
 		, m_pWindow{ nullptr }
 		, m_pInstance{ nullptr }
+		, m_InstanceVersion{ VK_API_VERSION_1_0 }
 		, m_pDebugMessenger{ nullptr }
 		, m_PhysicalDevice{ VK_NULL_HANDLE }
+		, m_SwapChain{ VK_NULL_HANDLE }
+		, m_DepthPass{ 0 }
+		, m_LateDepthPass{ 0 }
+		, m_MainPass{ 0 }
+		, m_DepthResource{ 0 }
+		, m_DepthFormat{ VK_FORMAT_UNDEFINED }
+		, m_RenderPass{ VK_NULL_HANDLE }
+		, m_PipelineKey{ 0 }
+		, m_DepthPipelineKey{ 0 }
+		, m_MeshLod{ 0 }
+		, m_SceneMeshLod{ UINT32_MAX }
+		, m_MeshTransform{ 0 }
+		, m_InstanceBuffer{ VK_NULL_HANDLE }
+		, m_InstanceBufferMemory{ VK_NULL_HANDLE }
+		, m_InstanceCapacity{ 0 }
+		, m_ParticlePipelineKey{ 0 }
+		, m_LastRecord{ std::chrono::steady_clock::now() }
+		, m_ShadowPipelineKey{ 0 }
+		, m_pUploadData{ nullptr }
 		, m_CurrentFrame{ 0 }
 		, m_FramebufferResized{ false }
+		, m_TraceFlushRequested{ false }
+		, m_ScratchArena{ 16 * 1024 }
+		, m_pBenchmarkScenario{ nullptr }
+		, m_BenchmarkMesh{}
+		, m_BenchmarkUploadBuffer{ VK_NULL_HANDLE }
+		, m_BenchmarkUploadBufferMemory{ VK_NULL_HANDLE }
+		, m_BenchmarkSeed{ 0x9e3779b9u }
 	{
+		Trace::SetThreadName("Main");
+		Trace::Enable(!m_Settings.tracePath.empty()); // Before Initialize, so the init stages are on the timeline
+
 		Initialize();
 	}
 
@@ -64,78 +106,327 @@ namespace vulkat{
 	}
 
 	void Core::Run() {
+		using Clock = std::chrono::steady_clock;
+
+		bool firstFrame{ true };
+		Clock::time_point frameStart{ Clock::now() };
+		Clock::time_point lastStats{ frameStart };
+		uint64_t allocationsStart{ AllocationCounter::Get() };
+
 		// Run as long as window is not closed
 		while (!glfwWindowShouldClose(m_pWindow)) {
+			if (m_LatencyMode == LatencyMode::LowLatency) {
+				// Wait for the GPU and the frame slot before sampling input, not after, so nothing queues up behind stale input
+				TRACE_SCOPE("WaitForFrameFence");
+				m_Frames[m_CurrentFrame]->Wait();
+				m_FramePacer.WaitForNextFrame();
+			}
+
 			glfwPollEvents(); // Get events
+			m_FramePacer.MarkInputSampled();
+
 			DrawFrame(); // Draw frames
+
+			Clock::time_point frameEnd{ Clock::now() };
+			m_CpuFrameTime.Add(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+			frameStart = frameEnd;
+
+			uint64_t allocationsEnd{ AllocationCounter::Get() };
+			m_AllocationsPerFrame.Add(double(allocationsEnd - allocationsStart));
+			allocationsStart = allocationsEnd;
+
+			if ((m_Settings.printFrameStats || m_Settings.printMemoryStats) && frameEnd - lastStats >= std::chrono::seconds{ 1 }) {
+				lastStats = frameEnd;
+				m_MemoryTracker.UpdateBudget();
+
+				if (m_Settings.printFrameStats) PrintFrameStats();
+				if (m_Settings.printMemoryStats) {
+					m_MemoryTracker.Print(std::cout);
+					m_Geometry.PrintStats(std::cout);
+					std::cout << '\n';
+				}
+			}
+
+			if (m_TraceFlushRequested) {
+				m_TraceFlushRequested = false;
+				Trace::Flush(m_Settings.tracePath);
+				if (m_Debug) std::cout << "Trace written to " << m_Settings.tracePath << '\n';
+			}
+
+			if (firstFrame) {
+				firstFrame = false;
+				m_StartupProfiler.Mark("First frame");
+
+				if (m_Debug) {
+					m_StartupProfiler.Print();
+					m_PipelineRegistry.PrintStats();
+					m_MemoryTracker.Print(std::cout);
+				}
+				if (!m_Settings.startupProfilePath.empty()) m_StartupProfiler.WriteJson(m_Settings.startupProfilePath);
+			}
+		}
+
+		vkDeviceWaitIdle(m_Device);
+
+		if (Trace::IsEnabled()) Trace::Flush(m_Settings.tracePath);
+	}
+
+	bool Core::RunBenchmark() {
+		using Clock = std::chrono::steady_clock;
+
+		Benchmark benchmark{};
+		bool hasBaseline{ benchmark.LoadBaseline(m_Settings.benchmarkBaseline) };
+
+		std::cout << "Benchmarking on " << m_Capabilities.properties.deviceName << '\n';
+
+		for (const auto& scenario : Benchmark::GetScenarios()) {
+			TRACE_SCOPE(scenario.name);
+			if (m_Debug) std::cout << "Scenario " << scenario.name << '\n';
+
+			benchmark.Begin(scenario);
+			BeginBenchmarkScenario(scenario, benchmark);
+
+			// GPU times of the measured frames only, the rolling average would still hold the previous scenario's
+			double gpuTotalStart{ 0.0 };
+			uint64_t gpuFramesStart{ 0 };
+
+			// Warm up first, the first frames of a scenario pay for its uploads and for pipelines the driver compiles lazily
+			for (uint32_t i{}; i < Benchmark::m_WarmupFrames + scenario.frames; ++i) {
+				if (glfwWindowShouldClose(m_pWindow)) {
+					throw std::runtime_error("Failed to finish the benchmark, the window was closed!");
+				}
+
+				// Results arrive frames in flight late, the ones from here on are still this scenario's warmed up frames
+				if (i == Benchmark::m_WarmupFrames) {
+					gpuTotalStart = m_GpuProfiler.GetTotalFrameMs();
+					gpuFramesStart = m_GpuProfiler.GetFrameCount();
+				}
+
+				Clock::time_point frameStart{ Clock::now() };
+				uint64_t allocationsStart{ AllocationCounter::Get() };
+
+				glfwPollEvents();
+				double work{ PrepareBenchmarkFrame(i, benchmark) };
+				DrawFrame();
+
+				if (i >= Benchmark::m_WarmupFrames) {
+					benchmark.AddFrame(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count(), work,
+						AllocationCounter::Get() - allocationsStart);
+				}
+			}
+
+			const uint64_t gpuFrames{ m_GpuProfiler.GetFrameCount() - gpuFramesStart };
+			benchmark.End(gpuFrames > 0 ? (m_GpuProfiler.GetTotalFrameMs() - gpuTotalStart) / double(gpuFrames) : 0.0);
+			EndBenchmarkScenario();
 		}
 
 		vkDeviceWaitIdle(m_Device);
+		if (Trace::IsEnabled()) Trace::Flush(m_Settings.tracePath);
+
+		benchmark.Print(std::cout);
+
+		// Zero allocations in steady state is a requirement, not a metric that may drift within a threshold
+		const bool allocationFree{ benchmark.CheckAllocations(std::cout) };
+
+		if (!hasBaseline || m_Settings.updateBaseline) {
+			benchmark.SaveBaseline(m_Settings.benchmarkBaseline, m_Capabilities.properties.deviceName);
+			std::cout << "Baseline written to " << m_Settings.benchmarkBaseline << '\n';
+			return allocationFree;
+		}
+
+		return benchmark.Compare(std::cout) && allocationFree;
 	}
 
 	// Private functions
 	void Core::Initialize() {
-		// Init glfw
-		glfwInit();
+		m_StartupProfiler.Stage("Window", [this]{
+			// Init glfw
+			glfwInit();
+
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // disable opengl
+			glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // disable resizing
+
+			// Init the window
+			m_pWindow = glfwCreateWindow(
+					m_WindowProperties.width,
+					m_WindowProperties.height,
+					m_WindowProperties.title.c_str(),
+					nullptr, // not fullscreen
+					nullptr // don't share resources with other windows (opengl only)
+			);
+
+			glfwSetWindowUserPointer(m_pWindow, this); // Set a pointer to Core for glfw callback
+			glfwSetFramebufferSizeCallback(m_pWindow, FramebufferResizeCallback); // Set callback function for when window gets resized
+			glfwSetKeyCallback(m_pWindow, KeyCallback);
+
+			if (m_LatencyMode == LatencyMode::LowLatency) {
+				double fps{ m_Settings.targetFps };
+				if (fps <= 0.0) {
+					const GLFWvidmode* pMode{ glfwGetVideoMode(glfwGetPrimaryMonitor()) };
+					fps = (pMode && pMode->refreshRate > 0) ? double(pMode->refreshRate) : 60.0;
+				}
+
+				m_FramePacer.SetTargetFps(fps);
+				if (m_Debug) std::cout << "Frame limiter at " << fps << " fps\n";
+			}
+		});
 
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // disable opengl
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // disable resizing
+		// Init Vulkan
+		m_StartupProfiler.Stage("CreateInstance", [this]{ CreateInstance(); });
+		m_StartupProfiler.Stage("SetupDebugMessenger", [this]{ SetupDebugMessenger(); });
+		m_StartupProfiler.Stage("CreateSurface", [this]{ CreateSurface(); });
+		m_StartupProfiler.Stage("PickPhysicalDevice", [this]{ PickPhysicalDevice(); });
+		m_StartupProfiler.Stage("CreateLogicalDevice", [this]{ CreateLogicalDevice(); });
+		m_DeletionQueue.Initialize(&m_GraphicsTimeline);
+		m_ShaderCache.Initialize(m_Device, m_Debug);
+		m_PipelineRegistry.Initialize(m_Device, &m_ShaderCache, &m_ThreadPool, m_Debug);
+		m_RenderGraph.Initialize(m_Device, &m_GpuProfiler, &m_MemoryTracker, m_Debug);
+		m_DrawQueue.Initialize(&m_ThreadPool);
+
+		// Everything below only needs the device, so independent stages overlap:
+		// worker: shaders -> pipeline compile, main: swapchain -> render graph -> geometry upload
+		// The worker only touches the shader cache until it is joined
+		std::future<void> shaders{ m_ThreadPool.Submit([this]{
+			m_StartupProfiler.Stage("LoadShaders", [this]{
+				m_ShaderCache.Get(SHADER(vert.spv));
+				m_ShaderCache.Get(SHADER(frag.spv));
+
+				if (m_OcclusionCulling) {
+					m_ShaderCache.Get(SHADER(hiz_comp.spv));
+					m_ShaderCache.Get(SHADER(cull_comp.spv));
+				}
+
+				if (m_LitShading) {
+					m_ShaderCache.Get(m_Settings.shadows ? SHADER(lit_shadow_frag.spv) : SHADER(lit_frag.spv));
+					m_ShaderCache.Get(SHADER(light_comp.spv));
+				}
+
+				if (m_Settings.shadows) m_ShaderCache.Get(SHADER(shadow_vert.spv));
+			});
+		}) };
+
+		m_StartupProfiler.Stage("CreateSwapChain", [this]{ CreateSwapChain(); });
+		m_StartupProfiler.Stage("CreateImageViews", [this]{ CreateImageViews(); });
+		m_StartupProfiler.Stage("CreateRenderGraph", [this]{ CreateRenderGraph(); }); // Render passes and framebuffers
+
+		shaders.get(); // Rethrows anything the worker threw
+
+		// Before the pipelines, its set layout is part of the main pipeline layout
+		if (m_LitShading) {
+			m_StartupProfiler.Stage("CreateClusteredLighting", [this]{
+				m_Lighting.Initialize(m_Device, &m_MemoryTracker, &m_DeletionQueue,
+					m_ShaderCache.Get(SHADER(light_comp.spv)), m_Settings.lightCount, m_Debug);
+				m_Lighting.Configure(m_SwapChainExtent);
+			});
+		}
 
-		// Init the window
-		m_pWindow = glfwCreateWindow(
-				m_WindowProperties.width,
-				m_WindowProperties.height,
-				m_WindowProperties.title.c_str(),
-				nullptr, // not fullscreen
-				nullptr // don't share resources with other windows (opengl only)
- 		);
+		// Same for the shadow map's set, and the cascade pipeline is requested with the others
+		if (m_Settings.shadows) {
+			m_StartupProfiler.Stage("CreateShadowCascades", [this]{
+				m_Shadows.Initialize(m_Device, &m_MemoryTracker, SHADER(shadow_vert.spv), m_Debug);
+			});
+		}
 
-		glfwSetWindowUserPointer(m_pWindow, this); // Set a pointer to Core for glfw callback
-		glfwSetFramebufferSizeCallback(m_pWindow, FramebufferResizeCallback); // Set callback function for when window gets resized
+		m_StartupProfiler.Stage("CreateGraphicsPipeline", [this]{ CreateGraphicsPipeline(); }); // Queues the compile on the thread pool
 
-		// Init Vulkan
-		CreateInstance();
-		SetupDebugMessenger();
-		CreateSurface();
-		PickPhysicalDevice();
-		CreateLogicalDevice();
+		if (m_Settings.particleCount > 0) {
+			m_StartupProfiler.Stage("CreateParticleSystem", [this]{ CreateParticleSystem(m_Settings.particleCount); });
+		}
 
-		CreateSwapChain();
-		CreateImageViews();
-		CreateRenderPass();
-		CreateGraphicsPipeline();
-		CreateFramebuffers();
-		CreateCommandPool();
-		CreateBuffer<Vertex>(vertices, m_VertexBuffer, m_VertexBufferMemory, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-		CreateBuffer<uint16_t>(indices, m_IndexBuffer, m_IndexBufferMemory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-		CreateCommandBuffers();
+		if (m_OcclusionCulling) {
+			m_StartupProfiler.Stage("CreateOcclusionCuller", [this]{
+				const VkPhysicalDeviceLimits& limits{ m_Capabilities.properties.limits };
+				m_Culler.Initialize(m_Device, &m_MemoryTracker, &m_DeletionQueue,
+					m_ShaderCache.Get(SHADER(hiz_comp.spv)), m_ShaderCache.Get(SHADER(cull_comp.spv)), m_Settings.framesInFlight,
+					m_Capabilities.features.multiDrawIndirect ? limits.maxDrawIndirectCount : 1, m_Debug);
+				m_Culler.Configure(m_RenderGraph.GetImageView(m_DepthResource), m_SwapChainExtent);
+			});
+		}
 
-		CreateSyncObjects();
+		m_StartupProfiler.Stage("CreateCommandPool", [this]{ CreateCommandPool(); });
+		m_StartupProfiler.Stage("GenerateMeshLods", [this]{
+			std::vector<glm::vec3> positions{};
+			for (const auto& vertex : vertices) positions.push_back(glm::vec3{ vertex.pos, 0.f });
+
+			m_MeshLods = MeshLod::Generate(positions, std::vector<uint32_t>(indices.begin(), indices.end()));
+			if (m_Debug) std::cout << m_MeshLods.levels.size() << " mesh LODs\n";
+		});
+		m_StartupProfiler.Stage("UploadMesh", [this]{
+			m_Geometry.Initialize(m_Device, &m_MemoryTracker, &m_DeletionQueue, sizeof(Vertex), m_Debug);
+			m_Mesh = UploadMesh(vertices, m_MeshLods.indices);
+		});
+
+		// Scene: a root with the mesh under it, both static so they cost nothing after the first frame
+		uint32_t sceneRoot{ m_Transforms.Create() };
+		m_MeshTransform = m_Transforms.Create(sceneRoot);
+
+		// The first frame needs the base pipeline, it's also the fallback of main pass draws whose pipeline is still compiling
+		m_StartupProfiler.Stage("WaitGraphicsPipeline", [this]{
+			m_PipelineRegistry.Wait(m_PipelineKey);
+			if (m_DepthPrepass) m_PipelineRegistry.Wait(m_DepthPipelineKey);
+			if (m_Settings.shadows) m_PipelineRegistry.Wait(m_ShadowPipelineKey);
+		});
+
+		m_StartupProfiler.Stage("CreateFrameContexts", [this]{ CreateFrameContexts(); });
 	}
 
 	void Core::Cleanup() {
 		// Clean up Vulkan objects
 
+		// Write the frames still being read back, then free the readback ring
+		m_FrameCapture.Cleanup();
+
 		CleanupSwapChain();
 
-		// Destroy index buffer
-		vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
-		vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
+		// The device is idle, everything still queued for deletion can go
+		m_DeletionQueue.Flush();
 
-		// Destroy vertex buffer
-		vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
-		vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
+		// Destroy timestamp queries
+		m_GpuProfiler.Cleanup();
 
-		// Destroy semaphores and fences
-		for (size_t i{}; i < m_MaxFramesInFlight; ++i){
-			vkDestroySemaphore(m_Device, m_RenderFinishedSemaphores[i], nullptr);
-			vkDestroySemaphore(m_Device, m_ImageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(m_Device, m_InFlightFences[i], nullptr);
+		// Destroy particle buffers and compute pipelines
+		if (m_pParticles) {
+			m_pParticles->Cleanup();
+			m_pParticles.reset();
 		}
 
+		// Destroy the Hi-Z pyramid, cull buffers and pipelines
+		if (m_OcclusionCulling) m_Culler.Cleanup();
+
+		// Destroy the light and cluster buffers and the assignment pipelines
+		if (m_LitShading) m_Lighting.Cleanup();
+
+		// Destroy the shadow map, its passes and the cascade uniforms
+		if (m_Settings.shadows) m_Shadows.Cleanup();
+
+		// Destroy instance buffer
+		vkDestroyBuffer(m_Device, m_InstanceBuffer, nullptr);
+		m_MemoryTracker.Free(m_InstanceBufferMemory);
+
+		// Destroy the vertex and index pages of every mesh
+		m_Geometry.Cleanup();
+
+		// Destroy per frame command pools and semaphores, their deferred deletions already ran in the flush above
+		for (auto& frame : m_Frames) {
+			frame->Cleanup();
+		}
+		m_Frames.clear();
+
+		// Destroy upload ring
+		vkUnmapMemory(m_Device, m_UploadBufferMemory);
+		vkDestroyBuffer(m_Device, m_UploadBuffer, nullptr);
+		m_MemoryTracker.Free(m_UploadBufferMemory);
+
+		// Destroy the graphics timeline, or the fences standing in for it
+		m_GraphicsTimeline.Cleanup();
+
 		// Destroy command pool
 		vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
 
+		// Destroy pipeline cache and cached shader modules
+		m_PipelineRegistry.Cleanup();
+		m_ShaderCache.Cleanup();
+
 		vkDestroyDevice(m_Device, nullptr);
 
 		// Destroy debug messengers
@@ -154,25 +445,35 @@ namespace vulkat{
 		glfwTerminate();
 	}
 
-	std::vector<char> Core::ReadFile(const std::string& filename, bool debug) {
-		std::ifstream file{filename, std::ios::ate | std::ios::binary}; // ate: read from the end, binary: read in binary format
+	void Core::PrintFrameStats() const {
+		std::cout << std::fixed << std::setprecision(3) << "CPU " << m_CpuFrameTime.Get() << " ms | ";
+		m_GpuProfiler.Print(std::cout);
 
-		if (!file.is_open()) {
-			throw std::runtime_error("Failed to open file: " + filename + "!");
-		}
-		else {
-			if (debug) std::cout << "File " << filename << " read correctly.\n";
+		if (m_GpuProfiler.HasStatistics()) {
+			double pixels{ double(m_SwapChainExtent.width) * double(m_SwapChainExtent.height) };
+			std::cout << std::fixed << std::setprecision(2) << " | Overdraw " << m_GpuProfiler.GetFragmentInvocations() / pixels << "x";
 		}
 
-		size_t fileSize = size_t(file.tellg()); // Get filesize by position because we read from the end
-		std::vector<char> buffer(fileSize); // Allocate a buffer of that size
+		std::cout << " | ";
+		m_DrawQueue.PrintStats(std::cout);
 
-		file.seekg(0); // Go to the beginning
-		file.read(buffer.data(), fileSize); // Read the file into the buffer
+		if (m_OcclusionCulling) {
+			std::cout << " | ";
+			m_Culler.PrintStats(std::cout);
+		}
+
+		if (m_Settings.shadows) {
+			std::cout << " | ";
+			m_Shadows.PrintStats(std::cout);
+		}
 
-		file.close();
+		std::cout << std::fixed << std::setprecision(3) << " | Input to present " << m_FramePacer.GetLatencyMs() << " ms | ";
+		m_MemoryTracker.PrintSummary(std::cout);
 
-		return buffer;
+		if (AllocationCounter::IsEnabled()) {
+			std::cout << std::fixed << std::setprecision(1) << " | " << m_AllocationsPerFrame.Get() << " allocs/frame";
+		}
+		std::cout << '\n';
 	}
 
 	void Core::FramebufferResizeCallback(GLFWwindow* window, int width, int height) {
@@ -180,50 +481,22 @@ namespace vulkat{
 		core->m_FramebufferResized = true;
 	}
 
-	uint32_t Core::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memProperties);
+	void Core::KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		auto core = reinterpret_cast<Core*>(glfwGetWindowUserPointer(window));
 
-		for (uint32_t i{}; i < memProperties.memoryTypeCount; ++i) {
-			// Find idx of suitable memory type by iterating over them and checking if corresponding bit is set
-			// Additionally, check memoryTypes for memory with specified properties
-			if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
-			}
+		// F12: write the trace recorded so far (flushed from the loop, not from inside glfwPollEvents)
+		if (key == GLFW_KEY_F12 && action == GLFW_PRESS && Trace::IsEnabled()) {
+			core->m_TraceFlushRequested = true;
 		}
-
-		throw std::runtime_error("Failed to find suitable memory type!");
 	}
 
-	void Core::CreateVkBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-		VkBufferCreateInfo bufferInfo{};
-
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = usage;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		if (vkCreateBuffer(m_Device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create buffer!");
-		}
-
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(m_Device, buffer, &memRequirements);
-
-		VkMemoryAllocateInfo allocInfo{};
-
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate buffer memory!");
-		}
-
-		vkBindBufferMemory(m_Device, buffer, bufferMemory, 0);
+	void Core::CreateVkBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+		buffer = m_MemoryTracker.CreateBuffer(size, usage, properties, category, bufferMemory);
 	}
 
-	void Core::CopyVkBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+	uint64_t Core::CopyVkBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset) {
+		TRACE_SCOPE("CopyVkBuffer");
+
 		VkCommandBufferAllocateInfo allocateInfo{};
 
 		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -243,12 +516,21 @@ namespace vulkat{
 
 		VkBufferCopy copyRegion{};
 
-		copyRegion.srcOffset = 0;
-		copyRegion.dstOffset = 0;
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
 		copyRegion.size = size;
 
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
+		// Nobody waits for the copy, frames submitted after it on the same queue are ordered by this barrier
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
 		vkEndCommandBuffer(commandBuffer);
 
 		VkSubmitInfo submitInfo{};
@@ -257,10 +539,13 @@ namespace vulkat{
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
 
-		vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(m_GraphicsQueue);
+		uint64_t value{ m_GraphicsTimeline.Submit(m_GraphicsQueue, submitInfo) };
 
-		vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
+		m_DeletionQueue.Push(value, [this, commandBuffer]{
+			vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
+		});
+
+		return value;
 	}
 
 	// Extension support
@@ -339,6 +624,14 @@ namespace vulkat{
 			throw std::runtime_error("Validation layer requested, but none available!");
 		}
 
+		// vkEnumerateInstanceVersion only exists from 1.1 on, a 1.0 loader doesn't have it
+		auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+		if (enumerateInstanceVersion != nullptr) {
+			enumerateInstanceVersion(&m_InstanceVersion);
+		}
+		// Nothing past 1.2 is used (timeline semaphores), a 1.0 instance still works with fallbacks
+		m_InstanceVersion = std::min(m_InstanceVersion, VK_API_VERSION_1_2);
+
 		// Optional: Info about the app
 		// APPINFO
 		VkApplicationInfo appInfo{}; // pNext gets initialized to nullptr
@@ -347,7 +640,7 @@ namespace vulkat{
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = ENGINE;
 		appInfo.engineVersion = VK_MAKE_VERSION(VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = m_InstanceVersion;
 		// END APPINFO
 
 		// Not Optional: Vulkan extensions and validation layers
@@ -423,39 +716,171 @@ namespace vulkat{
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		vkEnumeratePhysicalDevices(m_pInstance, &deviceCount, devices.data()); // fill the array
 
+		std::vector<DeviceCapabilities> candidates;
 		for (const auto& device : devices) {
-			if (IsDeviceSuitable(device)) {
-				m_PhysicalDevice = device;
-				break;
+			candidates.push_back(QueryDeviceCapabilities(device));
+		}
+
+		// Highest score among the suitable devices, a discrete GPU wins over an integrated one or a software rasterizer
+		int chosen{ -1 };
+		for (size_t i{}; i < candidates.size(); ++i) {
+			if (candidates[i].suitable && (chosen < 0 || candidates[i].score > candidates[chosen].score)) {
+				chosen = int(i);
+			}
+		}
+
+		// Override by index or by (part of the) name, the command line wins over the environment
+		std::string override{ m_Settings.device };
+		if (override.empty()) {
+			if (const char* pEnv{ std::getenv("VULKAT_DEVICE") }) override = pEnv;
+		}
+
+		if (!override.empty()) {
+			auto lower{ [](std::string text) {
+				std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+				return text;
+			} };
+
+			const bool isIndex{ std::all_of(override.begin(), override.end(), [](unsigned char c) { return std::isdigit(c) != 0; }) };
+
+			int requested{ -1 };
+			for (size_t i{}; i < candidates.size() && requested < 0; ++i) {
+				bool match{ isIndex ? std::to_string(i) == override
+					: lower(candidates[i].properties.deviceName).find(lower(override)) != std::string::npos };
+				if (match) requested = int(i);
+			}
+
+			if (requested < 0) {
+				std::cerr << "No GPU matches '" << override << "', picking one by score\n";
+			}
+			else if (!candidates[requested].suitable) {
+				std::cerr << "GPU '" << candidates[requested].properties.deviceName << "' can't present to the window, picking one by score\n";
+			}
+			else {
+				chosen = requested;
 			}
 		}
 
 		// If no suitable GPU is found, also throw an error
-		if (m_PhysicalDevice == VK_NULL_HANDLE) {
+		if (chosen < 0) {
 			throw std::runtime_error("Failed to find a suitable GPU");
 		}
 
+		if (m_Debug) {
+			for (size_t i{}; i < candidates.size(); ++i) {
+				const DeviceCapabilities& candidate{ candidates[i] };
+				std::cout << (int(i) == chosen ? "* " : "  ") << i << ": " << candidate.properties.deviceName
+					<< ", " << candidate.deviceLocalMemory / (1024 * 1024) << " MiB device local, "
+					<< (candidate.suitable ? "score " + std::to_string(candidate.score) : std::string{ "not suitable" }) << '\n';
+			}
+		}
+
+		// Keep the capabilities around, eg. timestampPeriod for the GPU profiler
+		m_Capabilities = std::move(candidates[chosen]);
+		m_PhysicalDevice = m_Capabilities.device;
+
+		// Culled objects are drawn with their transform's index as first instance
+		if (m_OcclusionCulling && !m_Capabilities.features.drawIndirectFirstInstance) {
+			std::cerr << "GPU can't draw indirect with a first instance, occlusion culling is off\n";
+			m_OcclusionCulling = false;
+		}
+
+		m_DepthFormat = FindDepthFormat();
+
 		// Print the chosen device
-		VkPhysicalDeviceProperties deviceProperties;
-		vkGetPhysicalDeviceProperties(m_PhysicalDevice, &deviceProperties);
-		if (m_Debug) std::cout << "Running on physical device: " << deviceProperties.deviceName << std::endl;
+		if (m_Debug) std::cout << "Running on physical device: " << m_Capabilities.properties.deviceName << std::endl;
+	}
+
+	DeviceCapabilities Core::QueryDeviceCapabilities(VkPhysicalDevice device) {
+		DeviceCapabilities capabilities{};
+		capabilities.device = device;
+
+		vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+		vkGetPhysicalDeviceFeatures(device, &capabilities.features);
+		vkGetPhysicalDeviceMemoryProperties(device, &capabilities.memoryProperties);
+
+		for (uint32_t i{}; i < capabilities.memoryProperties.memoryHeapCount; ++i) {
+			const VkMemoryHeap& heap{ capabilities.memoryProperties.memoryHeaps[i] };
+			if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+				capabilities.deviceLocalMemory = std::max(capabilities.deviceLocalMemory, heap.size);
+			}
+		}
+
+		capabilities.queueFamilies = FindQueueFamilies(device);
+
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+		capabilities.extensions.resize(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, capabilities.extensions.data());
+
+		// Surface queries need the swapchain extension
+		if (CheckDeviceExtensionSupport(capabilities)) {
+			capabilities.swapChain = QuerySwapChainSupport(device);
+		}
+
+		capabilities.suitable = IsDeviceSuitable(capabilities);
+		capabilities.score = ScoreDevice(capabilities);
+
+		return capabilities;
+	}
+
+	int64_t Core::ScoreDevice(const DeviceCapabilities& capabilities) const {
+		int64_t score{ 0 };
+
+		// Device type dominates
+		switch (capabilities.properties.deviceType) {
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; break;
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 50000; break;
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 20000; break;
+			case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 1000; break; // Software rasterizer, eg. lavapipe
+			default: break;
+		}
+
+		// Then memory, a point per 64 MiB of the largest device local heap
+		score += int64_t(capabilities.deviceLocalMemory / (64 * 1024 * 1024));
+
+		// Then what the engine can make use of
+		if (capabilities.properties.apiVersion >= VK_API_VERSION_1_2 || capabilities.HasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) score += 200;
+		if (capabilities.HasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) score += 100;
+		if (capabilities.features.pipelineStatisticsQuery) score += m_Settings.measureOverdraw ? 1000 : 50;
+		if (capabilities.features.samplerAnisotropy) score += 50;
+
+		return score;
 	}
 
-	bool Core::IsDeviceSuitable(VkPhysicalDevice device) {
-		QueueFamilyIndices indices{ FindQueueFamilies(device) };
+	VkFormat Core::FindDepthFormat() const {
+		// In order of preference, D32 is the most precise, D24S8 the most widely supported on older hardware
+		const VkFormat candidates[]{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+
+		// The Hi-Z pass samples depth, through a view of the depth aspect alone so stencil formats are out
+		const VkFormatFeatureFlags required{ VkFormatFeatureFlags(VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+			| (m_OcclusionCulling ? VkFormatFeatureFlags(VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) : 0) };
+
+		for (VkFormat format : candidates) {
+			if (m_OcclusionCulling && (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT)) continue;
+
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, format, &properties);
+
+			if ((properties.optimalTilingFeatures & required) == required) {
+				return format;
+			}
+		}
+
+		throw std::runtime_error("Failed to find a supported depth format!");
+	}
 
-		bool extensionSupported{ CheckDeviceExtensionSupport(device) };
+	bool Core::IsDeviceSuitable(const DeviceCapabilities& capabilities) const {
+		QueueFamilyIndices indices{ capabilities.queueFamilies };
+
+		bool extensionSupported{ CheckDeviceExtensionSupport(capabilities) };
 
 		bool swapChainAdequate{ false };
 		if (extensionSupported) {
-			SwapChainSupportDetails swapChainSupport{ QuerySwapChainSupport(device) };
-			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+			swapChainAdequate = !capabilities.swapChain.formats.empty() && !capabilities.swapChain.presentModes.empty();
 		}
 
-		return indices.IsComplete() && extensionSupported && swapChainAdequate;
-
-		// Could be extended to fall back on iGPU
-		// Or select based on features
+		return indices.IsComplete() && indices.presentFamily.has_value() && extensionSupported && swapChainAdequate;
 	}
 
 	QueueFamilyIndices Core::FindQueueFamilies(VkPhysicalDevice device) {
@@ -464,7 +889,8 @@ namespace vulkat{
 		uint32_t queueFamilyCount{0};
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
 
-		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		const size_t marker{ m_ScratchArena.GetMarker() };
+		std::vector<VkQueueFamilyProperties, ArenaAllocator<VkQueueFamilyProperties>> queueFamilies(queueFamilyCount, ArenaAllocator<VkQueueFamilyProperties>{ m_ScratchArena });
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
 		// Find a queue family that supports VK_QUEUE_GRAPHICS_BIT
@@ -488,27 +914,20 @@ namespace vulkat{
 			++i;
 		}
 
+		m_ScratchArena.Rewind(marker);
 		return indices;
 	}
 
-	bool Core::CheckDeviceExtensionSupport(VkPhysicalDevice device) {
-		uint32_t extensionCount;
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-
-		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-		std::set<std::string> requiredExtensions(Validation::m_DeviceExtensions.begin(), Validation::m_DeviceExtensions.end());
-
-		for (const auto& extension : availableExtensions) {
-			requiredExtensions.erase(extension.extensionName);
+	bool Core::CheckDeviceExtensionSupport(const DeviceCapabilities& capabilities) const {
+		for (const char* required : Validation::m_DeviceExtensions) {
+			if (!capabilities.HasExtension(required)) return false;
 		}
 
-		return requiredExtensions.empty();
+		return true;
 	}
 
 	void Core::CreateLogicalDevice() {
-		QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
+		const QueueFamilyIndices& indices{ m_Capabilities.queueFamilies };
 
 		// Fill the queueCreateInfo struct
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -519,25 +938,47 @@ namespace vulkat{
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
 			VkDeviceQueueCreateInfo queueCreateInfo{};
 			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.queueFamilyIndex = indices.graphicsFamily.value();
+			queueCreateInfo.queueFamilyIndex = queueFamily;
 			queueCreateInfo.queueCount = 1;
 			queueCreateInfo.pQueuePriorities = &queuePriority;
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
 		// Fill the deviceFeatures struct
-		VkPhysicalDeviceFeatures deviceFeatures{}; // No special features required
+		VkPhysicalDeviceFeatures deviceFeatures{}; // Only what the settings ask for
+		deviceFeatures.pipelineStatisticsQuery = m_Settings.measureOverdraw ? m_Capabilities.features.pipelineStatisticsQuery : VK_FALSE;
+		deviceFeatures.multiDrawIndirect = m_OcclusionCulling ? m_Capabilities.features.multiDrawIndirect : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = m_OcclusionCulling ? VK_TRUE : VK_FALSE;
+
+		// Optional extensions, enabled when the device has them
+		std::vector<const char*> deviceExtensions{ Validation::m_DeviceExtensions };
+
+		// Timeline semaphores are core in 1.2 (instance and device both), before that the KHR extension has them.
+		// The feature is mandatory wherever either is there
+		const bool timelineCore{ m_InstanceVersion >= VK_API_VERSION_1_2 && m_Capabilities.properties.apiVersion >= VK_API_VERSION_1_2 };
+		const bool timelineKhr{ !timelineCore && m_Capabilities.HasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) };
+		if (timelineKhr) deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+		// Memory budget is queried with vkGetPhysicalDeviceMemoryProperties2, core in 1.1
+		const bool memoryBudget{ m_InstanceVersion >= VK_API_VERSION_1_1 && m_Capabilities.properties.apiVersion >= VK_API_VERSION_1_1
+			&& m_Capabilities.HasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) };
+		if (memoryBudget) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timelineFeatures.timelineSemaphore = VK_TRUE;
 
 		// Finally, fill the createInfo struct
 		VkDeviceCreateInfo createInfo{};
 
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = (timelineCore || timelineKhr) ? &timelineFeatures : nullptr;
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pQueueCreateInfos = queueCreateInfos.data(); // Reference the queue create info struct
 		createInfo.pEnabledFeatures = &deviceFeatures; // Reference the device features struct
 		// Depricated but a good idea to add anyway
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(Validation::m_DeviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = Validation::m_DeviceExtensions.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 		if (m_Debug) {
 			createInfo.enabledLayerCount = static_cast<uint32_t>(Validation::m_ValidationLayers.size());
 			createInfo.ppEnabledLayerNames = Validation::m_ValidationLayers.data();
@@ -555,6 +996,26 @@ namespace vulkat{
 		vkGetDeviceQueue(m_Device, indices.graphicsFamily.value(), 0, &m_GraphicsQueue); // Only create single queue (0)
 		// Store the presentation queue
 		vkGetDeviceQueue(m_Device, indices.presentFamily.value(), 0, &m_PresentQueue); // idem
+
+		m_MemoryTracker.Initialize(m_pInstance, m_PhysicalDevice, m_Device, memoryBudget);
+		m_GraphicsTimeline.Initialize(m_Device, timelineCore || timelineKhr, timelineKhr);
+		if (m_Debug) {
+			std::cout << "Graphics queue sync: " << (timelineCore ? "timeline semaphore (1.2)"
+				: timelineKhr ? "timeline semaphore (" VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME ")" : "fences") << '\n';
+		}
+
+		// One slot more than frames in flight, so recording never waits for the copy of the previous round
+		m_FrameCapture.Initialize(m_Device, &m_GraphicsTimeline, &m_MemoryTracker,
+			m_Settings.capturePath, m_Settings.framesInFlight + 1, m_Debug);
+
+		m_GpuProfiler.Initialize(m_Device, m_PhysicalDevice, m_Capabilities.properties, indices.graphicsFamily.value());
+
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			m_GpuProfiler.EnableStatistics();
+		}
+		else if (m_Settings.measureOverdraw) {
+			std::cerr << "Overdraw measurement needs pipelineStatisticsQuery, which this device doesn't support\n";
+		}
 	}
 
 	void Core::CreateSurface() {
@@ -563,6 +1024,8 @@ namespace vulkat{
 		}
 	}
 
+	// Unlike FindQueueFamilies this stays on the heap: the result is kept in DeviceCapabilities for the lifetime of the
+	// device and reused by every swapchain recreation, so it is queried once per device at startup and never per frame
 	SwapChainSupportDetails Core::QuerySwapChainSupport(VkPhysicalDevice device) {
 		SwapChainSupportDetails details;
 
@@ -600,14 +1063,33 @@ namespace vulkat{
 	}
 
 	VkPresentModeKHR Core::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-		// Prefer triple buffering
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-				return availablePresentMode;
+		// Runs on every swapchain recreation, so the candidates live on the stack. Unused slots stay Fifo, the fallback anyway
+		VkPresentModeKHR preferred[2]{ VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR };
+
+		switch (m_LatencyMode) {
+			case LatencyMode::Uncapped:
+				// No waiting on vblank at all
+				preferred[0] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+				preferred[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+				break;
+			case LatencyMode::LowLatency:
+				// The limiter paces the frames, mailbox only keeps the newest one without tearing
+				preferred[0] = VK_PRESENT_MODE_MAILBOX_KHR;
+				preferred[1] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+				break;
+			default:
+				// Relaxed tears on a late frame instead of waiting a whole refresh for the next vblank
+				preferred[0] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+				break;
+		}
+
+		for (VkPresentModeKHR mode : preferred) {
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end()) {
+				return mode;
 			}
 		}
 
-		// If mailbox is not available, use fifo
+		// Fifo is always available
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
 
@@ -636,7 +1118,9 @@ namespace vulkat{
 	}
 
 	void Core::CreateSwapChain() {
-		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice);
+		// Formats and present modes were queried with the device, only the extent limits change (eg. on resize)
+		SwapChainSupportDetails& swapChainSupport{ m_Capabilities.swapChain };
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_PhysicalDevice, m_Surface, &swapChainSupport.capabilities);
 
 		VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormats(swapChainSupport.formats);
 		VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupport.presentModes);
@@ -660,7 +1144,15 @@ namespace vulkat{
 		createInfo.imageArrayLayers = 1; // Always 1 unless VR
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // Can be set to VK_IMAGE_USAGE_TRANSFER_DST_BIT when eg. implementing post-processing
 
-		QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
+		// Frame capture copies out of the swapchain images
+		if (m_FrameCapture.IsEnabled()) {
+			if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+				throw std::runtime_error("Failed to enable frame capture, the surface can't be copied from!");
+			}
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+
+		const QueueFamilyIndices& indices{ m_Capabilities.queueFamilies };
 		uint32_t queueFamilyIndices[] {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
 		// If graphicsFamily & presentFamily differ, images must be explicitly transferred
@@ -683,7 +1175,7 @@ namespace vulkat{
 
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
-		createInfo.oldSwapchain = VK_NULL_HANDLE; // Implemented later
+		createInfo.oldSwapchain = m_SwapChain; // Retired on recreation, its destruction is already queued
 
 		// Create the swapchain object
 		if (vkCreateSwapchainKHR(m_Device, &createInfo, nullptr, &m_SwapChain) != VK_SUCCESS) {
@@ -696,6 +1188,9 @@ namespace vulkat{
 
 		m_SwapChainImageFormat = surfaceFormat.format;
 		m_SwapChainExtent = extent;
+
+		// Writes what was captured at the old size first
+		m_FrameCapture.Configure(m_SwapChainImageFormat, m_SwapChainExtent);
 	}
 
 	void Core::CreateImageViews() {
@@ -732,166 +1227,77 @@ namespace vulkat{
 		}
 	}
 
-	void Core::CreateRenderPass() {
-		VkAttachmentDescription colorAttachment{};
-
-		colorAttachment.format = m_SwapChainImageFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		VkAttachmentReference colorAttachmentRef{};
+	void Core::CreateRenderGraph() {
+		// The graph is rebuilt with the swapchain, its passes are declared here
+		RenderGraph::Resource backbuffer{
+			m_RenderGraph.ImportBackbuffer("Backbuffer", m_SwapChainImageFormat, m_SwapChainImages, m_SwapChainImageViews, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+		};
 
-		colorAttachmentRef.attachment = 0;
-		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		// Transient, so it follows the swapchain extent and gets recreated with it
+		RenderGraph::Resource depth{ m_RenderGraph.CreateImage("Depth", RenderGraph::ImageDesc{ m_DepthFormat }) };
+		m_DepthResource = depth;
 
-		VkSubpassDescription subpass{};
+		VkClearColorValue clearColor{ { 0.f, 0.f, 0.f, 1.f } };
+		VkClearDepthStencilValue clearDepth{ 1.f, 0 };
 
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorAttachmentRef;
-
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		VkRenderPassCreateInfo renderPassInfo{};
-
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1;
-		renderPassInfo.pAttachments = &colorAttachment;
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
-
-		if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS){
-			throw std::runtime_error("Failed to create render pass!");
+		if (m_DepthPrepass) {
+			m_DepthPass = m_RenderGraph.AddPass("DepthPrepass", [this](VkCommandBuffer commandBuffer){ RecordDepthPass(commandBuffer); });
+			m_RenderGraph.WriteDepth(m_DepthPass, depth, &clearDepth);
 		}
-	}
 
-	void Core::CreateGraphicsPipeline() {
-		auto vertShaderCode = ReadFile(SHADER(vert.spv), m_Debug);
-		auto fragShaderCode = ReadFile(SHADER(frag.spv), m_Debug);
+		if (m_OcclusionCulling) {
+			// Hi-Z pyramid of the early depth, then the re-test. Its real outputs are the culler's buffers, so nothing keeps it alive but the flag
+			RenderGraph::Pass hiZ{ m_RenderGraph.AddComputePass("HiZ", [this](VkCommandBuffer commandBuffer){
+				m_Culler.BuildPyramid(commandBuffer);
+				m_Culler.CullLate(commandBuffer, uint32_t(m_CurrentFrame));
+			}) };
+			m_RenderGraph.ReadTexture(hiZ, depth);
+			m_RenderGraph.SetSideEffect(hiZ);
+
+			// Adds the re-tested survivors on top of the early depth
+			m_LateDepthPass = m_RenderGraph.AddPass("DepthPrepassLate", [this](VkCommandBuffer commandBuffer){ RecordCulledDraws(commandBuffer, m_DepthPipelineKey, true); });
+			m_RenderGraph.WriteDepth(m_LateDepthPass, depth);
+		}
 
-		VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-		VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+		m_MainPass = m_RenderGraph.AddPass("Main", [this](VkCommandBuffer commandBuffer){ RecordMainPass(commandBuffer); });
+		m_RenderGraph.WriteColor(m_MainPass, backbuffer, &clearColor);
 
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+		if (m_DepthPrepass) m_RenderGraph.ReadDepth(m_MainPass, depth); // Depth is final, only test it
+		else m_RenderGraph.WriteDepth(m_MainPass, depth, &clearDepth);
 
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		vertShaderStageInfo.pName = "main";
+		m_RenderGraph.Compile(m_SwapChainExtent);
 
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+		m_RenderPass = m_RenderGraph.GetRenderPass(m_MainPass);
+	}
 
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
+	PipelineState Core::GetMainPipelineState(bool lit) const {
+		PipelineState state{};
 
-		VkPipelineShaderStageCreateInfo shaderStages[]{ vertShaderStageInfo, fragShaderStageInfo };
+		state.vertexShader = SHADER(vert.spv);
+		state.fragmentShader = !lit || !m_LitShading ? SHADER(frag.spv)
+			: m_Settings.shadows ? SHADER(lit_shadow_frag.spv) : SHADER(lit_frag.spv);
 
-		auto bindingDescription = Vertex::GetBindingDescription();
 		auto attributeDescription = Vertex::GetAttributeDescription();
+		auto instanceAttributeDescription = InstanceData::GetAttributeDescription();
+		state.bindings = { Vertex::GetBindingDescription(), InstanceData::GetBindingDescription() };
+		state.attributes.assign(attributeDescription.begin(), attributeDescription.end());
+		state.attributes.insert(state.attributes.end(), instanceAttributeDescription.begin(), instanceAttributeDescription.end());
+
+		state.extent = m_SwapChainExtent;
+		state.layout = m_PipelineLayout;
+		state.renderPass = m_RenderPass;
+
+		state.depthTest = true;
+		state.depthWrite = !m_DepthPrepass;
+		// After the pre-pass only the front most fragment matches. Both pipelines run shader.vert, whose invariant
+		// gl_Position keeps the depth identical across them
+		state.depthCompareOp = m_DepthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+
+		return state;
+	}
 
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());;
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssemplyInfo{};
-
-		inputAssemplyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemplyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssemplyInfo.primitiveRestartEnable = VK_FALSE;
-
-		VkViewport viewport{};
-
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = float(m_SwapChainExtent.width);
-		viewport.height = float(m_SwapChainExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-
-		scissor.offset = { 0, 0 };
-		scissor.extent = m_SwapChainExtent;
-
-		VkPipelineViewportStateCreateInfo viewportStateInfo{};
-
-		viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportStateInfo.viewportCount = 1;
-		viewportStateInfo.pViewports = &viewport;
-		viewportStateInfo.scissorCount = 1;
-		viewportStateInfo.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
-
-		rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizerInfo.depthClampEnable = VK_FALSE;
-		rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
-		rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizerInfo.lineWidth = 1.0f;
-		rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizerInfo.depthBiasEnable = VK_FALSE;
-		rasterizerInfo.depthBiasConstantFactor = 0.0f;
-		rasterizerInfo.depthBiasClamp = 0.0f;
-		rasterizerInfo.depthBiasSlopeFactor = 0.0f;
-
-		VkPipelineMultisampleStateCreateInfo multisamplingInfo{};
-
-		multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisamplingInfo.sampleShadingEnable = VK_FALSE;
-		multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisamplingInfo.minSampleShading = 1.0f;
-		multisamplingInfo.pSampleMask = nullptr;
-		multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
-		multisamplingInfo.alphaToOneEnable = VK_FALSE;
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-		VkPipelineColorBlendStateCreateInfo colorBlendingInfo{};
-		colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlendingInfo.logicOpEnable = VK_FALSE;
-		colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendingInfo.attachmentCount = 1;
-		colorBlendingInfo.pAttachments = &colorBlendAttachment;
-		colorBlendingInfo.blendConstants[0] = 0.0f;
-		colorBlendingInfo.blendConstants[1] = 0.0f;
-		colorBlendingInfo.blendConstants[2] = 0.0f;
-		colorBlendingInfo.blendConstants[3] = 0.0f;
-
-		VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_LINE_WIDTH };
-
-		VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
-
-		dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicStateInfo.dynamicStateCount = 2;
-		dynamicStateInfo.pDynamicStates = dynamicStates;
+	void Core::CreateGraphicsPipeline() {
+		TRACE_SCOPE("CreateGraphicsPipeline");
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 
@@ -901,197 +1307,433 @@ namespace vulkat{
 		pipelineLayoutInfo.pushConstantRangeCount = 0;
 		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create pipeline layout!");
+		// lit.frag reads the lights and clusters from set 0, the grid from push constants, the shadow map from set 1
+		std::array<VkDescriptorSetLayout, 2> setLayouts{ m_Lighting.GetSetLayout(), m_Shadows.GetSetLayout() };
+		VkPushConstantRange lightPushConstants{ m_Lighting.GetPushConstantRange() };
+		if (m_LitShading) {
+			pipelineLayoutInfo.setLayoutCount = m_Settings.shadows ? 2 : 1;
+			pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+			pipelineLayoutInfo.pushConstantRangeCount = 1;
+			pipelineLayoutInfo.pPushConstantRanges = &lightPushConstants;
 		}
 
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssemplyInfo;
-		pipelineInfo.pViewportState = &viewportStateInfo;
-		pipelineInfo.pRasterizationState = &rasterizerInfo;
-		pipelineInfo.pMultisampleState = &multisamplingInfo;
-		pipelineInfo.pDepthStencilState = nullptr;
-		pipelineInfo.pColorBlendState = &colorBlendingInfo;
-		//pipelineInfo.pDynamicState = &dynamicStateInfo;
-		pipelineInfo.layout = m_PipelineLayout;
-		pipelineInfo.renderPass = m_RenderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-		pipelineInfo.basePipelineIndex = -1;
-
-		if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_GraphicsPipeline) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create graphics pipeline!");
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout!");
 		}
 
-		vkDestroyShaderModule(m_Device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(m_Device, vertShaderModule, nullptr);
-	}
+		PipelineState state{ GetMainPipelineState() };
 
-	VkShaderModule Core::CreateShaderModule(const std::vector<char>& bytecode) {
-		VkShaderModuleCreateInfo createInfo{};
+		// Compiles on the thread pool, also the fallback of main pass draws whose own pipeline isn't ready yet
+		m_PipelineKey = m_PipelineRegistry.Request(state);
 
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = bytecode.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(bytecode.data());
+		if (m_DepthPrepass) {
+			// Vertex stage only, no color attachments
+			PipelineState depthState{ state };
+			depthState.fragmentShader.clear();
+			depthState.colorAttachmentCount = 0;
+			depthState.renderPass = m_RenderGraph.GetRenderPass(m_DepthPass);
+			depthState.depthWrite = true;
+			depthState.depthCompareOp = VK_COMPARE_OP_LESS;
 
-		VkShaderModule shaderModule;
-		if (vkCreateShaderModule(m_Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create shader module!");
+			m_DepthPipelineKey = m_PipelineRegistry.Request(depthState);
 		}
 
-		return shaderModule;
-	}
-
-	void Core::CreateFramebuffers() {
-		m_SwapChainFramebuffers.resize(m_SwapChainImageViews.size());
-
-		for (size_t i{}; i < m_SwapChainImageViews.size(); ++i) {
-			VkImageView attachments[] = { m_SwapChainImageViews[i] };
-
-			VkFramebufferCreateInfo framebufferInfo{};
-			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = m_RenderPass;
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = attachments;
-			framebufferInfo.width = m_SwapChainExtent.width;
-			framebufferInfo.height = m_SwapChainExtent.height;
-			framebufferInfo.layers = 1;
+		// Its own render pass and layout, only the vertex input follows the main pass
+		if (m_Settings.shadows) {
+			m_ShadowPipelineKey = m_PipelineRegistry.Request(m_Shadows.GetPipelineState(state));
+		}
 
-			if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_SwapChainFramebuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to create framebuffer!");
-			}
+		if (m_pParticles) {
+			m_ParticlePipelineKey = m_PipelineRegistry.Request(m_pParticles->GetPipelineState(GetMainPipelineState(false)));
 		}
 	}
 
 	void Core::CreateCommandPool() {
-		QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+		const QueueFamilyIndices& queueFamilyIndices{ m_Capabilities.queueFamilies };
 
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		//poolInfo.flags = 0;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Short lived transfer command buffers
 
 		if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create command pool!");
 		}
 	}
 
-	template<typename T>
-	void Core::CreateBuffer(const std::vector<T>& data, VkBuffer& buffer, VkDeviceMemory& bufferMemory, VkBufferUsageFlags usage) {
-		VkDeviceSize bufferSize = sizeof(data[0]) * data.size();
+	MeshAllocation Core::UploadMesh(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices) {
+		MeshAllocation mesh{ m_Geometry.Allocate(uint32_t(meshVertices.size()), uint32_t(meshIndices.size())) };
+
+		// One staging buffer, the vertices followed by the indices
+		VkDeviceSize vertexSize = sizeof(meshVertices[0]) * meshVertices.size();
+		VkDeviceSize indexSize = sizeof(meshIndices[0]) * meshIndices.size();
 
 		VkBuffer stagingBuffer;
 		VkDeviceMemory stagingBufferMemory;
 
-		CreateVkBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		CreateVkBuffer(vertexSize + indexSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging, stagingBuffer, stagingBufferMemory);
 
 		void* temp;
-		vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &temp);
-		memcpy(temp, data.data(), size_t(bufferSize));
+		vkMapMemory(m_Device, stagingBufferMemory, 0, vertexSize + indexSize, 0, &temp);
+		memcpy(temp, meshVertices.data(), size_t(vertexSize));
+		memcpy(static_cast<uint8_t*>(temp) + vertexSize, meshIndices.data(), size_t(indexSize));
 		vkUnmapMemory(m_Device, stagingBufferMemory);
 
-		CreateVkBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+		CopyVkBuffer(stagingBuffer, m_Geometry.GetVertexBuffer(mesh.page), vertexSize, 0, m_Geometry.GetVertexByteOffset(mesh));
+		uint64_t copied{ CopyVkBuffer(stagingBuffer, m_Geometry.GetIndexBuffer(mesh.page), indexSize, vertexSize, m_Geometry.GetIndexByteOffset(mesh)) };
 
-		CopyVkBuffer(stagingBuffer, buffer, bufferSize);
+		// The staging buffer goes once both copies retired, the upload doesn't block
+		m_DeletionQueue.Push(copied, [this, stagingBuffer, stagingBufferMemory]{
+			vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+			m_MemoryTracker.Free(stagingBufferMemory);
+		});
 
-		vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-		vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+		return mesh;
 	}
 
-	void Core::CreateCommandBuffers() {
-		m_CommandBuffers.resize(m_SwapChainFramebuffers.size());
+	void Core::CreateFrameContexts() {
+		const uint32_t frameCount{ m_Settings.framesInFlight };
+		const QueueFamilyIndices& queueFamilyIndices{ m_Capabilities.queueFamilies };
 
-		VkCommandBufferAllocateInfo allocateInfo{};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocateInfo.commandPool = m_CommandPool;
-		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocateInfo.commandBufferCount = uint32_t(m_CommandBuffers.size());
+		// One host visible buffer, every frame writes to its own slice while the GPU reads the others
+		CreateVkBuffer(m_UploadSliceSize * frameCount,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Upload, m_UploadBuffer, m_UploadBufferMemory);
+		vkMapMemory(m_Device, m_UploadBufferMemory, 0, m_UploadSliceSize * frameCount, 0, &m_pUploadData);
 
-		if (vkAllocateCommandBuffers(m_Device, &allocateInfo, m_CommandBuffers.data()) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate command buffers!");
+		m_Frames.clear();
+		for (uint32_t i{}; i < frameCount; ++i) {
+			m_Frames.push_back(std::make_unique<FrameContext>());
+			m_Frames.back()->Initialize(m_Device, queueFamilyIndices.graphicsFamily.value(), &m_GraphicsTimeline, &m_DeletionQueue, m_UploadBuffer, i * m_UploadSliceSize, m_UploadSliceSize, m_pUploadData);
 		}
 
-		for (size_t i{}; i < m_CommandBuffers.size(); ++i) {
-			VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-			cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			//cmdBufferBeginInfo.flags = 0;
-			//cmdBufferBeginInfo.pInheritanceInfo = 0;
+		m_GpuProfiler.SetSlotCount(frameCount); // One range of timestamps per frame in flight
+
+		if (m_Debug) std::cout << frameCount << " frames in flight\n";
+	}
+
+	void Core::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+		VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+		cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // Recorded again every frame
+
+		if (vkBeginCommandBuffer(commandBuffer, &cmdBufferBeginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
+
+		uint32_t slot{ uint32_t(m_CurrentFrame) };
+		m_GpuProfiler.BeginFrame(commandBuffer, slot);
+
+		// World matrices of whatever moved, before any draw reads them
+		UploadTransforms(commandBuffer);
+
+		std::chrono::steady_clock::time_point now{ std::chrono::steady_clock::now() };
+		float deltaTime{ std::chrono::duration<float>(now - m_LastRecord).count() };
+		m_LastRecord = now;
+
+		if (m_pParticles) {
+			uint32_t pass{ m_GpuProfiler.BeginPass(commandBuffer, slot, "Particles") };
+			m_pParticles->Simulate(commandBuffer, deltaTime);
+			m_GpuProfiler.EndPass(commandBuffer, slot, pass);
+		}
+
+		// Lights move and get binned into the clusters the main pass shades with
+		if (m_LitShading) {
+			uint32_t pass{ m_GpuProfiler.BeginPass(commandBuffer, slot, "Lights") };
+			m_Lighting.Assign(commandBuffer, deltaTime);
+			m_GpuProfiler.EndPass(commandBuffer, slot, pass);
+		}
+
+		// Sorted once, each pass records its range
+		CollectDraws();
+
+		if (m_OcclusionCulling || m_Settings.shadows) UpdateSceneObjects();
 
-			if (vkBeginCommandBuffer(m_CommandBuffers[i], &cmdBufferBeginInfo) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to begin recording command buffer!");
+		// Early half of the occlusion test, the late half runs in the render graph's HiZ pass
+		if (m_OcclusionCulling) {
+			uint32_t pass{ m_GpuProfiler.BeginPass(commandBuffer, slot, "CullEarly") };
+			m_Culler.CullEarly(commandBuffer, *m_Frames[m_CurrentFrame]);
+			m_GpuProfiler.EndPass(commandBuffer, slot, pass);
+		}
+
+		// Cascades that are still valid keep last frame's layers, usually all of them
+		if (m_Settings.shadows) {
+			uint32_t pass{ m_GpuProfiler.BeginPass(commandBuffer, slot, "Shadows") };
+			RecordShadows(commandBuffer);
+			m_GpuProfiler.EndPass(commandBuffer, slot, pass);
+		}
+
+		// Barriers, render passes and the pass callbacks. Draws whose pipeline is still compiling are skipped this frame
+		if (m_pBenchmarkScenario && m_pBenchmarkScenario->load == BenchmarkLoad::Uploads) {
+			RecordBenchmarkUploads(commandBuffer);
+		}
+
+		m_RenderGraph.Execute(commandBuffer, imageIndex, slot);
+
+		// Copy of the finished image, read back a few frames later
+		m_FrameCapture.Record(commandBuffer, m_SwapChainImages[imageIndex]);
+
+		m_GpuProfiler.EndFrame(commandBuffer, slot);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record command buffer!");
+		}
+	}
+
+	void Core::UploadTransforms(VkCommandBuffer commandBuffer) {
+		TRACE_SCOPE("UploadTransforms");
+
+		m_Transforms.Update();
+
+		// Grow the instance buffer, the old contents are copied over on the GPU
+		if (m_Transforms.GetCount() > m_InstanceCapacity) {
+			VkBuffer oldBuffer{ m_InstanceBuffer };
+			VkDeviceMemory oldMemory{ m_InstanceBufferMemory };
+			VkDeviceSize oldSize{ VkDeviceSize(m_InstanceCapacity) * sizeof(InstanceData) };
+
+			m_InstanceCapacity = std::max(m_Transforms.GetCount(), m_InstanceCapacity * 2);
+			CreateVkBuffer(VkDeviceSize(m_InstanceCapacity) * sizeof(InstanceData), VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Vertex, m_InstanceBuffer, m_InstanceBufferMemory);
+
+			if (oldBuffer != VK_NULL_HANDLE) {
+				// Earlier frames' uploads wrote the old buffer, the copy reads it
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				VkBufferCopy region{ 0, 0, oldSize };
+				vkCmdCopyBuffer(commandBuffer, oldBuffer, m_InstanceBuffer, 1, &region);
+
+				// The uploads below may overwrite part of the copy
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				m_Frames[m_CurrentFrame]->Defer([this, oldBuffer, oldMemory]{
+					vkDestroyBuffer(m_Device, oldBuffer, nullptr);
+					m_MemoryTracker.Free(oldMemory);
+				});
 			}
+		}
+
+		// Whatever doesn't fit in half the frame's upload slice goes next frame
+		const uint32_t maxCount{ uint32_t(m_UploadSliceSize / 2 / sizeof(InstanceData)) };
+		m_Transforms.TakeUploads(maxCount, m_TransformUploads);
+
+		if (m_TransformUploads.empty()) return; // Static scene, nothing to do
+
+		uint32_t count{ 0 };
+		for (const auto& range : m_TransformUploads) count += range.count;
 
-			VkRenderPassBeginInfo renderPassBeginInfo{};
-			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBeginInfo.renderPass = m_RenderPass;
-			renderPassBeginInfo.framebuffer = m_SwapChainFramebuffers[i];
-			renderPassBeginInfo.renderArea.offset = { 0, 0 };
-			renderPassBeginInfo.renderArea.extent = m_SwapChainExtent;
+		// Straight from the world matrices into the upload ring, one copy region per run of changed matrices
+		UploadAllocation upload{ m_Frames[m_CurrentFrame]->Allocate(VkDeviceSize(count) * sizeof(InstanceData)) };
+		uint8_t* pData{ static_cast<uint8_t*>(upload.pData) };
+		VkDeviceSize offset{ 0 };
 
-			VkClearValue clearColor = { { { 0.f, 0.f, 0.f, 1.f } } };
-			renderPassBeginInfo.clearValueCount = 1;
-			renderPassBeginInfo.pClearValues = &clearColor;
+		// The regions only live until the copy is recorded, the frame's arena takes them back on its next Reset()
+		LinearArena& arena{ m_Frames[m_CurrentFrame]->GetArena() };
+		VkBufferCopy* pCopies{ static_cast<VkBufferCopy*>(arena.Allocate(sizeof(VkBufferCopy) * m_TransformUploads.size(), alignof(VkBufferCopy))) };
+		uint32_t copyCount{ 0 };
 
-			vkCmdBeginRenderPass(m_CommandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		for (const auto& range : m_TransformUploads) {
+			VkDeviceSize size{ VkDeviceSize(range.count) * sizeof(InstanceData) };
+			memcpy(pData + offset, m_Transforms.GetWorldMatrices() + range.first, size_t(size));
 
-			// Begin
-			vkCmdBindPipeline(m_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+			VkBufferCopy region{};
+			region.srcOffset = upload.offset + offset;
+			region.dstOffset = VkDeviceSize(range.first) * sizeof(InstanceData);
+			region.size = size;
+			pCopies[copyCount++] = region;
 
-			VkBuffer vertexBuffers[]{ m_VertexBuffer };
-			VkDeviceSize offsets[]{ 0 };
-			vkCmdBindVertexBuffers(m_CommandBuffers[i], 0, 1, vertexBuffers, offsets);
+			offset += size;
+		}
+
+		// Frames still in flight share the instance buffer, their draws have to be done reading before it is overwritten
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
 
-			vkCmdBindIndexBuffer(m_CommandBuffers[i], m_IndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdCopyBuffer(commandBuffer, upload.buffer, m_InstanceBuffer, copyCount, pCopies);
 
-			// Draw command
-			// 2nd param: vertexcount
-			// 3rd param: instanceCount
-			// 4th param: firstVertex
-			// 5th param: firstInstance
-			//vkCmdDraw(m_CommandBuffers[i], static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-			vkCmdDrawIndexed(m_CommandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-			// End
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = m_InstanceBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
 
-			vkCmdEndRenderPass(m_CommandBuffers[i]);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
 
-			if (vkEndCommandBuffer(m_CommandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to record command buffer!");
+	void Core::CollectDraws() {
+		m_DrawQueue.Clear();
+
+		// No camera yet, the mesh is in NDC so one unit is half the viewport high
+		m_MeshLod = MeshLod::Select(m_MeshLods, float(m_SwapChainExtent.height) * 0.5f, m_MeshLod);
+		const LodLevel& lod{ m_MeshLods.levels[m_MeshLod] };
+
+		DrawCommand draw{};
+		draw.vertexBuffer = m_Geometry.GetVertexBuffer(m_Mesh.page);
+		draw.instanceBuffer = m_InstanceBuffer;
+		draw.indexBuffer = m_Geometry.GetIndexBuffer(m_Mesh.page);
+		draw.indexType = GeometryBuffer::m_IndexType;
+		draw.firstIndex = m_Mesh.firstIndex + lod.firstIndex;
+		draw.indexCount = lod.indexCount;
+		draw.vertexOffset = m_Mesh.vertexOffset;
+		draw.firstInstance = m_Transforms.GetIndex(m_MeshTransform);
+
+		// With occlusion culling the mesh is drawn from the culler's lists
+		if (!m_OcclusionCulling) {
+			if (m_DepthPrepass) {
+				draw.pipelineKey = m_DepthPipelineKey;
+				m_DrawQueue.Add(m_DepthPass, draw, 0, 0.0f);
 			}
+
+			draw.pipelineKey = m_PipelineKey;
+			m_DrawQueue.Add(m_MainPass, draw, 0, 0.0f);
 		}
+
+		if (m_pBenchmarkScenario) CollectBenchmarkDraws();
+
+		m_DrawQueue.Sort();
+	}
+
+	void Core::RecordDepthPass(VkCommandBuffer commandBuffer) {
+		m_DrawQueue.Record(commandBuffer, m_DepthPass, m_PipelineRegistry, m_DepthPipelineKey);
+
+		if (m_OcclusionCulling) RecordCulledDraws(commandBuffer, m_DepthPipelineKey, false);
+	}
+
+	void Core::RecordMainPass(VkCommandBuffer commandBuffer) {
+		if (m_LitShading) m_Lighting.Bind(commandBuffer, m_PipelineLayout);
+		if (m_Settings.shadows) m_Shadows.Bind(commandBuffer, m_PipelineLayout);
+
+		m_DrawQueue.Record(commandBuffer, m_MainPass, m_PipelineRegistry, m_PipelineKey);
+
+		// Everything either depth pass drew, the EQUAL test shades only what ended up in front
+		if (m_OcclusionCulling) {
+			RecordCulledDraws(commandBuffer, m_PipelineKey, false);
+			RecordCulledDraws(commandBuffer, m_PipelineKey, true);
+		}
+
+		// Blended on top, after the opaque draws
+		if (m_pParticles) m_pParticles->Record(commandBuffer, m_PipelineRegistry.Get(m_ParticlePipelineKey));
 	}
 
-	void Core::CreateSyncObjects() {
-		m_ImageAvailableSemaphores.resize(m_MaxFramesInFlight);
-		m_RenderFinishedSemaphores.resize(m_MaxFramesInFlight);
-		m_InFlightFences.resize(m_MaxFramesInFlight);
-		m_ImagesInFlight.resize(m_SwapChainImages.size(), VK_NULL_HANDLE);
+	void Core::UpdateSceneObjects() {
+		// Object 0 is the scene's mesh, the rest are the occlusion benchmark's quads
+		const uint32_t count{ 1 + uint32_t(m_BenchmarkTransforms.size()) };
+		bool resized{ false };
+		if (m_OcclusionCulling && m_Culler.GetObjectCount() != count) {
+			m_Culler.SetObjectCount(count);
+			resized = true;
+		}
+		if (m_Settings.shadows && m_Shadows.GetCasterCount() != count) {
+			m_Shadows.SetCasterCount(count);
+			resized = true;
+		}
 
-		VkSemaphoreCreateInfo semaphoreInfo{};
-		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		const LodLevel& lod{ m_MeshLods.levels[m_MeshLod] };
+		VkDrawIndexedIndirectCommand draw{ lod.indexCount, 1, m_Mesh.firstIndex + lod.firstIndex, m_Mesh.vertexOffset, 0 };
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		auto setObject{ [&](uint32_t object, uint32_t transform) {
+			// No camera yet, world space is NDC with z as depth
+			const glm::mat4& world{ m_Transforms.GetWorld(transform) };
 
-		for (size_t i{}; i < m_MaxFramesInFlight; ++i) {
-			if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_ImageAvailableSemaphores[i]) != VK_SUCCESS
-				|| vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderFinishedSemaphores[i]) != VK_SUCCESS
-				|| vkCreateFence(m_Device, &fenceInfo, nullptr, &m_InFlightFences[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to create semaphores for a frame!");
+			glm::vec3 boundsMin{ world * glm::vec4{ vertices[0].pos, 0.f, 1.f } };
+			glm::vec3 boundsMax{ boundsMin };
+			for (const auto& vertex : vertices) {
+				glm::vec3 position{ world * glm::vec4{ vertex.pos, 0.f, 1.f } };
+				boundsMin = glm::min(boundsMin, position);
+				boundsMax = glm::max(boundsMax, position);
 			}
+
+			draw.firstInstance = m_Transforms.GetIndex(transform);
+			if (m_OcclusionCulling) m_Culler.SetObject(object, boundsMin, boundsMax, draw);
+
+			// Nothing in the scene moves after it's placed, a LOD switch is the only change the cascades see
+			if (m_Settings.shadows) m_Shadows.SetCaster(object, boundsMin, boundsMax, draw, false);
+		} };
+
+		// Unchanged objects are skipped by the culler and the cascades, but walking thousands of them isn't free either:
+		// indices and world matrices only change when a transform did
+		if (!resized && m_SceneMeshLod == m_MeshLod && m_Transforms.GetUpdatedCount() == 0) return;
+		m_SceneMeshLod = m_MeshLod;
+
+		setObject(0, m_MeshTransform);
+		for (uint32_t i{}; i < m_BenchmarkTransforms.size(); ++i) {
+			setObject(i + 1, m_BenchmarkTransforms[i]);
 		}
 	}
 
+	void Core::RecordCulledDraws(VkCommandBuffer commandBuffer, uint64_t pipelineKey, bool late) {
+		VkPipeline pipeline{ m_PipelineRegistry.Get(pipelineKey) };
+		if (pipeline == VK_NULL_HANDLE) return; // Still compiling
+
+		// Every culled object is the mesh with its own instance
+		VkDeviceSize instanceOffset{ 0 };
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		m_Geometry.Bind(commandBuffer, m_Mesh.page);
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &m_InstanceBuffer, &instanceOffset);
+
+		m_Culler.RecordDraws(commandBuffer, late);
+	}
+
+	void Core::RecordShadows(VkCommandBuffer commandBuffer) {
+		// Every caster is the mesh with its own instance, like the culled draws
+		VkDeviceSize instanceOffset{ 0 };
+
+		m_Geometry.Bind(commandBuffer, m_Mesh.page);
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &m_InstanceBuffer, &instanceOffset);
+
+		m_Shadows.Record(commandBuffer, m_PipelineRegistry.Get(m_ShadowPipelineKey));
+	}
+
+	void Core::CreateParticleSystem(uint32_t capacity) {
+		m_pParticles = std::make_unique<ParticleSystem>();
+		m_pParticles->Initialize(m_Device, &m_MemoryTracker, m_ShaderCache.Get(SHADER(particle_comp.spv)),
+			SHADER(particle_vert.spv), capacity, m_Debug);
+
+		// Compiles in the background, the particles are simulated but not drawn until it's ready
+		m_ParticlePipelineKey = m_PipelineRegistry.Request(m_pParticles->GetPipelineState(GetMainPipelineState(false)));
+	}
+
+	void Core::DestroyParticleSystem() {
+		m_DeletionQueue.Push([pParticles = std::shared_ptr<ParticleSystem>{ std::move(m_pParticles) }]{
+			pParticles->Cleanup();
+		});
+
+		m_ParticlePipelineKey = 0;
+	}
+
 	void Core::DrawFrame() {
-		vkWaitForFences(m_Device, 1, &m_InFlightFences[m_CurrentFrame], VK_TRUE, UINT64_MAX);
+		TRACE_SCOPE("DrawFrame");
+
+		FrameContext& frame{ *m_Frames[m_CurrentFrame] };
+
+		{
+			TRACE_SCOPE("WaitForFrameFence");
+			frame.Wait();
+		}
+
+		// Surfaces compiles that failed on the pool, nothing else would for pipelines never waited on
+		m_PipelineRegistry.Poll();
+
+		// Whatever the frames that retired by now were the last to use
+		m_DeletionQueue.Collect();
+		m_FrameCapture.Collect();
+		if (m_OcclusionCulling) m_Culler.Collect(uint32_t(m_CurrentFrame));
 
 		uint32_t imageIndex;
-		VkResult result = vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrame], VK_NULL_HANDLE, &imageIndex);
+		VkResult result;
+		{
+			TRACE_SCOPE("AcquireNextImage");
+			result = vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, frame.GetImageAvailable(), VK_NULL_HANDLE, &imageIndex);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			// Recreate the swap chain and exit
@@ -1102,33 +1744,40 @@ namespace vulkat{
 			throw std::runtime_error("Failed to acquire swap chain image!");
 		}
 
-		// Check if previous frame is using image
-		if (m_ImagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-			vkWaitForFences(m_Device, 1, &m_ImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		// The frame's last submission retired, its timestamps are ready (read before recording resets them)
+		m_GpuProfiler.Collect(uint32_t(m_CurrentFrame));
+
+		// Deferred deletions, command pool and upload slice of this frame are free again
+		frame.Reset();
+
+		{
+			TRACE_SCOPE("RecordCommandBuffer");
+			RecordCommandBuffer(frame.GetCommandBuffer(), imageIndex);
 		}
-		// Mark the image as being in use
-		m_ImagesInFlight[imageIndex] = m_InFlightFences[m_CurrentFrame];
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore waitSemaphores[] = { m_ImageAvailableSemaphores[m_CurrentFrame] };
-		VkSemaphore signalSemaphores[] = { m_RenderFinishedSemaphores[m_CurrentFrame] };
+		VkSemaphore waitSemaphores[] = { frame.GetImageAvailable() };
+		VkSemaphore signalSemaphores[] = { frame.GetRenderFinished() };
+		VkCommandBuffer commandBuffer{ frame.GetCommandBuffer() };
 
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &m_CommandBuffers[imageIndex];
+		submitInfo.pCommandBuffers = &commandBuffer;
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
-		vkResetFences(m_Device, 1, &m_InFlightFences[m_CurrentFrame]);
-
-		if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_InFlightFences[m_CurrentFrame]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to submit draw command buffer!");
+		{
+			TRACE_SCOPE("QueueSubmit");
+			frame.MarkSubmitted(m_GraphicsTimeline.Submit(m_GraphicsQueue, submitInfo));
 		}
+		m_FrameCapture.MarkSubmitted(m_GraphicsTimeline.GetSubmitted());
+		m_GpuProfiler.MarkSubmitted(uint32_t(m_CurrentFrame));
+		if (m_OcclusionCulling) m_Culler.MarkSubmitted(uint32_t(m_CurrentFrame));
 
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1141,7 +1790,11 @@ namespace vulkat{
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr;
 
-		result = vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+		{
+			TRACE_SCOPE("QueuePresent");
+			result = vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+		}
+		m_FramePacer.MarkPresented();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_FramebufferResized) {
 			// Recreate the swap chain
@@ -1152,10 +1805,297 @@ namespace vulkat{
 			throw std::runtime_error("Failed to present swap chain image!");
 		}
 
-		m_CurrentFrame = (m_CurrentFrame + 1) % m_MaxFramesInFlight; // Increment the current frame
+		m_CurrentFrame = (m_CurrentFrame + 1) % m_Frames.size(); // Increment the current frame
+	}
+
+	void Core::BeginBenchmarkScenario(const BenchmarkScenario& scenario, Benchmark& benchmark) {
+		using Clock = std::chrono::steady_clock;
+
+		switch (scenario.load) {
+			case BenchmarkLoad::Triangles: {
+				// Small triangles scattered over the screen, the same ones every run
+				std::vector<Vertex> triangleVertices(size_t(scenario.count) * 3);
+				std::vector<uint32_t> triangleIndices(triangleVertices.size());
+
+				auto random = [this]{ return Benchmark::Random(m_BenchmarkSeed); };
+
+				for (size_t i{}; i < triangleVertices.size(); i += 3) {
+					glm::vec2 center{ random() * 2.f - 1.f, random() * 2.f - 1.f };
+					glm::vec3 color{ random(), random(), random() };
+					triangleVertices[i] = { center + glm::vec2{ -0.01f, 0.01f }, color };
+					triangleVertices[i + 1] = { center + glm::vec2{ 0.f, -0.01f }, color };
+					triangleVertices[i + 2] = { center + glm::vec2{ 0.01f, 0.01f }, color };
+				}
+				for (size_t i{}; i < triangleIndices.size(); ++i) triangleIndices[i] = uint32_t(i);
+
+				m_BenchmarkMesh = UploadMesh(triangleVertices, triangleIndices);
+				break;
+			}
+			case BenchmarkLoad::Pipelines: {
+				// Blend factors, culling and winding give every pipeline its own hash
+				static const VkBlendFactor blendFactors[]{
+					VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_SRC_ALPHA, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+					VK_BLEND_FACTOR_DST_COLOR, VK_BLEND_FACTOR_SRC_COLOR, VK_BLEND_FACTOR_ONE_MINUS_DST_COLOR, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR
+				};
+				static const VkCullModeFlags cullModes[]{ VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT };
+
+				PipelineState state{ GetMainPipelineState() };
+				state.blendEnable = true;
+
+				Clock::time_point start{ Clock::now() };
+				for (uint32_t i{}; i < scenario.count; ++i) {
+					state.srcBlendFactor = blendFactors[i % 8];
+					state.dstBlendFactor = blendFactors[i / 8 % 8];
+					state.cullMode = cullModes[i / 64 % 3];
+					state.frontFace = i / 192 % 2 ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE;
+
+					m_BenchmarkPipelineKeys.push_back(m_PipelineRegistry.Request(state));
+				}
+				for (uint64_t key : m_BenchmarkPipelineKeys) m_PipelineRegistry.Wait(key);
+
+				// Compiles run on the pool, so this is pipelines per second of wall clock time
+				benchmark.AddWork(double(scenario.count), std::chrono::duration<double>(Clock::now() - start).count());
+				break;
+			}
+			case BenchmarkLoad::SpatialQueries:
+			case BenchmarkLoad::SpatialChurn: {
+				// Unit boxes spread through a cube with room to spare, about what a streaming open world holds
+				m_pBenchmarkTree = std::make_unique<AabbTree>(0.5f);
+				m_BenchmarkBounds.resize(scenario.count);
+				m_BenchmarkProxies.resize(scenario.count);
+
+				for (uint32_t i{}; i < scenario.count; ++i) {
+					glm::vec3 center{ Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f };
+					m_BenchmarkBounds[i] = Aabb{ center - glm::vec3{ 1.f }, center + glm::vec3{ 1.f } };
+					m_BenchmarkProxies[i] = m_pBenchmarkTree->Insert(m_BenchmarkBounds[i], i);
+				}
+
+				if (m_Debug) {
+					std::cout << "AABB tree of " << m_pBenchmarkTree->GetProxyCount() << " objects, height " << m_pBenchmarkTree->GetHeight()
+						<< ", area ratio " << m_pBenchmarkTree->GetAreaRatio() << '\n';
+				}
+				break;
+			}
+			case BenchmarkLoad::Particles:
+				if (!m_pParticles) CreateParticleSystem(scenario.count);
+				m_PipelineRegistry.Wait(m_ParticlePipelineKey);
+
+				// Refill as fast as particles die, so every frame simulates and draws about all of them
+				m_pParticles->SetEmitter(glm::vec2{ 0.f, 0.8f }, float(scenario.count) * 60.f);
+				break;
+			case BenchmarkLoad::Occlusion: {
+				// A wall just behind the mesh covering the screen, and count - 1 small quads hidden behind the wall
+				const glm::quat identity{ 1.f, 0.f, 0.f, 0.f };
+
+				m_BenchmarkTransforms.push_back(m_Transforms.Create());
+				m_Transforms.SetLocal(m_BenchmarkTransforms.back(), glm::vec3{ 0.f, 0.f, 0.1f }, identity, glm::vec3{ 2.5f, 2.5f, 1.f });
+
+				for (uint32_t i{ 1 }; i < scenario.count; ++i) {
+					glm::vec3 position{ Benchmark::Random(m_BenchmarkSeed) * 1.8f - 0.9f, Benchmark::Random(m_BenchmarkSeed) * 1.8f - 0.9f,
+						0.5f + Benchmark::Random(m_BenchmarkSeed) * 0.4f };
+
+					m_BenchmarkTransforms.push_back(m_Transforms.Create());
+					m_Transforms.SetLocal(m_BenchmarkTransforms.back(), position, identity, glm::vec3{ 0.05f, 0.05f, 1.f });
+				}
+				break;
+			}
+			case BenchmarkLoad::Uploads:
+				CreateVkBuffer(VkDeviceSize(scenario.count) * 1024, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					MemoryCategory::Other, m_BenchmarkUploadBuffer, m_BenchmarkUploadBufferMemory);
+				break;
+			default:
+				break;
+		}
+
+		m_pBenchmarkScenario = &scenario;
+	}
+
+	void Core::EndBenchmarkScenario() {
+		// Frames still in flight may use the scenario's buffers
+		if (m_BenchmarkUploadBuffer != VK_NULL_HANDLE) {
+			m_DeletionQueue.Push([this, buffer = m_BenchmarkUploadBuffer, memory = m_BenchmarkUploadBufferMemory]{
+				vkDestroyBuffer(m_Device, buffer, nullptr);
+				m_MemoryTracker.Free(memory);
+			});
+		}
+
+		m_BenchmarkUploadBuffer = VK_NULL_HANDLE;
+		m_BenchmarkUploadBufferMemory = VK_NULL_HANDLE;
+
+		m_Geometry.Free(m_BenchmarkMesh);
+		m_BenchmarkMesh = {};
+
+		// The pipelines stay in the registry until the next swapchain recreation
+		m_BenchmarkPipelineKeys.clear();
+
+		m_pBenchmarkTree.reset();
+		m_BenchmarkProxies.clear();
+		m_BenchmarkBounds.clear();
+
+		// Their instances go with them, the culler drops the objects next frame
+		for (uint32_t transform : m_BenchmarkTransforms) m_Transforms.Destroy(transform);
+		m_BenchmarkTransforms.clear();
+
+		// Unless -e asked for them too
+		if (m_pBenchmarkScenario->load == BenchmarkLoad::Particles && m_Settings.particleCount == 0) {
+			DestroyParticleSystem();
+		}
+
+		// Back to the size the window was created with
+		if (m_pBenchmarkScenario->load == BenchmarkLoad::Resizes) {
+			glfwSetWindowSize(m_pWindow, int(m_WindowProperties.width), int(m_WindowProperties.height));
+		}
+
+		m_pBenchmarkScenario = nullptr;
+	}
+
+	double Core::PrepareBenchmarkFrame(uint32_t frame, Benchmark& benchmark) {
+		using Clock = std::chrono::steady_clock;
+
+		const BenchmarkScenario& scenario{ *m_pBenchmarkScenario };
+		const bool measured{ frame >= Benchmark::m_WarmupFrames };
+
+		switch (scenario.load) {
+			case BenchmarkLoad::Triangles:
+			case BenchmarkLoad::Draws:
+			case BenchmarkLoad::Occlusion:
+				return double(scenario.count);
+			case BenchmarkLoad::Uploads:
+				return double(scenario.count) / 1024.0; // MiB
+			case BenchmarkLoad::Particles:
+				return double(m_pParticles->GetCapacity()); // Once the first frames filled it up
+			case BenchmarkLoad::Resizes: {
+				// Alternate between the full and three quarter size, the resize callback recreates the swapchain after the present
+				float scale{ frame % 2 ? 0.75f : 1.f };
+				glfwSetWindowSize(m_pWindow, int(m_WindowProperties.width * scale), int(m_WindowProperties.height * scale));
+				return 1.0;
+			}
+			case BenchmarkLoad::SpatialQueries: {
+				// Timed on their own, rendering would otherwise dominate the throughput
+				const uint32_t frustumQueries{ 16 }, rayQueries{ 1024 }, overlapQueries{ 1024 };
+				size_t hits{ 0 };
+
+				Clock::time_point start{ Clock::now() };
+				for (uint32_t i{}; i < frustumQueries; ++i) {
+					glm::vec3 eye{ Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f };
+					glm::mat4 viewProjection{ glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 250.f)
+						* glm::lookAt(eye, glm::vec3{ 500.f }, glm::vec3{ 0.f, 1.f, 0.f }) };
+					m_pBenchmarkTree->QueryFrustum(Frustum::FromMatrix(viewProjection), [&hits](uint32_t){ ++hits; });
+				}
+				for (uint32_t i{}; i < rayQueries; ++i) {
+					// Picking: nearest box along a random ray, clipped as hits come in
+					Ray ray{ glm::vec3{ Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f, 0.f },
+						glm::vec3{ Benchmark::Random(m_BenchmarkSeed) - 0.5f, Benchmark::Random(m_BenchmarkSeed) - 0.5f, 1.f }, 1000.f };
+					m_pBenchmarkTree->QueryRay(ray, [&hits](const Ray& clipped, uint32_t){ ++hits; return clipped.maxDistance * 0.9f; });
+				}
+				for (uint32_t i{}; i < overlapQueries; ++i) {
+					glm::vec3 center{ Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f, Benchmark::Random(m_BenchmarkSeed) * 1000.f };
+					m_pBenchmarkTree->QueryOverlap(Aabb{ center - glm::vec3{ 10.f }, center + glm::vec3{ 10.f } }, [&hits](uint32_t){ ++hits; return true; });
+				}
+				double seconds{ std::chrono::duration<double>(Clock::now() - start).count() };
+
+				if (measured) benchmark.AddWork(double(frustumQueries + rayQueries + overlapQueries), seconds);
+				if (m_Debug && frame == Benchmark::m_WarmupFrames) std::cout << hits << " spatial query hits per frame\n";
+				return 0.0;
+			}
+			case BenchmarkLoad::SpatialChurn: {
+				// Everything drifts a little, most moves stay inside the fat bounds and never touch the tree
+				const uint32_t moves{ scenario.count / 10 };
+
+				Clock::time_point start{ Clock::now() };
+				for (uint32_t i{}; i < moves; ++i) {
+					uint32_t object{ uint32_t(Benchmark::Random(m_BenchmarkSeed) * float(scenario.count)) % scenario.count };
+					glm::vec3 offset{ Benchmark::Random(m_BenchmarkSeed) - 0.5f, Benchmark::Random(m_BenchmarkSeed) - 0.5f, Benchmark::Random(m_BenchmarkSeed) - 0.5f };
+
+					Aabb& bounds{ m_BenchmarkBounds[object] };
+					bounds = Aabb{ bounds.min + offset, bounds.max + offset };
+					m_pBenchmarkTree->Move(m_BenchmarkProxies[object], bounds);
+				}
+				double seconds{ std::chrono::duration<double>(Clock::now() - start).count() };
+
+				if (measured) benchmark.AddWork(double(moves), seconds);
+				return 0.0;
+			}
+			default:
+				return 0.0;
+		}
+	}
+
+	void Core::CollectBenchmarkDraws() {
+		const BenchmarkScenario& scenario{ *m_pBenchmarkScenario };
+
+		DrawCommand draw{};
+		draw.pipelineKey = m_PipelineKey;
+		draw.vertexBuffer = m_Geometry.GetVertexBuffer(m_Mesh.page);
+		draw.instanceBuffer = m_InstanceBuffer;
+		draw.indexBuffer = m_Geometry.GetIndexBuffer(m_Mesh.page);
+		draw.indexType = GeometryBuffer::m_IndexType;
+		draw.firstIndex = m_Mesh.firstIndex + m_MeshLods.levels[m_MeshLod].firstIndex;
+		draw.indexCount = m_MeshLods.levels[m_MeshLod].indexCount;
+		draw.vertexOffset = m_Mesh.vertexOffset;
+		draw.firstInstance = m_Transforms.GetIndex(m_MeshTransform);
+
+		switch (scenario.load) {
+			case BenchmarkLoad::Triangles:
+				// Usually the mesh's page too, then nothing is bound again for it
+				draw.vertexBuffer = m_Geometry.GetVertexBuffer(m_BenchmarkMesh.page);
+				draw.indexBuffer = m_Geometry.GetIndexBuffer(m_BenchmarkMesh.page);
+				draw.firstIndex = m_BenchmarkMesh.firstIndex;
+				draw.indexCount = m_BenchmarkMesh.indexCount;
+				draw.vertexOffset = m_BenchmarkMesh.vertexOffset;
+				m_DrawQueue.Add(m_MainPass, draw, 1, 0.0f);
+				break;
+			case BenchmarkLoad::Draws:
+				for (uint32_t i{}; i < scenario.count; ++i) {
+					m_DrawQueue.Add(m_MainPass, draw, 0, float(i) / float(scenario.count));
+				}
+				break;
+			case BenchmarkLoad::Pipelines:
+				for (uint64_t key : m_BenchmarkPipelineKeys) {
+					draw.pipelineKey = key;
+					m_DrawQueue.Add(m_MainPass, draw, 0, 0.0f);
+				}
+				break;
+			case BenchmarkLoad::Occlusion:
+				if (m_OcclusionCulling) break; // Drawn from the culler's lists
+
+				// The baseline: every object through both passes, front to back
+				for (uint32_t transform : m_BenchmarkTransforms) {
+					draw.firstInstance = m_Transforms.GetIndex(transform);
+					float depth{ m_Transforms.GetWorld(transform)[3].z };
+
+					if (m_DepthPrepass) {
+						draw.pipelineKey = m_DepthPipelineKey;
+						m_DrawQueue.Add(m_DepthPass, draw, 0, depth);
+					}
+
+					draw.pipelineKey = m_PipelineKey;
+					m_DrawQueue.Add(m_MainPass, draw, 0, depth);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	void Core::RecordBenchmarkUploads(VkCommandBuffer commandBuffer) {
+		VkDeviceSize size{ VkDeviceSize(m_pBenchmarkScenario->count) * 1024 };
+		UploadAllocation upload{ m_Frames[m_CurrentFrame]->Allocate(size) };
+
+		// Every byte is written, like a real upload
+		memset(upload.pData, int(m_CurrentFrame), size_t(size));
+
+		VkBufferCopy region{};
+		region.srcOffset = upload.offset;
+		region.dstOffset = 0;
+		region.size = size;
+
+		vkCmdCopyBuffer(commandBuffer, upload.buffer, m_BenchmarkUploadBuffer, 1, &region);
 	}
 
 	void Core::RecreateSwapChain() {
+		TRACE_SCOPE("RecreateSwapChain");
+
 		int width{ 0 }, height{ 0 };
 		glfwGetFramebufferSize(m_pWindow, &width, &height);
 		while (width == 0 || height == 0) { // When window is minimized, its size will be 0
@@ -1165,40 +2105,38 @@ namespace vulkat{
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(m_Device); // Don't touch resources until device is ready
-
+		// No wait for the device, frames still in flight keep the old objects until they retire
 		CleanupSwapChain(); // Clean up previous swap chain and dependencies
 
 		CreateSwapChain(); // Recreate the swap chain
 
 		// These all depend on the swap chain
 		CreateImageViews();
-		CreateRenderPass();
+		CreateRenderGraph();
+		if (m_OcclusionCulling) m_Culler.Configure(m_RenderGraph.GetImageView(m_DepthResource), m_SwapChainExtent);
+		if (m_LitShading) m_Lighting.Configure(m_SwapChainExtent);
 		CreateGraphicsPipeline();
-		CreateFramebuffers();
-		CreateCommandBuffers();
+		m_PipelineRegistry.Wait(m_PipelineKey); // No fallback survives a new render pass
+		if (m_DepthPrepass) m_PipelineRegistry.Wait(m_DepthPipelineKey);
+		if (m_Settings.shadows) m_PipelineRegistry.Wait(m_ShadowPipelineKey);
 	}
 
 	void Core::CleanupSwapChain() {
-		// Destroy framebuffers
-		for (auto framebuffer : m_SwapChainFramebuffers) {
-			vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
-		}
+		// Destroy rendering pipelines, they were built against this render pass
+		m_PipelineRegistry.Clear(&m_DeletionQueue);
 
-		// Free existing command buffers instead of recreating them
-		vkFreeCommandBuffers(m_Device, m_CommandPool, static_cast<uint32_t>(m_CommandBuffers.size()), m_CommandBuffers.data());
+		// Destroy render passes, framebuffers and transient attachments
+		m_RenderGraph.Reset(&m_DeletionQueue);
 
-		// Destroy rendering pipeline
-		vkDestroyPipeline(m_Device, m_GraphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-		vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+		// Destroy the pipeline layout, image views and the swap chain
+		m_DeletionQueue.Push([this, pipelineLayout = m_PipelineLayout, imageViews = m_SwapChainImageViews, swapChain = m_SwapChain]{
+			vkDestroyPipelineLayout(m_Device, pipelineLayout, nullptr);
 
-		// Destroy image views
-		for (auto imageView : m_SwapChainImageViews) {
-			vkDestroyImageView(m_Device, imageView, nullptr);
-		}
+			for (auto imageView : imageViews) {
+				vkDestroyImageView(m_Device, imageView, nullptr);
+			}
 
-		// Destroy swap chains
-		vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
+			vkDestroySwapchainKHR(m_Device, swapChain, nullptr);
+		});
 	}
 }
@@ -6,6 +6,40 @@
 
 // Validation Layers
 #include "validation.hpp"
+
+// Shader modules and pipelines
+#include "shadercache.hpp"
+#include "pipelineregistry.hpp"
+#include "threadpool.hpp"
+
+// Passes and their attachments
+#include "rendergraph.hpp"
+#include "drawqueue.hpp"
+#include "meshlod.hpp"
+#include "geometrybuffer.hpp"
+#include "particlesystem.hpp"
+#include "occlusionculler.hpp"
+#include "shadowcascades.hpp"
+#include "clusteredlighting.hpp"
+
+// Device memory and CPU allocators
+#include "memorytracker.hpp"
+#include "allocators.hpp"
+
+// Per frame in flight resources and queue synchronization
+#include "timeline.hpp"
+#include "deletionqueue.hpp"
+#include "framecontext.hpp"
+#include "framecapture.hpp"
+
+// Init stage and frame timing
+#include "startupprofiler.hpp"
+#include "framepacer.hpp"
+#include "gpuprofiler.hpp"
+#include "trace.hpp"
+#include "benchmark.hpp"
+#include "../game/aabbtree.hpp"
+#include "../game/transformhierarchy.hpp"
 #include <vulkan/vulkan_core.h>
 
 // vulkat
@@ -20,7 +54,7 @@
 namespace vulkat{
 	class Core final {
 	public:
-		explicit Core(const Window& window, bool debug);
+		explicit Core(const Window& window, const Settings& settings);
 
 		// Disallow copy
 		Core(const Core& other) = delete; // Copy constructor
@@ -32,67 +66,127 @@ namespace vulkat{
 		~Core();
 
 		void Run();
+		bool RunBenchmark(); // Synthetic scenarios instead of the game loop, false if they regressed past the baseline
 
 	private:
 		// DATA MEMBERS
 		const Window m_WindowProperties; // Window properties
+		const Settings m_Settings; // Command line options
 		bool m_Debug;
+		LatencyMode m_LatencyMode; // Resolved, never FromWindow
+		bool m_OcclusionCulling; // Off if the device can't draw indirect with a first instance
+		bool m_DepthPrepass; // Asked for or needed by occlusion culling
+		bool m_LitShading; // lit.frag and the light set, with lights or shadows
+
+		StartupProfiler m_StartupProfiler; // Time to first frame
 
-		static const int m_MaxFramesInFlight;
+		static const VkDeviceSize m_UploadSliceSize; // Upload ring space per frame in flight
 
 		GLFWwindow* m_pWindow; // Window to render to
 
 		VkInstance m_pInstance; // Vulkan Instance (is pointer)
+		uint32_t m_InstanceVersion; // Highest API version the loader and instance support, capped at 1.2
 		VkDebugUtilsMessengerEXT m_pDebugMessenger; // Debug Messenger (is pointer)
 		VkSurfaceKHR m_Surface; // Window Surface
 
 		VkPhysicalDevice m_PhysicalDevice; // Physical device (the GPU)
+		DeviceCapabilities m_Capabilities; // Of the chosen GPU, queried once
 		VkDevice m_Device; // Logical device
+		MemoryTracker m_MemoryTracker; // Every device memory allocation, per heap and category
 
 		VkQueue m_GraphicsQueue; // Handle to interact with graphics queue
 		VkQueue m_PresentQueue; // Handle to interact with the presentation queue
+		Timeline m_GraphicsTimeline; // Every graphics queue submission signals the next value
+		DeletionQueue m_DeletionQueue; // Resources waiting for the graphics timeline to pass their last use
+		FrameCapture m_FrameCapture; // Readback of presented frames, with -c
 
 		VkSwapchainKHR m_SwapChain; // Swapchain
 		std::vector<VkImage> m_SwapChainImages; // Handle for images in swapchain
 		VkFormat m_SwapChainImageFormat;
 		VkExtent2D m_SwapChainExtent;
 		std::vector<VkImageView> m_SwapChainImageViews; // Handle for image views in swapchain
-		std::vector<VkFramebuffer> m_SwapChainFramebuffers; // Handle for frame buffers
 
-		VkRenderPass m_RenderPass; // Render pass
+		RenderGraph m_RenderGraph; // Render passes, framebuffers and transient attachments
+		RenderGraph::Pass m_DepthPass; // Only with the depth pre-pass
+		RenderGraph::Pass m_LateDepthPass; // Only with occlusion culling, objects the Hi-Z re-test found visible
+		RenderGraph::Pass m_MainPass;
+		RenderGraph::Resource m_DepthResource; // Sampled by the Hi-Z pass with occlusion culling
+		VkFormat m_DepthFormat; // Best depth format the device supports as attachment
+		VkRenderPass m_RenderPass; // Render pass of the main pass, owned by the render graph
 		VkPipelineLayout m_PipelineLayout; // Pipeline layout
-		VkPipeline m_GraphicsPipeline; // Graphics pipeline
+		uint64_t m_PipelineKey; // Graphics pipeline, owned by the registry
+		uint64_t m_DepthPipelineKey; // Depth only pipeline for the pre-pass
+
+		ThreadPool m_ThreadPool; // Workers for pipeline compiles and other background jobs
+		ShaderCache m_ShaderCache; // Shader modules, kept alive across pipeline rebuilds
+		PipelineRegistry m_PipelineRegistry; // Deduplicated, asynchronously compiled pipelines
+
+		VkCommandPool m_CommandPool; // Command pool for one time transfers, frames have their own
 
-		VkCommandPool m_CommandPool; // Command pool
+		GeometryBuffer m_Geometry; // Every static mesh, sub-allocated from shared vertex and index buffers
+		MeshAllocation m_Mesh; // The scene's mesh, every LOD's indices
+		MeshLods m_MeshLods; // Index ranges of the LODs, relative to m_Mesh.firstIndex
+		uint32_t m_MeshLod; // Level drawn last frame, selection is relative to it
+		uint32_t m_SceneMeshLod; // Level the culler's and shadow casters' draws were last written with
 
-		VkBuffer m_VertexBuffer; // Vertex buffer
-		VkDeviceMemory m_VertexBufferMemory; // Vertex buffer on gpu
-		VkBuffer m_IndexBuffer; // Index buffer
-		VkDeviceMemory m_IndexBufferMemory; // Index buffer on gpu
+		TransformHierarchy m_Transforms; // Scene graph, world matrices become instance data
+		uint32_t m_MeshTransform;
+		VkBuffer m_InstanceBuffer; // World matrix of every transform, by index, only changed ones are copied in
+		VkDeviceMemory m_InstanceBufferMemory;
+		uint32_t m_InstanceCapacity;
+		std::vector<TransformRange> m_TransformUploads; // Scratch, kept to avoid allocating every frame
 
+		std::unique_ptr<ParticleSystem> m_pParticles; // With -e or during the particle benchmark
+		uint64_t m_ParticlePipelineKey;
+		std::chrono::steady_clock::time_point m_LastRecord; // Simulation steps span the time between recorded frames
 
-		std::vector<VkCommandBuffer> m_CommandBuffers; // Commandbuffers
+		ClusteredLighting m_Lighting; // With -i or -w: lights binned into a froxel grid every frame, shaded by lit.frag
+		ShadowCascades m_Shadows; // With -w: the mesh and benchmark objects cast, static so the cascades stay cached
+		uint64_t m_ShadowPipelineKey;
 
-		// Semaphores & Fences
-		std::vector<VkSemaphore> m_ImageAvailableSemaphores;
-		std::vector<VkSemaphore> m_RenderFinishedSemaphores;
-		std::vector<VkFence> m_InFlightFences;
-		std::vector<VkFence> m_ImagesInFlight;
+		VkBuffer m_UploadBuffer; // Ring of per frame slices, persistently mapped
+		VkDeviceMemory m_UploadBufferMemory;
+		void* m_pUploadData;
+
+		DrawQueue m_DrawQueue; // Sorted draws of the frame being recorded
+		OcclusionCuller m_Culler; // With -x: the mesh (object 0) and benchmark objects, drawn from GPU written indirect lists
+
+		std::vector<std::unique_ptr<FrameContext>> m_Frames; // One per frame in flight
 		size_t m_CurrentFrame;
 
 		bool m_FramebufferResized;
+		bool m_TraceFlushRequested;
+
+		GpuProfiler m_GpuProfiler; // Timestamp queries per frame and per pass
+		FramePacer m_FramePacer; // Frame limiter and input to present latency
+		RollingAverage m_CpuFrameTime; // Whole loop iteration, in ms
+		RollingAverage m_AllocationsPerFrame; // operator new calls per loop iteration, 0 in steady state
+
+		LinearArena m_ScratchArena; // Short lived query results, rewound by whoever used it
+
+		// Benchmark load, only while RunBenchmark() runs a scenario
+		const BenchmarkScenario* m_pBenchmarkScenario;
+		std::vector<uint64_t> m_BenchmarkPipelineKeys;
+		MeshAllocation m_BenchmarkMesh; // Triangles of the triangle scenario, next to the scene's mesh
+		VkBuffer m_BenchmarkUploadBuffer; // Destination of the upload scenario's copies
+		VkDeviceMemory m_BenchmarkUploadBufferMemory;
+		std::unique_ptr<AabbTree> m_pBenchmarkTree; // Objects of the spatial scenarios
+		std::vector<int32_t> m_BenchmarkProxies;
+		std::vector<Aabb> m_BenchmarkBounds;
+		std::vector<uint32_t> m_BenchmarkTransforms; // Objects of the occlusion scenario
+		uint32_t m_BenchmarkSeed;
 
 		// MEMBER FUNCTIONS
 		void Initialize();
 		// void Run();
 		void Cleanup();
+		void PrintFrameStats() const;
 
 		// Helper functions
-		static std::vector<char> ReadFile(const std::string& filename, bool debug);
 		static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
-		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-		void CreateVkBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-		void CopyVkBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+		static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+		void CreateVkBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+		uint64_t CopyVkBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0); // Returns the timeline value of the copy
 
 		// Vulkan Extension & Validation layer checks
 		void PrintVulkanExtensions() const;
@@ -112,9 +206,12 @@ namespace vulkat{
 
 		// Physical devices and Queue families
 		void PickPhysicalDevice();
-		bool IsDeviceSuitable(VkPhysicalDevice device);
+		DeviceCapabilities QueryDeviceCapabilities(VkPhysicalDevice device);
+		int64_t ScoreDevice(const DeviceCapabilities& capabilities) const;
+		VkFormat FindDepthFormat() const;
+		bool IsDeviceSuitable(const DeviceCapabilities& capabilities) const;
 		QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
-		bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+		bool CheckDeviceExtensionSupport(const DeviceCapabilities& capabilities) const;
 
 		// Logical devices
 		void CreateLogicalDevice();
@@ -132,35 +229,47 @@ namespace vulkat{
 		// Image Views
 		void CreateImageViews();
 
-		// Render pass
-		void CreateRenderPass();
+		// Render graph
+		void CreateRenderGraph();
+		void CollectDraws();
+		void RecordDepthPass(VkCommandBuffer commandBuffer);
+		void RecordMainPass(VkCommandBuffer commandBuffer);
+		void UpdateSceneObjects(); // Culler objects and shadow casters, whichever are on
+		void RecordCulledDraws(VkCommandBuffer commandBuffer, uint64_t pipelineKey, bool late);
+		void RecordShadows(VkCommandBuffer commandBuffer);
 
 		// Graphics pipeline
+		PipelineState GetMainPipelineState(bool lit = true) const; // Unlit for draws that don't bind the light set, eg. particles
 		void CreateGraphicsPipeline();
-		VkShaderModule CreateShaderModule(const std::vector<char>& bytecode);
-
-		// Framebuffers
-		void CreateFramebuffers();
 
 		// Command pool
 		void CreateCommandPool();
 
-		// Buffers
-		template<typename T>
-		void CreateBuffer(const std::vector<T>& data, VkBuffer& buffer, VkDeviceMemory& bufferMemory, VkBufferUsageFlags usage);
+		// Static geometry, staged into m_Geometry
+		MeshAllocation UploadMesh(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices);
 
-		// Commandbuffers
-		void CreateCommandBuffers();
+		// Frames in flight
+		void CreateFrameContexts();
+		void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+		void UploadTransforms(VkCommandBuffer commandBuffer);
 
-		// Signaling Objects
-		void CreateSyncObjects();
+		// GPU particles
+		void CreateParticleSystem(uint32_t capacity);
+		void DestroyParticleSystem(); // Deferred, frames in flight may still draw them
 
 		// Draw frame
 		void DrawFrame();
 
+		// Benchmark scenarios
+		void BeginBenchmarkScenario(const BenchmarkScenario& scenario, Benchmark& benchmark);
+		void EndBenchmarkScenario();
+		double PrepareBenchmarkFrame(uint32_t frame, Benchmark& benchmark); // Returns the load the frame pushes
+		void CollectBenchmarkDraws();
+		void RecordBenchmarkUploads(VkCommandBuffer commandBuffer);
+
 		// Recreate the swapchain
 		void RecreateSwapChain();
-		void CleanupSwapChain();
+		void CleanupSwapChain(); // Deferred, the swapchain itself stays valid until the next one retired it
 	};
 }
 #endif // CORE_HPP
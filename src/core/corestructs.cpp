@@ -36,7 +36,39 @@ namespace vulkat{
 		return attributeDescription;
 	}
 
+	VkVertexInputBindingDescription InstanceData::GetBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription{};
+
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(InstanceData);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindingDescription;
+	}
+
+	std::array<VkVertexInputAttributeDescription, 4> InstanceData::GetAttributeDescription() {
+		// A mat4 takes a location per column, after the vertex attributes
+		std::array<VkVertexInputAttributeDescription, 4> attributeDescription{};
+
+		for (uint32_t column{}; column < 4; ++column) {
+			attributeDescription[column].binding = 1;
+			attributeDescription[column].location = 2 + column;
+			attributeDescription[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescription[column].offset = offsetof(InstanceData, model) + column * sizeof(glm::vec4);
+		}
+
+		return attributeDescription;
+	}
+
 	bool QueueFamilyIndices::IsComplete() {
 		return graphicsFamily.has_value();
 	}
+
+	bool DeviceCapabilities::HasExtension(const char* name) const {
+		for (const auto& extension : extensions) {
+			if (strcmp(extension.extensionName, name) == 0) return true;
+		}
+
+		return false;
+	}
 }
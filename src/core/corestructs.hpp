@@ -15,6 +15,35 @@ namespace vulkat{
 		bool isVsyncOn;
 	};
 
+	enum class LatencyMode {
+		FromWindow, // Vsync or Uncapped, following Window::isVsyncOn
+		Vsync, // FIFO (relaxed if available), paced by the display
+		Uncapped, // IMMEDIATE, as many frames as possible, tears
+		LowLatency // Frame limiter that sleeps before input sampling, shallow queue
+	};
+
+	// Engine options, filled in from the command line
+	struct Settings {
+		bool debug{ false };
+		std::string startupProfilePath{}; // Write startup stage timings as JSON when set
+		bool printFrameStats{ false }; // Print rolling CPU and GPU frame times every second
+		std::string tracePath{}; // Record trace zones, written here on F12 and at exit
+		bool depthPrepass{ false }; // Lay down depth first, the main pass then shades each pixel once
+		bool measureOverdraw{ false }; // Count fragment shader invocations per pixel
+		LatencyMode latencyMode{ LatencyMode::FromWindow };
+		double targetFps{ 0.0 }; // Frame limiter target in low latency mode, 0 uses the monitor's refresh rate
+		uint32_t framesInFlight{ 2 }; // More overlaps CPU and GPU better, fewer lowers latency
+		bool printMemoryStats{ false }; // Dump device memory per heap and category every second
+		std::string device{}; // GPU by index or name, overrides the scored pick (so does VULKAT_DEVICE)
+		std::string capturePath{}; // Read back every presented frame to files or, with "-", stdout
+		std::string benchmarkBaseline{}; // Run the benchmark scenarios instead of the game loop, compared with this baseline
+		bool updateBaseline{ false }; // Write the benchmark results as the new baseline
+		uint32_t particleCount{ 0 }; // GPU simulated particles, 0 disables the particle system
+		bool occlusionCulling{ false }; // Hi-Z occlusion culling on the GPU with indirect draws, implies the depth pre-pass
+		uint32_t lightCount{ 0 }; // Dynamic point lights with clustered forward shading, 0 keeps the unlit shader
+		bool shadows{ false }; // Directional sun with cascaded shadow maps, implies the lit shader
+	};
+
 	struct Vertex {
 		glm::vec2 pos;
 		glm::vec3 color;
@@ -23,6 +52,14 @@ namespace vulkat{
 		static std::array<VkVertexInputAttributeDescription, 2> GetAttributeDescription();
 	};
 
+	// Per instance vertex data, binding 1
+	struct InstanceData {
+		glm::mat4 model; // World matrix from the transform hierarchy
+
+		static VkVertexInputBindingDescription GetBindingDescription();
+		static std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescription();
+	};
+
 	struct QueueFamilyIndices {
 		std::optional<uint32_t> graphicsFamily; // Allows for checking if a value is present
 		std::optional<uint32_t> presentFamily;
@@ -35,5 +72,21 @@ namespace vulkat{
 		std::vector<VkSurfaceFormatKHR> formats;
 		std::vector<VkPresentModeKHR> presentModes;
 	};
+
+	// Everything device selection and creation look at, queried once per physical device
+	struct DeviceCapabilities {
+		VkPhysicalDevice device{ VK_NULL_HANDLE };
+		VkPhysicalDeviceProperties properties{};
+		VkPhysicalDeviceFeatures features{};
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		VkDeviceSize deviceLocalMemory{ 0 }; // Largest device local heap
+		QueueFamilyIndices queueFamilies{};
+		std::vector<VkExtensionProperties> extensions{};
+		SwapChainSupportDetails swapChain{}; // Formats and present modes are fixed per surface, capabilities get queried again on resize
+		bool suitable{ false };
+		int64_t score{ 0 };
+
+		bool HasExtension(const char* name) const;
+	};
 }
 #endif // CORESTRUCTS_HPP
@@ -0,0 +1,46 @@
+#include "../pch.hpp"
+#include "deletionqueue.hpp"
+
+namespace vulkat {
+	DeletionQueue::DeletionQueue()
+		: m_pTimeline{ nullptr }
+	{}
+
+	void DeletionQueue::Initialize(Timeline* pTimeline) {
+		m_pTimeline = pTimeline;
+	}
+
+	void DeletionQueue::Push(uint64_t value, std::function<void()> deleter) {
+		// Never ahead of an earlier entry, so the front is always the first to retire
+		if (!m_Pending.empty()) value = std::max(value, m_Pending.back().first);
+
+		m_Pending.emplace_back(value, std::move(deleter));
+	}
+
+	void DeletionQueue::Push(std::function<void()> deleter) {
+		Push(m_pTimeline->GetSubmitted() + 1, std::move(deleter));
+	}
+
+	void DeletionQueue::Collect() {
+		if (m_Pending.empty()) return;
+
+		const uint64_t completed{ m_pTimeline->GetCompleted() };
+		while (!m_Pending.empty() && m_Pending.front().first <= completed) {
+			m_Pending.front().second();
+			m_Pending.pop_front();
+		}
+	}
+
+	void DeletionQueue::Flush() {
+		if (m_Pending.empty()) return;
+
+		// Values past the last submission never get signaled, they can only be there if nothing used them
+		m_pTimeline->Wait(std::min(m_Pending.back().first, m_pTimeline->GetSubmitted()));
+
+		for (auto& pending : m_Pending) {
+			pending.second();
+		}
+
+		m_Pending.clear();
+	}
+}
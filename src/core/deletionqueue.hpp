@@ -0,0 +1,46 @@
+#ifndef DELETIONQUEUE_HPP
+#define DELETIONQUEUE_HPP
+
+#include <deque>
+#include <functional>
+
+#include "timeline.hpp"
+
+namespace vulkat {
+	// Destroys resources once the GPU is past the last submission that used them,
+	// so replacing something at runtime (resize, streaming, hot swaps) never drains the queue.
+	// Entries retire in push order, main thread only
+	class DeletionQueue final {
+	public:
+		DeletionQueue();
+
+		DeletionQueue(const DeletionQueue& other) = delete;
+		DeletionQueue(DeletionQueue&& other) = delete;
+		DeletionQueue& operator=(const DeletionQueue& other) = delete;
+		DeletionQueue& operator=(DeletionQueue&& other) = delete;
+
+		~DeletionQueue() = default;
+
+		void Initialize(Timeline* pTimeline);
+
+		// Last used by the submission that signals value
+		void Push(uint64_t value, std::function<void()> deleter);
+
+		// Last used by anything submitted so far or by the command buffer being recorded
+		void Push(std::function<void()> deleter);
+
+		// Runs the deleters whose submission completed, doesn't block
+		void Collect();
+
+		// Waits for everything pushed and runs it, eg. at shutdown
+		void Flush();
+
+		size_t GetPendingCount() const { return m_Pending.size(); }
+
+	private:
+		Timeline* m_pTimeline;
+
+		std::deque<std::pair<uint64_t, std::function<void()>>> m_Pending;
+	};
+}
+#endif // DELETIONQUEUE_HPP
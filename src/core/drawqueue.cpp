@@ -0,0 +1,216 @@
+#include "../pch.hpp"
+#include "drawqueue.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	DrawQueue::DrawQueue()
+		: m_pThreadPool{ nullptr }
+		, m_Stats{}
+	{}
+
+	void DrawQueue::Initialize(ThreadPool* pThreadPool) {
+		m_pThreadPool = pThreadPool;
+	}
+
+	void DrawQueue::Clear() {
+		m_Draws.clear();
+		m_DrawPasses.clear();
+		m_Keys.clear();
+		m_Order.clear();
+
+		// Ids only have to be consistent within one sort, start over once every rebuild has used up the 16 bits.
+		// Only here at the frame boundary, draws already queued keep the ids their keys were built with
+		if (m_PipelineIds.size() > 0xFFFF) m_PipelineIds.clear();
+
+		m_Stats = Stats{};
+	}
+
+	void DrawQueue::Add(uint32_t pass, const DrawCommand& draw, uint16_t material, float depth) {
+		m_Keys.push_back(MakeSortKey(pass, GetPipelineId(draw.pipelineKey), material, depth));
+		m_Order.push_back(uint32_t(m_Draws.size()));
+		m_Draws.push_back(draw);
+		m_DrawPasses.push_back(uint8_t(pass));
+	}
+
+	uint64_t DrawQueue::MakeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, float depth) {
+		const uint32_t depthMax{ (1u << 24) - 1 };
+		uint32_t quantizedDepth{ uint32_t(std::min(std::max(depth, 0.0f), 1.0f) * float(depthMax)) };
+
+		return (uint64_t(pass & 0xFF) << 56)
+			| (uint64_t(pipeline & 0xFFFF) << 40)
+			| (uint64_t(material & 0xFFFF) << 24)
+			| uint64_t(quantizedDepth);
+	}
+
+	uint32_t DrawQueue::GetPipelineId(uint64_t pipelineKey) {
+		auto it = m_PipelineIds.find(pipelineKey);
+		if (it != m_PipelineIds.end()) return it->second;
+
+		// Past 0xFFFF ids alias in the sort key until the next Clear(), which only costs pipeline switches
+		uint32_t id{ uint32_t(m_PipelineIds.size()) };
+		m_PipelineIds.emplace(pipelineKey, id);
+		return id;
+	}
+
+	template<typename Func>
+	void DrawQueue::ForEachChunk(size_t chunkCount, Func&& func) {
+		const size_t count{ m_Keys.size() };
+		const size_t chunkSize{ (count + chunkCount - 1) / chunkCount };
+
+		if (chunkCount == 1) {
+			func(0, 0, count);
+			return;
+		}
+
+		// ForEach() rather than Submit(), this runs every frame and must not allocate
+		auto chunkJob{ [&func, count, chunkSize](uint32_t chunk) {
+			size_t begin{ chunk * chunkSize };
+			func(chunk, begin, std::min(count, begin + chunkSize));
+		} };
+		m_pThreadPool->ForEach(uint32_t(chunkCount), chunkJob);
+	}
+
+	void DrawQueue::Sort() {
+		TRACE_SCOPE("SortDraws");
+
+		const size_t count{ m_Keys.size() };
+		if (count < 2) return;
+
+		// Digits that are equal in every key don't change the order, eg. the pass byte with a single pass
+		uint64_t varying{ 0 };
+		for (uint64_t key : m_Keys) {
+			varying |= key ^ m_Keys[0];
+		}
+
+		size_t chunkCount{ 1 };
+		if (m_pThreadPool && count >= m_ParallelThreshold) {
+			chunkCount = std::min<size_t>(m_pThreadPool->GetThreadCount() + 1, count / (m_ParallelThreshold / 4));
+		}
+
+		m_ScratchKeys.resize(count);
+		m_ScratchOrder.resize(count);
+		m_Histograms.resize(chunkCount);
+
+		// LSD radix sort, a byte per pass. Each chunk counts its digits, the offsets are laid out digit major / chunk minor,
+		// then every chunk scatters its own range in order, which keeps every pass stable
+		for (uint32_t shift{ 0 }; shift < 64; shift += 8) {
+			if (((varying >> shift) & 0xFF) == 0) continue;
+
+			ForEachChunk(chunkCount, [this, shift](size_t chunk, size_t begin, size_t end) {
+				std::array<uint32_t, m_RadixSize>& histogram{ m_Histograms[chunk] };
+				histogram.fill(0);
+
+				for (size_t i{ begin }; i < end; ++i) {
+					++histogram[(m_Keys[i] >> shift) & 0xFF];
+				}
+			});
+
+			uint32_t offset{ 0 };
+			for (size_t digit{}; digit < m_RadixSize; ++digit) {
+				for (size_t chunk{}; chunk < chunkCount; ++chunk) {
+					uint32_t digitCount{ m_Histograms[chunk][digit] };
+					m_Histograms[chunk][digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			ForEachChunk(chunkCount, [this, shift](size_t chunk, size_t begin, size_t end) {
+				std::array<uint32_t, m_RadixSize>& offsets{ m_Histograms[chunk] };
+
+				for (size_t i{ begin }; i < end; ++i) {
+					uint32_t destination{ offsets[(m_Keys[i] >> shift) & 0xFF]++ };
+					m_ScratchKeys[destination] = m_Keys[i];
+					m_ScratchOrder[destination] = m_Order[i];
+				}
+			});
+
+			m_Keys.swap(m_ScratchKeys);
+			m_Order.swap(m_ScratchOrder);
+		}
+	}
+
+	bool DrawQueue::Record(VkCommandBuffer commandBuffer, uint32_t pass, const PipelineRegistry& registry, uint64_t fallbackKey) {
+		// The pass is the top byte, so its draws are one contiguous range
+		uint64_t passKey{ uint64_t(pass & 0xFF) << 56 };
+		auto first = std::lower_bound(m_Keys.begin(), m_Keys.end(), passKey);
+		auto last = std::lower_bound(first, m_Keys.end(), passKey + (1ull << 56));
+
+		bool complete{ true };
+
+		VkPipeline boundPipeline{ VK_NULL_HANDLE };
+		const DrawCommand* pBound{ nullptr }; // Last draw whose buffers were bound
+
+		for (auto it = first; it != last; ++it) {
+			const DrawCommand& draw{ m_Draws[m_Order[it - m_Keys.begin()]] };
+
+			VkPipeline pipeline{ registry.Get(draw.pipelineKey, fallbackKey) };
+			if (pipeline == VK_NULL_HANDLE) {
+				complete = false;
+				continue;
+			}
+
+			const BindChanges changes{ GetBindChanges(boundPipeline, pBound, pipeline, draw) };
+
+			if (changes.pipeline) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
+			if (changes.vertexBuffer) {
+				vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &draw.vertexBufferOffset);
+			}
+			if (changes.instanceBuffer) {
+				vkCmdBindVertexBuffers(commandBuffer, 1, 1, &draw.instanceBuffer, &draw.instanceBufferOffset);
+			}
+			if (changes.indexBuffer) {
+				vkCmdBindIndexBuffer(commandBuffer, draw.indexBuffer, draw.indexBufferOffset, draw.indexType);
+			}
+
+			const uint32_t bindCount{ changes.GetCount() };
+			const uint32_t bindSlots{ draw.instanceBuffer != VK_NULL_HANDLE ? 4u : 3u };
+			m_Stats.binds += bindCount;
+			m_Stats.skippedBinds += bindSlots - bindCount;
+
+			pBound = &draw;
+
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+			++m_Stats.draws;
+		}
+
+		// What the same draws would have cost in submission order, to see what sorting bought. Same draws, same comparisons
+		VkPipeline previousPipeline{ VK_NULL_HANDLE };
+		const DrawCommand* pPrevious{ nullptr };
+		for (size_t i{}; i < m_Draws.size(); ++i) {
+			if (m_DrawPasses[i] != (pass & 0xFF)) continue;
+
+			const DrawCommand& draw{ m_Draws[i] };
+			VkPipeline pipeline{ registry.Get(draw.pipelineKey, fallbackKey) };
+			if (pipeline == VK_NULL_HANDLE) continue;
+
+			const BindChanges changes{ GetBindChanges(previousPipeline, pPrevious, pipeline, draw) };
+			m_Stats.unsortedBinds += changes.GetCount();
+
+			previousPipeline = pipeline;
+			pPrevious = &draw;
+		}
+
+		return complete;
+	}
+
+	DrawQueue::BindChanges DrawQueue::GetBindChanges(VkPipeline boundPipeline, const DrawCommand* pBound, VkPipeline pipeline, const DrawCommand& draw) {
+		BindChanges changes{};
+		changes.pipeline = pipeline != boundPipeline;
+		changes.vertexBuffer = !pBound || pBound->vertexBuffer != draw.vertexBuffer || pBound->vertexBufferOffset != draw.vertexBufferOffset;
+		changes.instanceBuffer = draw.instanceBuffer != VK_NULL_HANDLE
+			&& (!pBound || pBound->instanceBuffer != draw.instanceBuffer || pBound->instanceBufferOffset != draw.instanceBufferOffset);
+		changes.indexBuffer = !pBound || pBound->indexBuffer != draw.indexBuffer || pBound->indexBufferOffset != draw.indexBufferOffset
+			|| pBound->indexType != draw.indexType;
+		return changes;
+	}
+
+	void DrawQueue::PrintStats(std::ostream& os) const {
+		int32_t saved{ int32_t(m_Stats.unsortedBinds) - int32_t(m_Stats.binds) };
+
+		os << "Draws " << m_Stats.draws << ", binds " << m_Stats.binds << " (" << m_Stats.skippedBinds << " redundant skipped, "
+			<< saved << " saved by sorting)";
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef DRAWQUEUE_HPP
+#define DRAWQUEUE_HPP
+
+#include <array>
+#include <unordered_map>
+
+#include "pipelineregistry.hpp"
+#include "threadpool.hpp"
+
+namespace vulkat {
+	// Everything needed to record one indexed draw
+	struct DrawCommand {
+		uint64_t pipelineKey{ 0 }; // From the PipelineRegistry
+		VkBuffer vertexBuffer{ VK_NULL_HANDLE };
+		VkDeviceSize vertexBufferOffset{ 0 };
+		VkBuffer instanceBuffer{ VK_NULL_HANDLE }; // Binding 1, optional
+		VkDeviceSize instanceBufferOffset{ 0 };
+		VkBuffer indexBuffer{ VK_NULL_HANDLE };
+		VkDeviceSize indexBufferOffset{ 0 };
+		VkIndexType indexType{ VK_INDEX_TYPE_UINT16 };
+		uint32_t indexCount{ 0 };
+		uint32_t instanceCount{ 1 };
+		uint32_t firstIndex{ 0 };
+		int32_t vertexOffset{ 0 };
+		uint32_t firstInstance{ 0 };
+	};
+
+	// Draws of a frame, sorted by a 64 bit key so state changes are grouped:
+	// | pass (8) | pipeline (16) | material (16) | depth (24) |, depth ascending draws front to back.
+	// Binds that repeat the previous state are skipped while recording
+	class DrawQueue final {
+	public:
+		struct Stats {
+			uint32_t draws{ 0 };
+			uint32_t binds{ 0 }; // Pipeline, vertex, instance and index buffer binds actually recorded
+			uint32_t unsortedBinds{ 0 }; // Binds submission order would have needed
+			uint32_t skippedBinds{ 0 }; // Redundant binds not recorded
+		};
+
+		DrawQueue();
+
+		DrawQueue(const DrawQueue& other) = delete;
+		DrawQueue(DrawQueue&& other) = delete;
+		DrawQueue& operator=(const DrawQueue& other) = delete;
+		DrawQueue& operator=(DrawQueue&& other) = delete;
+
+		~DrawQueue() = default;
+
+		// Large queues are sorted on the pool, small ones on the calling thread
+		void Initialize(ThreadPool* pThreadPool);
+
+		void Clear();
+
+		// depth is normalized view depth [0, 1], material groups draws sharing buffers and descriptors
+		void Add(uint32_t pass, const DrawCommand& draw, uint16_t material, float depth);
+
+		void Sort();
+
+		// Records the sorted draws of one pass. Draws whose pipeline is still compiling use fallbackKey's pipeline if that one is
+		// ready, see PipelineRegistry::Get(). False if draws had neither and were skipped
+		bool Record(VkCommandBuffer commandBuffer, uint32_t pass, const PipelineRegistry& registry, uint64_t fallbackKey = 0);
+
+		const Stats& GetStats() const { return m_Stats; }
+		void PrintStats(std::ostream& os) const;
+
+		static uint64_t MakeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, float depth);
+
+	private:
+		static const size_t m_ParallelThreshold{ 16384 }; // Below this, waking workers costs more than sorting
+		static const size_t m_RadixSize{ 256 };
+
+		ThreadPool* m_pThreadPool;
+
+		std::vector<DrawCommand> m_Draws;
+		std::vector<uint8_t> m_DrawPasses; // Pass of each draw, in submission order
+		std::vector<uint64_t> m_Keys;
+		std::vector<uint32_t> m_Order; // Indices into m_Draws, sorted with m_Keys
+
+		// Sort scratch, kept to avoid allocating every frame
+		std::vector<uint64_t> m_ScratchKeys;
+		std::vector<uint32_t> m_ScratchOrder;
+		std::vector<std::array<uint32_t, m_RadixSize>> m_Histograms; // One per chunk
+
+		// Pipeline keys compacted to 16 bit ids, only ever reset by Clear()
+		std::unordered_map<uint64_t, uint32_t> m_PipelineIds;
+
+		Stats m_Stats; // Since the last Clear()
+
+		// What changes from the bound state to draw, the recorded and the submission order counts both go through here
+		struct BindChanges {
+			bool pipeline;
+			bool vertexBuffer;
+			bool instanceBuffer; // Only for draws with an instance buffer
+			bool indexBuffer;
+
+			uint32_t GetCount() const { return uint32_t(pipeline) + uint32_t(vertexBuffer) + uint32_t(instanceBuffer) + uint32_t(indexBuffer); }
+		};
+
+		uint32_t GetPipelineId(uint64_t pipelineKey);
+		static BindChanges GetBindChanges(VkPipeline boundPipeline, const DrawCommand* pBound, VkPipeline pipeline, const DrawCommand& draw);
+
+		template<typename Func>
+		void ForEachChunk(size_t chunkCount, Func&& func);
+	};
+}
+#endif // DRAWQUEUE_HPP
@@ -0,0 +1,339 @@
+#include "../pch.hpp"
+#include "framecapture.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+
+namespace vulkat {
+	FrameCapture::FrameCapture()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pTimeline{ nullptr }
+		, m_pMemoryTracker{ nullptr }
+		, m_Debug{ false }
+		, m_Format{ VK_FORMAT_UNDEFINED }
+		, m_Extent{ 0, 0 }
+		, m_FrameSize{ 0 }
+		, m_Coherent{ true }
+		, m_RingSize{ 0 }
+		, m_Next{ 0 }
+		, m_Recorded{ -1 }
+		, m_FrameCount{ 0 }
+		, m_Stop{ false }
+		, m_FramesWritten{ 0 }
+	{}
+
+	void FrameCapture::Initialize(VkDevice device, Timeline* pTimeline, MemoryTracker* pMemoryTracker,
+		const std::string& target, uint32_t ringSize, bool debug) {
+		m_Device = device;
+		m_pTimeline = pTimeline;
+		m_pMemoryTracker = pMemoryTracker;
+		m_Target = target;
+		m_RingSize = std::max(ringSize, 1u);
+		m_Debug = debug;
+
+		if (!IsEnabled()) return;
+
+		m_Stop = false;
+		m_Writer = std::thread{ [this]{ WriterLoop(); } };
+	}
+
+	void FrameCapture::Cleanup() {
+		if (!IsEnabled()) return;
+
+		Drain();
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Stop = true;
+		}
+		m_Condition.notify_all();
+		if (m_Writer.joinable()) m_Writer.join();
+
+		DestroySlots();
+
+		if (m_Debug) std::cerr << m_FramesWritten << " frames captured to " << m_Target << '\n';
+	}
+
+	void FrameCapture::Configure(VkFormat format, VkExtent2D extent) {
+		if (!IsEnabled()) return;
+
+		Drain();
+		DestroySlots();
+
+		m_Format = format;
+		m_Extent = extent;
+		m_FrameSize = VkDeviceSize(extent.width) * extent.height * 4; // Swapchain formats are 8 bit RGBA or BGRA
+
+		if (format != VK_FORMAT_B8G8R8A8_SRGB && format != VK_FORMAT_B8G8R8A8_UNORM
+			&& format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_R8G8B8A8_UNORM) {
+			std::cerr << "Frame capture only supports 8 bit RGBA and BGRA swapchains, format " << format << " is written as is\n";
+		}
+
+		CreateSlots();
+
+		// The pipe has no header, whoever reads it needs to know the layout
+		if (m_Target == "-") {
+			bool bgra{ format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM };
+			std::cerr << "Streaming " << (bgra ? "bgra" : "rgba") << " frames of " << extent.width << "x" << extent.height << " to stdout\n";
+		}
+	}
+
+	void FrameCapture::Record(VkCommandBuffer commandBuffer, VkImage image) {
+		if (!IsEnabled() || m_Slots.empty()) return;
+
+		TRACE_SCOPE("FrameCaptureRecord");
+
+		WaitForSlot(m_Next);
+		Slot& slot{ m_Slots[m_Next] };
+
+		VkImageMemoryBarrier toTransfer{};
+		toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		toTransfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		toTransfer.image = image;
+		toTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0; // Tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { m_Extent.width, m_Extent.height, 1 };
+
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+		// Back for presentation, and the copy made visible to the host once the timeline passes it
+		VkImageMemoryBarrier toPresent{ toTransfer };
+		toPresent.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		toPresent.dstAccessMask = 0;
+		toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkMemoryBarrier toHost{};
+		toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &toHost, 0, nullptr, 1, &toPresent);
+
+		slot.state = SlotState::Recorded;
+		m_Recorded = int(m_Next);
+	}
+
+	void FrameCapture::MarkSubmitted(uint64_t value) {
+		if (m_Recorded < 0) return;
+
+		Slot& slot{ m_Slots[m_Recorded] };
+		slot.state = SlotState::InFlight;
+		slot.value = value;
+		slot.frame = m_FrameCount++;
+
+		m_InFlight.push_back(uint32_t(m_Recorded));
+		m_Next = (uint32_t(m_Recorded) + 1) % uint32_t(m_Slots.size());
+		m_Recorded = -1;
+	}
+
+	void FrameCapture::Collect() {
+		if (m_InFlight.empty()) return;
+
+		bool handedOff{ false };
+		while (!m_InFlight.empty() && m_pTimeline->IsComplete(m_Slots[m_InFlight.front()].value)) {
+			uint32_t index{ m_InFlight.front() };
+			m_InFlight.pop_front();
+
+			Slot& slot{ m_Slots[index] };
+			if (!m_Coherent) {
+				VkMappedMemoryRange range{};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = slot.memory;
+				range.offset = 0;
+				range.size = VK_WHOLE_SIZE;
+				vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+			}
+
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			slot.state = SlotState::Writing;
+			m_WriteQueue.push_back(index);
+			handedOff = true;
+		}
+
+		if (handedOff) m_Condition.notify_all();
+	}
+
+	void FrameCapture::CreateSlots() {
+		m_Slots.resize(m_RingSize);
+
+		for (auto& slot : m_Slots) {
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.size = m_FrameSize;
+			bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if (vkCreateBuffer(m_Device, &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create readback buffer!");
+			}
+
+			VkMemoryRequirements requirements;
+			vkGetBufferMemoryRequirements(m_Device, slot.buffer, &requirements);
+
+			// Cached memory reads a lot faster from the CPU, coherent is the fallback every device has
+			uint32_t typeIndex{ m_pMemoryTracker->FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) };
+			if (typeIndex == UINT32_MAX) {
+				typeIndex = m_pMemoryTracker->FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			}
+
+			if (typeIndex == UINT32_MAX) {
+				throw std::runtime_error("Failed to find host visible memory for readback!");
+			}
+
+			m_Coherent = (m_pMemoryTracker->GetMemoryProperties().memoryTypes[typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = requirements.size;
+			allocInfo.memoryTypeIndex = typeIndex;
+
+			slot.memory = m_pMemoryTracker->Allocate(allocInfo, MemoryCategory::Readback);
+			vkBindBufferMemory(m_Device, slot.buffer, slot.memory, 0);
+
+			void* pData;
+			vkMapMemory(m_Device, slot.memory, 0, m_FrameSize, 0, &pData);
+			slot.pData = static_cast<const uint8_t*>(pData);
+			slot.state = SlotState::Free;
+		}
+
+		m_Next = 0;
+	}
+
+	void FrameCapture::DestroySlots() {
+		// Only called after Drain(), the GPU and the writer are done with every slot
+		for (auto& slot : m_Slots) {
+			vkUnmapMemory(m_Device, slot.memory);
+			vkDestroyBuffer(m_Device, slot.buffer, nullptr);
+			m_pMemoryTracker->Free(slot.memory);
+		}
+
+		m_Slots.clear();
+	}
+
+	void FrameCapture::WaitForSlot(uint32_t slot) {
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		if (m_Slots[slot].state == SlotState::Free) return;
+
+		// The slot is only busy if the writer fell a whole ring behind
+		TRACE_SCOPE("FrameCaptureBackpressure");
+
+		if (m_Slots[slot].state == SlotState::InFlight) {
+			lock.unlock();
+			m_pTimeline->Wait(m_Slots[slot].value);
+			Collect();
+			lock.lock();
+		}
+
+		m_Condition.wait(lock, [&]{ return m_Slots[slot].state == SlotState::Free; });
+	}
+
+	void FrameCapture::Drain() {
+		if (!m_InFlight.empty()) {
+			m_pTimeline->Wait(m_Slots[m_InFlight.back()].value);
+			Collect();
+		}
+
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		m_Condition.wait(lock, [this]{
+			return std::all_of(m_Slots.begin(), m_Slots.end(), [](const Slot& slot) { return slot.state == SlotState::Free; });
+		});
+	}
+
+	void FrameCapture::WriterLoop() {
+		Trace::SetThreadName("FrameCapture");
+
+		while (true) {
+			uint32_t index;
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_Condition.wait(lock, [this]{ return m_Stop || !m_WriteQueue.empty(); });
+
+				if (m_WriteQueue.empty()) return; // Stopped and nothing left
+
+				index = m_WriteQueue.front();
+				m_WriteQueue.pop_front();
+			}
+
+			// The slot isn't touched by the main thread while it's being written
+			Write(m_Slots[index]);
+
+			{
+				std::lock_guard<std::mutex> lock{ m_Mutex };
+				m_Slots[index].state = SlotState::Free;
+				++m_FramesWritten;
+			}
+			m_Condition.notify_all();
+		}
+	}
+
+	void FrameCapture::Write(const Slot& slot) {
+		TRACE_SCOPE("FrameCaptureWrite");
+
+		if (m_Target == "-") {
+			fwrite(slot.pData, 1, size_t(m_FrameSize), stdout);
+			fflush(stdout);
+			return;
+		}
+
+		std::string fileName{ GetFileName(slot.frame) };
+		std::ofstream file{ fileName, std::ios::binary };
+		if (!file) {
+			std::cerr << "Failed to open " << fileName << " for writing\n";
+			return;
+		}
+
+		const bool ppm{ m_Target.size() >= 4 && m_Target.compare(m_Target.size() - 4, 4, ".ppm") == 0 };
+		if (!ppm) {
+			file.write(reinterpret_cast<const char*>(slot.pData), std::streamsize(m_FrameSize));
+			return;
+		}
+
+		// PPM is RGB without alpha, swizzled row by row
+		const bool bgra{ m_Format == VK_FORMAT_B8G8R8A8_SRGB || m_Format == VK_FORMAT_B8G8R8A8_UNORM };
+		file << "P6\n" << m_Extent.width << " " << m_Extent.height << "\n255\n";
+
+		std::vector<char> row(size_t(m_Extent.width) * 3);
+		for (uint32_t y{}; y < m_Extent.height; ++y) {
+			const uint8_t* pPixel{ slot.pData + size_t(y) * m_Extent.width * 4 };
+			for (uint32_t x{}; x < m_Extent.width; ++x, pPixel += 4) {
+				row[x * 3 + 0] = char(pPixel[bgra ? 2 : 0]);
+				row[x * 3 + 1] = char(pPixel[1]);
+				row[x * 3 + 2] = char(pPixel[bgra ? 0 : 2]);
+			}
+			file.write(row.data(), std::streamsize(row.size()));
+		}
+	}
+
+	std::string FrameCapture::GetFileName(uint64_t frame) const {
+		// Only the first %d is replaced, the path itself is never used as a format string
+		size_t marker{ m_Target.find("%d") };
+		if (marker != std::string::npos) {
+			return m_Target.substr(0, marker) + std::to_string(frame) + m_Target.substr(marker + 2);
+		}
+
+		char number[32];
+		snprintf(number, sizeof(number), "_%05llu", static_cast<unsigned long long>(frame));
+
+		size_t dot{ m_Target.find_last_of('.') };
+		size_t slash{ m_Target.find_last_of('/') };
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return m_Target + number;
+
+		return m_Target.substr(0, dot) + number + m_Target.substr(dot);
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef FRAMECAPTURE_HPP
+#define FRAMECAPTURE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "timeline.hpp"
+#include "memorytracker.hpp"
+
+namespace vulkat {
+	// Copies the presented image into a ring of host visible buffers and writes it out once
+	// the timeline says the copy is done, a few frames later, so capturing never stalls the GPU.
+	// Files are written by a thread of its own, in frame order. Only when it can't keep up
+	// does recording wait for a buffer to come free.
+	// Targets: "-" streams raw frames to stdout (eg. into ffmpeg -f rawvideo), a path ending in
+	// .ppm writes a PPM per frame, anything else raw pixels. The first %d in the path is
+	// replaced by the frame number, without one "_<number>" goes before the extension
+	class FrameCapture final {
+	public:
+		FrameCapture();
+
+		FrameCapture(const FrameCapture& other) = delete;
+		FrameCapture(FrameCapture&& other) = delete;
+		FrameCapture& operator=(const FrameCapture& other) = delete;
+		FrameCapture& operator=(FrameCapture&& other) = delete;
+
+		~FrameCapture() = default;
+
+		void Initialize(VkDevice device, Timeline* pTimeline, MemoryTracker* pMemoryTracker,
+			const std::string& target, uint32_t ringSize, bool debug);
+		void Cleanup(); // Writes whatever is still pending
+
+		bool IsEnabled() const { return !m_Target.empty(); }
+
+		// (Re)creates the ring for the swapchain's format and size, waits for and writes pending frames first
+		void Configure(VkFormat format, VkExtent2D extent);
+
+		// Records the copy of image, which is in PRESENT_SRC layout and stays in it
+		void Record(VkCommandBuffer commandBuffer, VkImage image);
+		void MarkSubmitted(uint64_t value);
+
+		// Hands finished copies to the writer, doesn't block
+		void Collect();
+
+		uint64_t GetFramesWritten() const { return m_FramesWritten; }
+
+	private:
+		enum class SlotState {
+			Free,
+			Recorded, // Copy recorded, not submitted yet
+			InFlight, // Submitted, waiting for the timeline
+			Writing // Handed to the writer thread
+		};
+
+		struct Slot {
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			const uint8_t* pData{ nullptr }; // Persistently mapped
+			SlotState state{ SlotState::Free };
+			uint64_t value{ 0 }; // Timeline value of the submission with the copy
+			uint64_t frame{ 0 };
+		};
+
+		VkDevice m_Device;
+		Timeline* m_pTimeline;
+		MemoryTracker* m_pMemoryTracker;
+		std::string m_Target;
+		bool m_Debug;
+
+		VkFormat m_Format;
+		VkExtent2D m_Extent;
+		VkDeviceSize m_FrameSize;
+		bool m_Coherent; // Otherwise mapped memory is invalidated before reading
+
+		std::vector<Slot> m_Slots;
+		uint32_t m_RingSize;
+		uint32_t m_Next;
+		int m_Recorded; // Slot recorded into the command buffer being built, -1 if none
+		std::deque<uint32_t> m_InFlight; // Slots in submission order
+		uint64_t m_FrameCount;
+
+		// Writer thread
+		std::thread m_Writer;
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::deque<uint32_t> m_WriteQueue;
+		bool m_Stop;
+		uint64_t m_FramesWritten;
+
+		void CreateSlots();
+		void DestroySlots();
+		void WaitForSlot(uint32_t slot);
+		void Drain(); // Everything submitted is written, all slots are free
+
+		void WriterLoop();
+		void Write(const Slot& slot);
+		std::string GetFileName(uint64_t frame) const;
+	};
+}
+#endif // FRAMECAPTURE_HPP
@@ -0,0 +1,94 @@
+#include "../pch.hpp"
+#include "framecontext.hpp"
+
+namespace vulkat {
+	FrameContext::FrameContext()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_CommandPool{ VK_NULL_HANDLE }
+		, m_CommandBuffer{ VK_NULL_HANDLE }
+		, m_ImageAvailable{ VK_NULL_HANDLE }
+		, m_RenderFinished{ VK_NULL_HANDLE }
+		, m_pTimeline{ nullptr }
+		, m_pDeletionQueue{ nullptr }
+		, m_SubmittedValue{ 0 }
+		, m_UploadBuffer{ VK_NULL_HANDLE }
+		, m_UploadOffset{ 0 }
+		, m_UploadSize{ 0 }
+		, m_UploadHead{ 0 }
+		, m_pUploadData{ nullptr }
+		, m_Arena{ 64 * 1024 }
+	{}
+
+	void FrameContext::Initialize(VkDevice device, uint32_t queueFamily, Timeline* pTimeline, DeletionQueue* pDeletionQueue, VkBuffer uploadBuffer, VkDeviceSize uploadOffset, VkDeviceSize uploadSize, void* pUploadData) {
+		m_Device = device;
+		m_pTimeline = pTimeline;
+		m_pDeletionQueue = pDeletionQueue;
+		m_SubmittedValue = 0;
+
+		m_UploadBuffer = uploadBuffer;
+		m_UploadOffset = uploadOffset;
+		m_UploadSize = uploadSize;
+		m_pUploadData = static_cast<uint8_t*>(pUploadData) + uploadOffset;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // Re-recorded every frame
+
+		if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create frame command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = m_CommandPool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_Device, &allocateInfo, &m_CommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate command buffers!");
+		}
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_ImageAvailable) != VK_SUCCESS
+			|| vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderFinished) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create semaphores for a frame!");
+		}
+	}
+
+	void FrameContext::Cleanup() {
+		vkDestroySemaphore(m_Device, m_RenderFinished, nullptr);
+		vkDestroySemaphore(m_Device, m_ImageAvailable, nullptr);
+
+		// Frees the command buffer with it
+		vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+	}
+
+	void FrameContext::Wait() {
+		m_pTimeline->Wait(m_SubmittedValue);
+	}
+
+	void FrameContext::Reset() {
+		vkResetCommandPool(m_Device, m_CommandPool, 0);
+		m_UploadHead = 0;
+		m_Arena.Reset();
+	}
+
+	UploadAllocation FrameContext::Allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		VkDeviceSize offset{ (m_UploadHead + alignment - 1) / alignment * alignment };
+		if (offset + size > m_UploadSize) {
+			throw std::runtime_error("Frame upload slice exhausted!");
+		}
+
+		m_UploadHead = offset + size;
+
+		return UploadAllocation{ m_UploadBuffer, m_UploadOffset + offset, m_pUploadData + offset };
+	}
+
+	void FrameContext::Defer(std::function<void()> deleter) {
+		// Recording happens before the submit, so the frame's submission is the next one
+		m_pDeletionQueue->Push(m_pTimeline->GetSubmitted() + 1, std::move(deleter));
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef FRAMECONTEXT_HPP
+#define FRAMECONTEXT_HPP
+
+#include "deletionqueue.hpp"
+#include "allocators.hpp"
+
+namespace vulkat {
+	// Slice of the upload ring handed out for this frame
+	struct UploadAllocation {
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VkDeviceSize offset{ 0 };
+		void* pData{ nullptr }; // Persistently mapped, host coherent
+	};
+
+	// Everything one frame in flight owns: its command pool and buffer, sync objects,
+	// a slice of the upload ring and a CPU arena for the frame's transient data. Deletions go to the queue's shared DeletionQueue.
+	// Nothing in here is touched again until the queue's timeline passed its previous submission
+	class FrameContext final {
+	public:
+		FrameContext();
+
+		FrameContext(const FrameContext& other) = delete;
+		FrameContext(FrameContext&& other) = delete;
+		FrameContext& operator=(const FrameContext& other) = delete;
+		FrameContext& operator=(FrameContext&& other) = delete;
+
+		~FrameContext() = default;
+
+		void Initialize(VkDevice device, uint32_t queueFamily, Timeline* pTimeline, DeletionQueue* pDeletionQueue, VkBuffer uploadBuffer, VkDeviceSize uploadOffset, VkDeviceSize uploadSize, void* pUploadData);
+		void Cleanup(); // Device must be idle
+
+		// Blocks until the previous submission of this frame is done
+		void Wait();
+
+		// Timeline value the frame's command buffer signals, recorded after the submit
+		void MarkSubmitted(uint64_t value) { m_SubmittedValue = value; }
+
+		// After Wait(): resets the command pool, the upload slice and the arena
+		void Reset();
+
+		// Bump allocation from this frame's slice, valid until the frame comes around again
+		UploadAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+		// Runs once the GPU is done with this frame's submission
+		void Defer(std::function<void()> deleter);
+
+		// Transient CPU data of the frame, eg. copy regions, valid until the frame comes around again
+		LinearArena& GetArena() { return m_Arena; }
+
+		VkCommandBuffer GetCommandBuffer() const { return m_CommandBuffer; }
+		VkSemaphore GetImageAvailable() const { return m_ImageAvailable; }
+		VkSemaphore GetRenderFinished() const { return m_RenderFinished; }
+
+	private:
+		VkDevice m_Device;
+
+		VkCommandPool m_CommandPool; // Reset as a whole, cheaper than resetting single buffers
+		VkCommandBuffer m_CommandBuffer;
+
+		VkSemaphore m_ImageAvailable;
+		VkSemaphore m_RenderFinished; // Binary, presentation can't wait on a timeline
+
+		Timeline* m_pTimeline; // Of the queue the frame is submitted to
+		DeletionQueue* m_pDeletionQueue;
+		uint64_t m_SubmittedValue; // 0 until the first submit, which never needs waiting for
+
+		VkBuffer m_UploadBuffer;
+		VkDeviceSize m_UploadOffset; // Start of this frame's slice in the ring buffer
+		VkDeviceSize m_UploadSize;
+		VkDeviceSize m_UploadHead;
+		uint8_t* m_pUploadData;
+
+		LinearArena m_Arena;
+	};
+}
+#endif // FRAMECONTEXT_HPP
@@ -0,0 +1,53 @@
+#include "../pch.hpp"
+#include "framepacer.hpp"
+#include "trace.hpp"
+
+#include <thread>
+
+namespace vulkat {
+	const FramePacer::Clock::duration FramePacer::m_SpinThreshold{ std::chrono::microseconds{ 1500 } };
+
+	FramePacer::FramePacer()
+		: m_TargetFps{ 0.0 }
+		, m_Interval{ Clock::duration::zero() }
+		, m_NextFrame{ Clock::now() }
+		, m_InputSampled{ Clock::now() }
+	{}
+
+	void FramePacer::SetTargetFps(double fps) {
+		m_TargetFps = fps > 0.0 ? fps : 0.0;
+		m_Interval = m_TargetFps > 0.0
+			? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>{ 1.0 / m_TargetFps })
+			: Clock::duration::zero();
+		m_NextFrame = Clock::now();
+	}
+
+	void FramePacer::WaitForNextFrame() {
+		if (m_Interval == Clock::duration::zero()) return;
+
+		TRACE_SCOPE("FrameLimiter");
+
+		Clock::time_point now{ Clock::now() };
+
+		if (m_NextFrame > now) {
+			if (m_NextFrame - now > m_SpinThreshold) {
+				std::this_thread::sleep_until(m_NextFrame - m_SpinThreshold);
+			}
+			while (Clock::now() < m_NextFrame) {
+				std::this_thread::yield();
+			}
+		}
+
+		// Fell behind (eg. a stall or a resize): start counting from now instead of rushing to catch up
+		m_NextFrame += m_Interval;
+		if (m_NextFrame < now) m_NextFrame = now + m_Interval;
+	}
+
+	void FramePacer::MarkInputSampled() {
+		m_InputSampled = Clock::now();
+	}
+
+	void FramePacer::MarkPresented() {
+		m_Latency.Add(std::chrono::duration<double, std::milli>(Clock::now() - m_InputSampled).count());
+	}
+}
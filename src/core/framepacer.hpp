@@ -0,0 +1,47 @@
+#ifndef FRAMEPACER_HPP
+#define FRAMEPACER_HPP
+
+#include <chrono>
+
+#include "gpuprofiler.hpp"
+
+namespace vulkat {
+	// Frame limiter for the low latency mode and input to present latency measurement.
+	// The limiter sleeps before input is sampled, so the frame that follows works with the freshest input
+	class FramePacer final {
+	public:
+		FramePacer();
+
+		FramePacer(const FramePacer& other) = delete;
+		FramePacer(FramePacer&& other) = delete;
+		FramePacer& operator=(const FramePacer& other) = delete;
+		FramePacer& operator=(FramePacer&& other) = delete;
+
+		~FramePacer() = default;
+
+		// 0 disables the limiter
+		void SetTargetFps(double fps);
+		double GetTargetFps() const { return m_TargetFps; }
+
+		// Blocks until the next frame slot, returns right away without a target
+		void WaitForNextFrame();
+
+		void MarkInputSampled();
+		void MarkPresented(); // After vkQueuePresentKHR returned, scanout isn't included
+
+		double GetLatencyMs() const { return m_Latency.Get(); }
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		static const Clock::duration m_SpinThreshold; // Sleep overshoots, the last stretch is spent yielding
+
+		double m_TargetFps;
+		Clock::duration m_Interval;
+		Clock::time_point m_NextFrame;
+		Clock::time_point m_InputSampled;
+
+		RollingAverage m_Latency; // In ms
+	};
+}
+#endif // FRAMEPACER_HPP
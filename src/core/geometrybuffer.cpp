@@ -0,0 +1,109 @@
+#include "../pch.hpp"
+#include "geometrybuffer.hpp"
+
+namespace vulkat {
+	GeometryBuffer::GeometryBuffer()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pMemoryTracker{ nullptr }
+		, m_pDeletionQueue{ nullptr }
+		, m_VertexStride{ 0 }
+		, m_Debug{ false }
+	{}
+
+	void GeometryBuffer::Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+		uint32_t vertexStride, bool debug) {
+		m_Device = device;
+		m_pMemoryTracker = pMemoryTracker;
+		m_pDeletionQueue = pDeletionQueue;
+		m_VertexStride = vertexStride;
+		m_Debug = debug;
+	}
+
+	void GeometryBuffer::Cleanup() {
+		for (auto& page : m_Pages) {
+			vkDestroyBuffer(m_Device, page.vertexBuffer, nullptr);
+			m_pMemoryTracker->Free(page.vertexMemory);
+			vkDestroyBuffer(m_Device, page.indexBuffer, nullptr);
+			m_pMemoryTracker->Free(page.indexMemory);
+		}
+
+		m_Pages.clear();
+	}
+
+	MeshAllocation GeometryBuffer::Allocate(uint32_t vertexCount, uint32_t indexCount) {
+		if (vertexCount == 0 || indexCount == 0) {
+			throw std::runtime_error("Failed to allocate empty mesh!");
+		}
+
+		auto tryPage{ [&](uint32_t page, MeshAllocation& mesh) {
+			RangeAllocator& vertices{ m_Pages[page].vertices };
+			RangeAllocator& indices{ m_Pages[page].indices };
+
+			uint64_t vertexOffset{ vertices.Allocate(vertexCount) };
+			if (vertexOffset == RangeAllocator::m_InvalidOffset) return false;
+
+			uint64_t firstIndex{ indices.Allocate(indexCount) };
+			if (firstIndex == RangeAllocator::m_InvalidOffset) {
+				vertices.Free(vertexOffset, vertexCount);
+				return false;
+			}
+
+			mesh = { page, int32_t(vertexOffset), vertexCount, uint32_t(firstIndex), indexCount };
+			return true;
+		} };
+
+		MeshAllocation mesh{};
+		for (uint32_t page{}; page < m_Pages.size(); ++page) {
+			if (tryPage(page, mesh)) return mesh;
+		}
+
+		AddPage(std::max(vertexCount, m_PageVertexCount), std::max(indexCount, m_PageIndexCount));
+		tryPage(uint32_t(m_Pages.size() - 1), mesh);
+
+		return mesh;
+	}
+
+	void GeometryBuffer::Free(const MeshAllocation& mesh) {
+		if (mesh.page == UINT32_MAX) return;
+
+		m_pDeletionQueue->Push([this, mesh]{
+			Page& page{ m_Pages[mesh.page] };
+			page.vertices.Free(uint64_t(mesh.vertexOffset), mesh.vertexCount);
+			page.indices.Free(mesh.firstIndex, mesh.indexCount);
+		});
+	}
+
+	void GeometryBuffer::Bind(VkCommandBuffer commandBuffer, uint32_t page) const {
+		VkDeviceSize offset{ 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_Pages[page].vertexBuffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, m_Pages[page].indexBuffer, 0, m_IndexType);
+	}
+
+	void GeometryBuffer::PrintStats(std::ostream& os) const {
+		uint64_t usedVertices{ 0 }, vertexCapacity{ 0 }, usedIndices{ 0 }, indexCapacity{ 0 };
+		for (const auto& page : m_Pages) {
+			usedVertices += page.vertices.GetUsed();
+			vertexCapacity += page.vertices.GetSize();
+			usedIndices += page.indices.GetUsed();
+			indexCapacity += page.indices.GetSize();
+		}
+
+		os << "Geometry " << m_Pages.size() << (m_Pages.size() == 1 ? " page, " : " pages, ")
+			<< usedVertices << "/" << vertexCapacity << " vertices, " << usedIndices << "/" << indexCapacity << " indices";
+	}
+
+	void GeometryBuffer::AddPage(uint32_t vertexCount, uint32_t indexCount) {
+		Page page{ VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, RangeAllocator{ vertexCount }, RangeAllocator{ indexCount } };
+		page.vertexBuffer = CreateBuffer(VkDeviceSize(vertexCount) * m_VertexStride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryCategory::Vertex, page.vertexMemory);
+		page.indexBuffer = CreateBuffer(VkDeviceSize(indexCount) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MemoryCategory::Index, page.indexMemory);
+
+		m_Pages.push_back(std::move(page));
+
+		if (m_Debug) std::cout << "Geometry page " << m_Pages.size() - 1 << ": " << vertexCount << " vertices, " << indexCount << " indices\n";
+	}
+
+	VkBuffer GeometryBuffer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryCategory category, VkDeviceMemory& memory) {
+		// Filled by staging copies
+		return m_pMemoryTracker->CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, category, memory);
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef GEOMETRYBUFFER_HPP
+#define GEOMETRYBUFFER_HPP
+
+#include "allocators.hpp"
+#include "memorytracker.hpp"
+#include "deletionqueue.hpp"
+
+namespace vulkat {
+	// Where a mesh landed in the GeometryBuffer, in vertices and indices rather than bytes,
+	// so they go straight into vkCmdDrawIndexed or a VkDrawIndexedIndirectCommand
+	struct MeshAllocation {
+		uint32_t page{ UINT32_MAX };
+		int32_t vertexOffset{ 0 };
+		uint32_t vertexCount{ 0 };
+		uint32_t firstIndex{ 0 };
+		uint32_t indexCount{ 0 };
+	};
+
+	// Static meshes packed into a few large vertex and index buffers. A page is one vertex and one index buffer,
+	// sub-allocated by offset, and a new page is only added when a mesh fits in none of them. Meshes on the same
+	// page are drawn with one bind and their own vertexOffset and firstIndex, which indirect draws rely on
+	class GeometryBuffer final {
+	public:
+		static constexpr VkIndexType m_IndexType{ VK_INDEX_TYPE_UINT32 };
+
+		GeometryBuffer();
+
+		GeometryBuffer(const GeometryBuffer& other) = delete;
+		GeometryBuffer(GeometryBuffer&& other) = delete;
+		GeometryBuffer& operator=(const GeometryBuffer& other) = delete;
+		GeometryBuffer& operator=(GeometryBuffer&& other) = delete;
+
+		~GeometryBuffer() = default;
+
+		// vertexStride is the size of one vertex of binding 0
+		void Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+			uint32_t vertexStride, bool debug);
+		void Cleanup();
+
+		// Space only, the caller copies the data in at GetVertexByteOffset() and GetIndexByteOffset()
+		MeshAllocation Allocate(uint32_t vertexCount, uint32_t indexCount);
+
+		// The space is reused once the frames still drawing the mesh retired
+		void Free(const MeshAllocation& mesh);
+
+		VkBuffer GetVertexBuffer(uint32_t page) const { return m_Pages.at(page).vertexBuffer; }
+		VkBuffer GetIndexBuffer(uint32_t page) const { return m_Pages.at(page).indexBuffer; }
+		VkDeviceSize GetVertexByteOffset(const MeshAllocation& mesh) const { return VkDeviceSize(mesh.vertexOffset) * m_VertexStride; }
+		VkDeviceSize GetIndexByteOffset(const MeshAllocation& mesh) const { return VkDeviceSize(mesh.firstIndex) * sizeof(uint32_t); }
+
+		// Vertex binding 0 and the index buffer of a page, at offset 0
+		void Bind(VkCommandBuffer commandBuffer, uint32_t page) const;
+
+		void PrintStats(std::ostream& os) const;
+
+	private:
+		struct Page {
+			VkBuffer vertexBuffer;
+			VkDeviceMemory vertexMemory;
+			VkBuffer indexBuffer;
+			VkDeviceMemory indexMemory;
+			RangeAllocator vertices; // In vertices
+			RangeAllocator indices;
+		};
+
+		static constexpr uint32_t m_PageVertexCount{ 1u << 20 }; // Larger meshes get a page of their own size
+		static constexpr uint32_t m_PageIndexCount{ 1u << 22 };
+
+		VkDevice m_Device;
+		MemoryTracker* m_pMemoryTracker;
+		DeletionQueue* m_pDeletionQueue;
+		uint32_t m_VertexStride;
+		bool m_Debug;
+
+		std::vector<Page> m_Pages; // Only added, meshes keep their page until freed
+
+		void AddPage(uint32_t vertexCount, uint32_t indexCount);
+		VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryCategory category, VkDeviceMemory& memory);
+	};
+}
+#endif // GEOMETRYBUFFER_HPP
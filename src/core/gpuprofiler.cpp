@@ -0,0 +1,218 @@
+#include "../pch.hpp"
+#include "gpuprofiler.hpp"
+
+#include <iomanip>
+
+namespace vulkat {
+	void RollingAverage::Add(double sample) {
+		if (m_Count == m_Size) {
+			m_Sum -= m_Samples[m_Next];
+		}
+		else {
+			++m_Count;
+		}
+
+		m_Samples[m_Next] = sample;
+		m_Sum += sample;
+		m_Next = (m_Next + 1) % m_Size;
+	}
+
+	double RollingAverage::Get() const {
+		return m_Count ? m_Sum / double(m_Count) : 0.0;
+	}
+
+	GpuProfiler::GpuProfiler()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_QueryPool{ VK_NULL_HANDLE }
+		, m_Supported{ false }
+		, m_StatisticsPool{ VK_NULL_HANDLE }
+		, m_Statistics{ false }
+		, m_TimestampPeriod{ 1.0 }
+		, m_TimestampMask{ ~0ull }
+		, m_TotalFrameMs{ 0.0 }
+		, m_FrameCount{ 0 }
+	{}
+
+	void GpuProfiler::Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties, uint32_t queueFamily) {
+		m_Device = device;
+		m_TimestampPeriod = double(properties.limits.timestampPeriod);
+
+		uint32_t queueFamilyCount{ 0 };
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		// A queue without valid bits can't write timestamps at all
+		uint32_t validBits{ queueFamilies[queueFamily].timestampValidBits };
+		m_Supported = validBits > 0 && m_TimestampPeriod > 0.0;
+		m_TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	}
+
+	void GpuProfiler::Cleanup() {
+		if (m_QueryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(m_Device, m_QueryPool, nullptr);
+			m_QueryPool = VK_NULL_HANDLE;
+		}
+
+		if (m_StatisticsPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(m_Device, m_StatisticsPool, nullptr);
+			m_StatisticsPool = VK_NULL_HANDLE;
+		}
+
+		m_Slots.clear();
+	}
+
+	void GpuProfiler::EnableStatistics() {
+		m_Statistics = true;
+	}
+
+	void GpuProfiler::SetSlotCount(uint32_t slotCount) {
+		if (!m_Supported && !m_Statistics) return;
+
+		// Same count: the pool is reused, only forget results of the old command buffers
+		if (slotCount == m_Slots.size()) {
+			for (auto& slot : m_Slots) {
+				slot.submitted = false;
+			}
+			return;
+		}
+
+		Cleanup();
+
+		if (m_Supported) {
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = slotCount * m_QueriesPerSlot;
+
+			if (vkCreateQueryPool(m_Device, &queryPoolInfo, nullptr, &m_QueryPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create timestamp query pool!");
+			}
+		}
+
+		if (m_Statistics) {
+			VkQueryPoolCreateInfo queryPoolInfo{};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+			queryPoolInfo.queryCount = slotCount;
+			queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+			if (vkCreateQueryPool(m_Device, &queryPoolInfo, nullptr, &m_StatisticsPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline statistics query pool!");
+			}
+		}
+
+		m_Slots.resize(slotCount);
+	}
+
+	void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t slot) {
+		// Outside of any render pass, so the query covers every pass of the frame
+		if (m_Statistics) {
+			vkCmdResetQueryPool(commandBuffer, m_StatisticsPool, slot, 1);
+			vkCmdBeginQuery(commandBuffer, m_StatisticsPool, slot, 0);
+		}
+
+		if (!m_Supported) return;
+
+		m_Slots[slot].passes.clear();
+
+		vkCmdResetQueryPool(commandBuffer, m_QueryPool, slot * m_QueriesPerSlot, m_QueriesPerSlot);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, slot * m_QueriesPerSlot);
+	}
+
+	uint32_t GpuProfiler::BeginPass(VkCommandBuffer commandBuffer, uint32_t slot, const char* name) {
+		if (!m_Supported) return 0;
+
+		// Passes are identified by name so their averages survive re-recording
+		auto it = std::find_if(m_Passes.begin(), m_Passes.end(), [name](const Pass& pass){ return pass.name == name; });
+		uint32_t pass{ uint32_t(it - m_Passes.begin()) };
+		if (it == m_Passes.end()) {
+			m_Passes.push_back(Pass{ name, {} });
+		}
+
+		std::vector<uint32_t>& passes{ m_Slots[slot].passes };
+		if (passes.size() >= m_MaxPasses) {
+			throw std::runtime_error("Too many profiled passes in one frame!");
+		}
+
+		uint32_t query{ slot * m_QueriesPerSlot + 2 + 2 * uint32_t(passes.size()) };
+		passes.push_back(pass);
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, query);
+
+		return pass;
+	}
+
+	void GpuProfiler::EndPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass) {
+		if (!m_Supported) return;
+
+		// The end query sits right after the last begin of this pass
+		const std::vector<uint32_t>& passes{ m_Slots[slot].passes };
+		uint32_t order{ uint32_t(std::find(passes.rbegin(), passes.rend(), pass).base() - passes.begin()) - 1 };
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, slot * m_QueriesPerSlot + 3 + 2 * order);
+	}
+
+	void GpuProfiler::EndFrame(VkCommandBuffer commandBuffer, uint32_t slot) {
+		if (m_Statistics) vkCmdEndQuery(commandBuffer, m_StatisticsPool, slot);
+
+		if (!m_Supported) return;
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, slot * m_QueriesPerSlot + 1);
+	}
+
+	void GpuProfiler::Collect(uint32_t slot) {
+		if ((!m_Supported && !m_Statistics) || !m_Slots[slot].submitted) return;
+
+		if (m_Statistics) {
+			uint64_t invocations{ 0 };
+			if (vkGetQueryPoolResults(m_Device, m_StatisticsPool, slot, 1, sizeof(invocations), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				m_FragmentInvocations.Add(double(invocations));
+			}
+		}
+
+		if (!m_Supported) return;
+
+		const std::vector<uint32_t>& passes{ m_Slots[slot].passes };
+		uint32_t queryCount{ 2 + 2 * uint32_t(passes.size()) };
+
+		std::array<uint64_t, m_QueriesPerSlot> timestamps{};
+
+		// No WAIT bit: the submission that wrote these already retired, VK_NOT_READY just skips a sample
+		VkResult result{ vkGetQueryPoolResults(m_Device, m_QueryPool, slot * m_QueriesPerSlot, queryCount,
+			sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) };
+		if (result != VK_SUCCESS) return;
+
+		auto toMs = [this](uint64_t begin, uint64_t end) {
+			return double((end & m_TimestampMask) - (begin & m_TimestampMask)) * m_TimestampPeriod * 1e-6;
+		};
+
+		const double frameMs{ toMs(timestamps[0], timestamps[1]) };
+		m_FrameTime.Add(frameMs);
+		m_TotalFrameMs += frameMs;
+		++m_FrameCount;
+		for (size_t i{}; i < passes.size(); ++i) {
+			m_Passes[passes[i]].time.Add(toMs(timestamps[2 + 2 * i], timestamps[3 + 2 * i]));
+		}
+	}
+
+	void GpuProfiler::MarkSubmitted(uint32_t slot) {
+		if (!m_Supported && !m_Statistics) return;
+
+		m_Slots[slot].submitted = true;
+	}
+
+	void GpuProfiler::Print(std::ostream& os) const {
+		if (!m_Supported) {
+			os << "GPU timestamps not supported";
+			return;
+		}
+
+		os << std::fixed << std::setprecision(3) << "GPU " << m_FrameTime.Get() << " ms";
+		for (const auto& pass : m_Passes) {
+			os << " (" << pass.name << " " << pass.time.Get() << " ms)";
+		}
+		os.unsetf(std::ios::floatfield);
+	}
+}
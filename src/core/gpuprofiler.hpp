@@ -0,0 +1,96 @@
+#ifndef GPUPROFILER_HPP
+#define GPUPROFILER_HPP
+
+#include <array>
+
+namespace vulkat {
+	// Average over the last N samples
+	class RollingAverage final {
+	public:
+		void Add(double sample);
+		double Get() const;
+
+	private:
+		static const size_t m_Size{ 64 };
+
+		std::array<double, m_Size> m_Samples{};
+		size_t m_Count{ 0 };
+		size_t m_Next{ 0 };
+		double m_Sum{ 0.0 };
+	};
+
+	// GPU time per frame and per pass from timestamp queries, optionally fragment shader invocations per frame (overdraw).
+	// Every slot (one per recorded command buffer) owns a range of the query pool. A slot's results are read
+	// right before it is submitted again, when its previous submission is known to be done, so reading never stalls
+	class GpuProfiler final {
+	public:
+		GpuProfiler();
+
+		GpuProfiler(const GpuProfiler& other) = delete;
+		GpuProfiler(GpuProfiler&& other) = delete;
+		GpuProfiler& operator=(const GpuProfiler& other) = delete;
+		GpuProfiler& operator=(GpuProfiler&& other) = delete;
+
+		~GpuProfiler() = default;
+
+		void Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties& properties, uint32_t queueFamily);
+		void Cleanup();
+
+		// Needs the pipelineStatisticsQuery feature, call before SetSlotCount
+		void EnableStatistics();
+
+		// (Re)creates the query pools when the number of command buffers changes
+		void SetSlotCount(uint32_t slotCount);
+
+		// Recording, in this order: BeginFrame, any number of BeginPass/EndPass pairs, EndFrame
+		void BeginFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+		uint32_t BeginPass(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+		void EndPass(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t pass);
+		void EndFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		// Call before resubmitting the slot, once its last submission has completed
+		void Collect(uint32_t slot);
+		void MarkSubmitted(uint32_t slot);
+
+		bool IsSupported() const { return m_Supported; }
+		double GetFrameMs() const { return m_FrameTime.Get(); }
+		// Every frame collected so far, the difference of two readings averages exactly the frames in between
+		double GetTotalFrameMs() const { return m_TotalFrameMs; }
+		uint64_t GetFrameCount() const { return m_FrameCount; }
+		bool HasStatistics() const { return m_Statistics; }
+		double GetFragmentInvocations() const { return m_FragmentInvocations.Get(); }
+		void Print(std::ostream& os) const;
+
+	private:
+		static const uint32_t m_MaxPasses{ 16 };
+		static const uint32_t m_QueriesPerSlot{ 2 + 2 * m_MaxPasses }; // Frame begin/end + begin/end per pass
+
+		struct Pass {
+			std::string name; // Copied, pass names may be rebuilt with the render graph
+			RollingAverage time;
+		};
+
+		struct Slot {
+			std::vector<uint32_t> passes; // Pass indices in recorded order
+			bool submitted{ false };
+		};
+
+		VkDevice m_Device;
+		VkQueryPool m_QueryPool;
+		bool m_Supported;
+
+		VkQueryPool m_StatisticsPool; // One query per slot, spans the whole frame
+		bool m_Statistics;
+		RollingAverage m_FragmentInvocations;
+
+		double m_TimestampPeriod; // ns per tick
+		uint64_t m_TimestampMask; // timestampValidBits of the queue
+
+		std::vector<Slot> m_Slots;
+		std::vector<Pass> m_Passes;
+		RollingAverage m_FrameTime;
+		double m_TotalFrameMs;
+		uint64_t m_FrameCount;
+	};
+}
+#endif // GPUPROFILER_HPP
@@ -0,0 +1,30 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vulkat {
+	// 64 bit FNV-1a, good enough to key caches on (not cryptographic)
+	constexpr uint64_t g_FnvOffsetBasis{ 0xcbf29ce484222325ull };
+	constexpr uint64_t g_FnvPrime{ 0x100000001b3ull };
+
+	inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = g_FnvOffsetBasis) {
+		const auto* bytes = static_cast<const uint8_t*>(data);
+
+		uint64_t hash{ seed };
+		for (size_t i{}; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= g_FnvPrime;
+		}
+
+		return hash;
+	}
+
+	// Hash a trivially copyable value and fold it into an existing hash
+	template<typename T>
+	inline uint64_t HashCombine(uint64_t seed, const T& value) {
+		return HashBytes(&value, sizeof(T), seed);
+	}
+}
+#endif // HASH_HPP
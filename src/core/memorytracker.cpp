@@ -0,0 +1,251 @@
+#include "../pch.hpp"
+#include "memorytracker.hpp"
+
+#include <sstream>
+
+namespace vulkat {
+	namespace {
+		double ToMiB(VkDeviceSize bytes) {
+			return double(bytes) / (1024.0 * 1024.0);
+		}
+	}
+
+	MemoryTracker::MemoryTracker()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_PhysicalDevice{ VK_NULL_HANDLE }
+		, m_MemoryProperties{}
+		, m_pGetMemoryProperties2{ nullptr }
+		, m_AllocationPool{ 64 }
+		, m_Allocations{ 0, std::hash<VkDeviceMemory>{}, std::equal_to<VkDeviceMemory>{}, PoolAllocator<std::pair<const VkDeviceMemory, Allocation>>{ m_AllocationPool } }
+		, m_Heaps{}
+		, m_Categories{}
+		, m_HeapBudget{}
+		, m_HeapUsage{}
+	{}
+
+	void MemoryTracker::Initialize(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool budgetExtension) {
+		m_Device = device;
+		m_PhysicalDevice = physicalDevice;
+
+		vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_MemoryProperties);
+
+		if (budgetExtension) {
+			m_pGetMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2");
+		}
+
+		UpdateBudget();
+	}
+
+	VkDeviceMemory MemoryTracker::Allocate(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category) {
+		const uint32_t heap{ m_MemoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex };
+
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkResult result{ vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory) };
+
+		if (result != VK_SUCCESS) {
+			HeapBudget budget{ GetHeapBudget(heap) };
+
+			std::ostringstream message;
+			message << std::fixed << std::setprecision(1) << "Failed to allocate " << ToMiB(allocInfo.allocationSize) << " MiB of "
+				<< GetCategoryName(category) << " memory on heap " << heap << " (" << ToMiB(budget.usage) << "/" << ToMiB(budget.budget) << " MiB used)!";
+			throw std::runtime_error(message.str());
+		}
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		m_Allocations.emplace(memory, Allocation{ heap, category, allocInfo.allocationSize });
+		Add(m_Heaps[heap], allocInfo.allocationSize);
+		Add(m_Categories[size_t(category)], allocInfo.allocationSize);
+
+		return memory;
+	}
+
+	void MemoryTracker::Free(VkDeviceMemory memory) {
+		if (memory == VK_NULL_HANDLE) return;
+
+		{
+			// The entry goes before the handle is freed, otherwise a concurrent Allocate can get the same handle back
+			// and insert it while the stale entry is still in the map
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+
+			auto it{ m_Allocations.find(memory) };
+			if (it != m_Allocations.end()) { // Not found when not allocated through the tracker
+				Remove(m_Heaps[it->second.heap], it->second.size);
+				Remove(m_Categories[size_t(it->second.category)], it->second.size);
+				m_Allocations.erase(it);
+			}
+		}
+
+		vkFreeMemory(m_Device, memory, nullptr);
+	}
+
+	uint32_t MemoryTracker::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+		for (uint32_t i{}; i < m_MemoryProperties.memoryTypeCount; ++i) {
+			if ((typeFilter & (1u << i)) && (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+
+		return UINT32_MAX;
+	}
+
+	VkDeviceMemory MemoryTracker::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category) {
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = requirements.size;
+		allocInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, properties);
+
+		if (allocInfo.memoryTypeIndex == UINT32_MAX) {
+			throw std::runtime_error(std::string{ "Failed to find suitable memory type for " } + GetCategoryName(category) + " memory!");
+		}
+
+		return Allocate(allocInfo, category);
+	}
+
+	VkBuffer MemoryTracker::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkDeviceMemory& memory) {
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(m_Device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+			throw std::runtime_error(std::string{ "Failed to create " } + GetCategoryName(category) + " buffer!");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+
+		memory = Allocate(requirements, properties, category);
+		vkBindBufferMemory(m_Device, buffer, memory, 0);
+
+		return buffer;
+	}
+
+	void MemoryTracker::UpdateBudget() {
+		if (!m_pGetMemoryProperties2) return;
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &budget;
+
+		m_pGetMemoryProperties2(m_PhysicalDevice, &properties);
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		for (uint32_t i{}; i < m_MemoryProperties.memoryHeapCount; ++i) {
+			m_HeapBudget[i] = budget.heapBudget[i];
+			m_HeapUsage[i] = budget.heapUsage[i];
+		}
+	}
+
+	MemoryCounters MemoryTracker::GetHeapCounters(uint32_t heap) const {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		return m_Heaps[heap];
+	}
+
+	MemoryCounters MemoryTracker::GetCategoryCounters(MemoryCategory category) const {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		return m_Categories[size_t(category)];
+	}
+
+	HeapBudget MemoryTracker::GetHeapBudget(uint32_t heap) const {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		HeapBudget budget{};
+		budget.size = m_MemoryProperties.memoryHeaps[heap].size;
+		budget.deviceLocal = (m_MemoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+		if (m_pGetMemoryProperties2) {
+			budget.budget = m_HeapBudget[heap];
+			// The driver's number lags behind until the next UpdateBudget(), the tracked one doesn't
+			budget.usage = std::max(m_HeapUsage[heap], m_Heaps[heap].usage);
+		}
+		else {
+			budget.budget = budget.size;
+			budget.usage = m_Heaps[heap].usage;
+		}
+
+		return budget;
+	}
+
+	double MemoryTracker::GetPressure() const {
+		double pressure{ 0.0 };
+
+		for (uint32_t i{}; i < GetHeapCount(); ++i) {
+			HeapBudget budget{ GetHeapBudget(i) };
+			if (!budget.deviceLocal || budget.budget == 0) continue;
+
+			pressure = std::max(pressure, double(budget.usage) / double(budget.budget));
+		}
+
+		return pressure;
+	}
+
+	const char* MemoryTracker::GetCategoryName(MemoryCategory category) {
+		switch (category) {
+			case MemoryCategory::Vertex: return "vertex";
+			case MemoryCategory::Index: return "index";
+			case MemoryCategory::Staging: return "staging";
+			case MemoryCategory::Upload: return "upload";
+			case MemoryCategory::Texture: return "texture";
+			case MemoryCategory::RenderTarget: return "render target";
+			case MemoryCategory::Readback: return "readback";
+			case MemoryCategory::Storage: return "storage";
+			default: return "other";
+		}
+	}
+
+	void MemoryTracker::Print(std::ostream& os) const {
+		os << std::fixed << std::setprecision(2);
+		os << "Memory heaps" << (HasBudgetExtension() ? " (" VK_EXT_MEMORY_BUDGET_EXTENSION_NAME ")" : " (no budget extension, heap size as budget)") << ":\n";
+
+		for (uint32_t i{}; i < GetHeapCount(); ++i) {
+			HeapBudget budget{ GetHeapBudget(i) };
+			MemoryCounters counters{ GetHeapCounters(i) };
+
+			os << "  heap " << i << (budget.deviceLocal ? " device local" : " host") << ": "
+				<< ToMiB(counters.usage) << " MiB tracked (peak " << ToMiB(counters.peak) << "), "
+				<< ToMiB(budget.usage) << "/" << ToMiB(budget.budget) << " MiB of budget, "
+				<< counters.allocations << " allocations (" << counters.totalAllocations << " total)\n";
+		}
+
+		os << "Memory categories:\n";
+		for (size_t i{}; i < size_t(MemoryCategory::Count); ++i) {
+			MemoryCounters counters{ GetCategoryCounters(MemoryCategory(i)) };
+			if (counters.totalAllocations == 0) continue;
+
+			os << "  " << std::setw(13) << std::left << GetCategoryName(MemoryCategory(i)) << std::right << ": "
+				<< ToMiB(counters.usage) << " MiB (peak " << ToMiB(counters.peak) << "), "
+				<< counters.allocations << " allocations (" << counters.totalAllocations << " total)\n";
+		}
+	}
+
+	void MemoryTracker::PrintSummary(std::ostream& os) const {
+		VkDeviceSize usage{ 0 }, budget{ 0 };
+		for (uint32_t i{}; i < GetHeapCount(); ++i) {
+			HeapBudget heap{ GetHeapBudget(i) };
+			if (!heap.deviceLocal) continue;
+
+			usage += heap.usage;
+			budget += heap.budget;
+		}
+
+		os << std::fixed << std::setprecision(1) << "VRAM " << ToMiB(usage) << "/" << ToMiB(budget) << " MiB";
+	}
+
+	void MemoryTracker::Add(MemoryCounters& counters, VkDeviceSize size) {
+		counters.usage += size;
+		counters.peak = std::max(counters.peak, counters.usage);
+		++counters.allocations;
+		++counters.totalAllocations;
+	}
+
+	void MemoryTracker::Remove(MemoryCounters& counters, VkDeviceSize size) {
+		counters.usage -= size;
+		--counters.allocations;
+	}
+}
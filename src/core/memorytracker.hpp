@@ -0,0 +1,114 @@
+#ifndef MEMORYTRACKER_HPP
+#define MEMORYTRACKER_HPP
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
+#include "allocators.hpp"
+
+namespace vulkat {
+	// What an allocation is for, streaming and caching decide what to evict by this
+	enum class MemoryCategory : uint8_t {
+		Vertex,
+		Index,
+		Staging, // Host visible, short lived
+		Upload, // Per frame upload ring
+		Texture,
+		RenderTarget, // Render graph attachments
+		Readback, // Host visible copies of rendered frames
+		Storage, // GPU only read/write buffers, eg. particles
+		Other,
+		Count
+	};
+
+	struct MemoryCounters {
+		VkDeviceSize usage{ 0 }; // Bytes currently allocated
+		VkDeviceSize peak{ 0 };
+		uint32_t allocations{ 0 }; // Currently alive
+		uint64_t totalAllocations{ 0 }; // Ever made
+	};
+
+	struct HeapBudget {
+		VkDeviceSize size{ 0 };
+		VkDeviceSize budget{ 0 }; // What the process can use before the driver starts evicting or failing
+		VkDeviceSize usage{ 0 }; // Whole process, including allocations not made through the tracker
+		bool deviceLocal{ false };
+	};
+
+	// Every vkAllocateMemory/vkFreeMemory goes through here, counted per heap and per category.
+	// Budgets come from VK_EXT_memory_budget when the device has it, otherwise the heap size and
+	// the tracked usage stand in. Thread safe
+	class MemoryTracker final {
+	public:
+		MemoryTracker();
+
+		MemoryTracker(const MemoryTracker& other) = delete;
+		MemoryTracker(MemoryTracker&& other) = delete;
+		MemoryTracker& operator=(const MemoryTracker& other) = delete;
+		MemoryTracker& operator=(MemoryTracker&& other) = delete;
+
+		~MemoryTracker() = default;
+
+		// budgetExtension: VK_EXT_memory_budget is enabled on the device (needs a 1.1 instance)
+		void Initialize(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, bool budgetExtension);
+
+		// Throws when the allocation fails, the message says how full the heap was
+		VkDeviceMemory Allocate(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category);
+		void Free(VkDeviceMemory memory);
+
+		// First type allowed by typeFilter that has all the properties, UINT32_MAX if there is none
+		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+		// Picks the type for the requirements, then allocates. Throws when no type has the properties
+		VkDeviceMemory Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category);
+
+		// Exclusive buffer with a dedicated allocation bound at offset 0, freed with vkDestroyBuffer() and Free()
+		VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkDeviceMemory& memory);
+
+		// Queries the driver's budget, cheap but not free: once per stats interval, not per allocation
+		void UpdateBudget();
+
+		const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return m_MemoryProperties; }
+		bool HasBudgetExtension() const { return m_pGetMemoryProperties2 != nullptr; }
+		uint32_t GetHeapCount() const { return m_MemoryProperties.memoryHeapCount; }
+		MemoryCounters GetHeapCounters(uint32_t heap) const;
+		MemoryCounters GetCategoryCounters(MemoryCategory category) const;
+		HeapBudget GetHeapBudget(uint32_t heap) const;
+
+		// Usage over budget of the fullest device local heap, 1 means the next allocation might fail
+		double GetPressure() const;
+
+		static const char* GetCategoryName(MemoryCategory category);
+
+		void Print(std::ostream& os) const; // Table per heap and per category
+		void PrintSummary(std::ostream& os) const; // One line, for the frame stats
+
+	private:
+		struct Allocation {
+			uint32_t heap;
+			MemoryCategory category;
+			VkDeviceSize size;
+		};
+
+		VkDevice m_Device;
+		VkPhysicalDevice m_PhysicalDevice;
+		VkPhysicalDeviceMemoryProperties m_MemoryProperties;
+		PFN_vkGetPhysicalDeviceMemoryProperties2 m_pGetMemoryProperties2; // Only with the budget extension
+
+		using AllocationMap = std::unordered_map<VkDeviceMemory, Allocation, std::hash<VkDeviceMemory>, std::equal_to<VkDeviceMemory>,
+			PoolAllocator<std::pair<const VkDeviceMemory, Allocation>>>;
+
+		mutable std::mutex m_Mutex;
+		FixedPool m_AllocationPool; // Map nodes, streaming allocates and frees all the time
+		AllocationMap m_Allocations;
+		std::array<MemoryCounters, VK_MAX_MEMORY_HEAPS> m_Heaps;
+		std::array<MemoryCounters, size_t(MemoryCategory::Count)> m_Categories;
+		std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_HeapBudget;
+		std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_HeapUsage; // Driver reported, 0 without the extension
+
+		static void Add(MemoryCounters& counters, VkDeviceSize size);
+		static void Remove(MemoryCounters& counters, VkDeviceSize size);
+	};
+}
+#endif // MEMORYTRACKER_HPP
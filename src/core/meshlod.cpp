@@ -0,0 +1,262 @@
+#include "../pch.hpp"
+#include "meshlod.hpp"
+
+#include <cmath>
+#include <unordered_map>
+
+namespace vulkat {
+	namespace {
+		// Sum of squared distances to a set of planes, as the upper triangle of a symmetric 4x4 matrix
+		struct Quadric {
+			double a2{}, ab{}, ac{}, ad{}, b2{}, bc{}, bd{}, c2{}, cd{}, d2{};
+
+			void AddPlane(const glm::vec3& normal, float distance, double weight) {
+				double a{ normal.x }, b{ normal.y }, c{ normal.z }, d{ distance };
+				a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+				b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+				c2 += weight * c * c; cd += weight * c * d;
+				d2 += weight * d * d;
+			}
+
+			void Add(const Quadric& other) {
+				a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+				b2 += other.b2; bc += other.bc; bd += other.bd;
+				c2 += other.c2; cd += other.cd;
+				d2 += other.d2;
+			}
+
+			double Evaluate(const glm::vec3& p) const {
+				double x{ p.x }, y{ p.y }, z{ p.z };
+				double error{ a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+					+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+					+ c2 * z * z + 2 * cd * z
+					+ d2 };
+				return std::max(error, 0.0); // Rounding can push it just below
+			}
+		};
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+
+		uint64_t EdgeKey(uint32_t a, uint32_t b) {
+			return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+		}
+
+		// Rejects collapses that fold a triangle over onto its neighbours
+		bool FlipsTriangle(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& canonical, const std::vector<uint32_t>& indices,
+			const std::vector<uint32_t>& triangleOffsets, const std::vector<uint32_t>& triangles, uint32_t from, uint32_t to) {
+			for (uint32_t i{ triangleOffsets[from] }; i < triangleOffsets[from + 1]; ++i) {
+				const uint32_t* pTriangle{ &indices[size_t(triangles[i]) * 3] };
+				if (canonical[pTriangle[0]] == canonical[to] || canonical[pTriangle[1]] == canonical[to] || canonical[pTriangle[2]] == canonical[to]) continue; // Collapses away
+
+				glm::vec3 corners[3];
+				glm::vec3 moved[3];
+				for (int c{}; c < 3; ++c) {
+					corners[c] = positions[pTriangle[c]];
+					moved[c] = pTriangle[c] == from ? positions[to] : corners[c];
+				}
+
+				glm::vec3 before{ glm::cross(corners[1] - corners[0], corners[2] - corners[0]) };
+				glm::vec3 after{ glm::cross(moved[1] - moved[0], moved[2] - moved[0]) };
+				if (glm::dot(before, after) <= 0.f) return true;
+			}
+
+			return false;
+		}
+	}
+
+	MeshLods MeshLod::Generate(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t maxLevels, float reduction) {
+		MeshLods mesh{};
+		mesh.indices = indices;
+		mesh.levels.push_back(LodLevel{ 0, uint32_t(indices.size()), 0.f });
+
+		const size_t vertexCount{ positions.size() };
+		if (indices.size() < 6 || maxLevels < 2) return mesh;
+
+		// Vertices sharing a position are one vertex for the quadrics and borders. The seam between them has to stay put,
+		// moving only one side would tear the surface open. Triangles keep their own copy, with its attributes
+		std::vector<uint32_t> canonical(vertexCount);
+		std::vector<bool> locked(vertexCount, false);
+		{
+			std::unordered_map<uint64_t, uint32_t> firstAt;
+			firstAt.reserve(vertexCount);
+			for (uint32_t v{}; v < vertexCount; ++v) {
+				uint32_t bits[3];
+				memcpy(bits, &positions[v], sizeof(bits));
+				uint64_t hash{ (uint64_t(bits[0]) * 73856093u) ^ (uint64_t(bits[1]) * 19349663u) ^ (uint64_t(bits[2]) << 32) };
+
+				auto it{ firstAt.find(hash) };
+				if (it != firstAt.end() && positions[it->second] == positions[v]) {
+					canonical[v] = it->second;
+					locked[v] = locked[it->second] = true;
+				}
+				else {
+					canonical[v] = v;
+					firstAt.emplace(hash, v);
+				}
+			}
+		}
+
+		std::vector<uint32_t> current{ indices };
+
+		// Plane of every triangle. Unweighted, so the error of a collapse is about its squared distance to the surface
+		std::vector<Quadric> quadrics(vertexCount); // Indexed by canonical vertex
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(current.size());
+		for (size_t t{}; t < current.size(); t += 3) {
+			const glm::vec3& p0{ positions[current[t]] };
+			glm::vec3 normal{ glm::cross(positions[current[t + 1]] - p0, positions[current[t + 2]] - p0) };
+			float area{ glm::length(normal) };
+			if (area <= 0.f) continue;
+
+			normal = normal / area;
+			for (int c{}; c < 3; ++c) {
+				quadrics[canonical[current[t + c]]].AddPlane(normal, -glm::dot(normal, p0), 1.0);
+				++edgeUse[EdgeKey(canonical[current[t + c]], canonical[current[t + (c + 1) % 3]])];
+			}
+		}
+
+		// Border edges get a heavily weighted plane perpendicular to their triangle, so the outline doesn't shrink
+		const double borderWeight{ 10.0 };
+		for (size_t t{}; t < current.size(); t += 3) {
+			const glm::vec3& p0{ positions[current[t]] };
+			glm::vec3 normal{ glm::cross(positions[current[t + 1]] - p0, positions[current[t + 2]] - p0) };
+			if (glm::length(normal) <= 0.f) continue;
+
+			for (int c{}; c < 3; ++c) {
+				uint32_t a{ canonical[current[t + c]] }, b{ canonical[current[t + (c + 1) % 3]] };
+				if (edgeUse[EdgeKey(a, b)] != 1) continue;
+
+				glm::vec3 edge{ positions[b] - positions[a] };
+				if (glm::length(edge) <= 0.f) continue;
+
+				glm::vec3 borderNormal{ glm::normalize(glm::cross(edge, normal)) };
+				float distance{ -glm::dot(borderNormal, positions[a]) };
+				quadrics[a].AddPlane(borderNormal, distance, borderWeight);
+				quadrics[b].AddPlane(borderNormal, distance, borderWeight);
+			}
+		}
+
+		// Scratch, reused by every pass
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<bool> touched(vertexCount);
+		std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+		std::vector<uint32_t> fill(vertexCount);
+		std::vector<uint32_t> triangles;
+		std::vector<uint64_t> edges;
+		std::vector<Collapse> collapses;
+
+		double maxError{ 0.0 };
+		size_t targetIndices{ current.size() };
+
+		while (mesh.levels.size() < maxLevels) {
+			targetIndices = std::max<size_t>(size_t(double(targetIndices) * reduction) / 3 * 3, 3);
+			const size_t levelStart{ current.size() };
+
+			// Passes of independent collapses, cheapest first, until the level is small enough or nothing collapses
+			while (current.size() > targetIndices) {
+				// Triangles around every vertex
+				std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0u);
+				for (uint32_t index : current) ++triangleOffsets[index + 1];
+				for (size_t v{}; v < vertexCount; ++v) triangleOffsets[v + 1] += triangleOffsets[v];
+				std::copy(triangleOffsets.begin(), triangleOffsets.end() - 1, fill.begin());
+				triangles.resize(current.size());
+				for (size_t i{}; i < current.size(); ++i) triangles[fill[current[i]]++] = uint32_t(i / 3);
+
+				edges.clear();
+				for (size_t t{}; t < current.size(); t += 3) {
+					for (int c{}; c < 3; ++c) edges.push_back(EdgeKey(current[t + c], current[t + (c + 1) % 3]));
+				}
+				std::sort(edges.begin(), edges.end());
+				edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+				// Each edge collapses in its cheaper direction, locked vertices only ever receive
+				collapses.clear();
+				for (uint64_t edge : edges) {
+					uint32_t a{ uint32_t(edge >> 32) }, b{ uint32_t(edge) };
+					if (canonical[a] == canonical[b]) continue;
+
+					Quadric merged{ quadrics[canonical[a]] };
+					merged.Add(quadrics[canonical[b]]);
+
+					double costA{ locked[a] ? HUGE_VAL : merged.Evaluate(positions[b]) }; // a moves to b
+					double costB{ locked[b] ? HUGE_VAL : merged.Evaluate(positions[a]) };
+					if (costA == HUGE_VAL && costB == HUGE_VAL) continue;
+
+					collapses.push_back(costA <= costB ? Collapse{ a, b, costA } : Collapse{ b, a, costB });
+				}
+				if (collapses.empty()) break;
+
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+				for (uint32_t v{}; v < vertexCount; ++v) remap[v] = v;
+				std::fill(touched.begin(), touched.end(), false);
+
+				// A vertex takes part in one collapse per pass, so the quadrics and flip tests stay valid
+				size_t removable{ (current.size() - targetIndices) / 3 };
+				size_t removed{ 0 };
+				for (const Collapse& collapse : collapses) {
+					if (removed >= removable) break;
+
+					uint32_t from{ canonical[collapse.from] }, to{ canonical[collapse.to] };
+					if (touched[from] || touched[to]) continue;
+					if (FlipsTriangle(positions, canonical, current, triangleOffsets, triangles, collapse.from, collapse.to)) continue;
+
+					remap[collapse.from] = collapse.to; // Unlocked, so the only vertex at its position
+					quadrics[to].Add(quadrics[from]);
+					touched[from] = touched[to] = true;
+					maxError = std::max(maxError, collapse.cost);
+
+					// Interior edges take two triangles with them, border edges one
+					removed += 2;
+				}
+				if (removed == 0) break;
+
+				// Drop the triangles that lost an edge
+				size_t kept{ 0 };
+				for (size_t t{}; t < current.size(); t += 3) {
+					uint32_t a{ remap[current[t]] }, b{ remap[current[t + 1]] }, c{ remap[current[t + 2]] };
+					if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) continue;
+
+					current[kept++] = a;
+					current[kept++] = b;
+					current[kept++] = c;
+				}
+				current.resize(kept);
+			}
+
+			// Not worth a level of its own, simplifying further won't get anywhere either
+			if (current.empty() || double(current.size()) > double(levelStart) * 0.9) break;
+
+			LodLevel level{};
+			level.firstIndex = uint32_t(mesh.indices.size());
+			level.indexCount = uint32_t(current.size());
+			level.error = float(std::sqrt(maxError)); // Errors only grow, so every level is at least as far off as the one before
+			mesh.indices.insert(mesh.indices.end(), current.begin(), current.end());
+			mesh.levels.push_back(level);
+		}
+
+		return mesh;
+	}
+
+	uint32_t MeshLod::Select(const MeshLods& mesh, float pixelsPerUnit, uint32_t current, float thresholdPixels, float hysteresis) {
+		if (mesh.levels.empty()) return 0;
+
+		uint32_t lod{ std::min(current, uint32_t(mesh.levels.size() - 1)) };
+
+		// Refine while the current level's error is clearly visible
+		while (lod > 0 && mesh.levels[lod].error * pixelsPerUnit > thresholdPixels * (1.f + hysteresis)) --lod;
+
+		// Coarsen while the next level's error is clearly not
+		while (lod + 1 < mesh.levels.size() && mesh.levels[lod + 1].error * pixelsPerUnit < thresholdPixels * (1.f - hysteresis)) ++lod;
+
+		return lod;
+	}
+
+	float MeshLod::GetPixelsPerUnit(float distance, float viewportHeight, float projectionScale) {
+		return viewportHeight * 0.5f * projectionScale / std::max(distance, 1e-4f);
+	}
+}
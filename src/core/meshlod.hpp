@@ -0,0 +1,36 @@
+#ifndef MESHLOD_HPP
+#define MESHLOD_HPP
+
+#include <glm/glm.hpp>
+
+namespace vulkat {
+	// One level of detail, a range of the mesh's shared index buffer
+	struct LodLevel {
+		uint32_t firstIndex{ 0 };
+		uint32_t indexCount{ 0 };
+		float error{ 0.f }; // Furthest the simplified surface may be from the original, in object units
+	};
+
+	// Every level indexes the same vertices, their index lists are concatenated, finest first.
+	// Drawing a level is only a different firstIndex and indexCount, no rebinding
+	struct MeshLods {
+		std::vector<uint32_t> indices;
+		std::vector<LodLevel> levels;
+	};
+
+	namespace MeshLod {
+		// Quadric error metric simplification (Garland & Heckbert). Each level keeps about reduction times the triangles
+		// of the one before, levels that barely simplify are dropped so a mesh may get fewer than maxLevels.
+		// Edges collapse onto one of their vertices, so no vertices are added and the vertex buffer is shared.
+		// Borders are held in place by extra quadrics, vertices on attribute seams (same position, other vertex) never move
+		MeshLods Generate(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, uint32_t maxLevels = 5, float reduction = 0.5f);
+
+		// Coarsest level whose error covers less than thresholdPixels on screen. A level only changes once its error
+		// is past the threshold by the hysteresis fraction, so objects around a boundary distance don't flicker between levels
+		uint32_t Select(const MeshLods& mesh, float pixelsPerUnit, uint32_t current, float thresholdPixels = 1.f, float hysteresis = 0.25f);
+
+		// Screen pixels one object unit covers at distance, projectionScale is proj[1][1] (cot(fovy / 2))
+		float GetPixelsPerUnit(float distance, float viewportHeight, float projectionScale);
+	}
+}
+#endif // MESHLOD_HPP
@@ -0,0 +1,648 @@
+#include "../pch.hpp"
+#include "occlusionculler.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	static_assert(sizeof(OcclusionCuller::Stats) == 5 * sizeof(uint32_t), "Stats must match Counters in cull.comp");
+
+	OcclusionCuller::OcclusionCuller()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pMemoryTracker{ nullptr }
+		, m_pDeletionQueue{ nullptr }
+		, m_MaxDrawCount{ 1 }
+		, m_Debug{ false }
+		, m_DirtyBegin{ 0 }
+		, m_DirtyEnd{ 0 }
+		, m_UploadedCount{ 0 }
+		, m_DispatchCount{ 0 }
+		, m_Capacity{ 0 }
+		, m_ObjectBuffer{ VK_NULL_HANDLE }
+		, m_ObjectMemory{ VK_NULL_HANDLE }
+		, m_VisibilityBuffer{ VK_NULL_HANDLE }
+		, m_VisibilityMemory{ VK_NULL_HANDLE }
+		, m_DrawBuffer{ VK_NULL_HANDLE }
+		, m_DrawMemory{ VK_NULL_HANDLE }
+		, m_CounterBuffer{ VK_NULL_HANDLE }
+		, m_CounterMemory{ VK_NULL_HANDLE }
+		, m_ReadbackBuffer{ VK_NULL_HANDLE }
+		, m_ReadbackMemory{ VK_NULL_HANDLE }
+		, m_pReadbackData{ nullptr }
+		, m_DepthView{ VK_NULL_HANDLE }
+		, m_DepthExtent{}
+		, m_PyramidImage{ VK_NULL_HANDLE }
+		, m_PyramidMemory{ VK_NULL_HANDLE }
+		, m_PyramidView{ VK_NULL_HANDLE }
+		, m_PyramidExtent{}
+		, m_LevelCount{ 0 }
+		, m_Sampler{ VK_NULL_HANDLE }
+		, m_PyramidValid{ false }
+		, m_NeedsTransition{ false }
+		, m_PyramidSetLayout{ VK_NULL_HANDLE }
+		, m_CullSetLayout{ VK_NULL_HANDLE }
+		, m_PyramidLayout{ VK_NULL_HANDLE }
+		, m_CullLayout{ VK_NULL_HANDLE }
+		, m_PyramidPipeline{ VK_NULL_HANDLE }
+		, m_CullPipelines{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+		, m_DescriptorPool{ VK_NULL_HANDLE }
+		, m_CullSet{ VK_NULL_HANDLE }
+		, m_Stats{}
+	{}
+
+	void OcclusionCuller::Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+		VkShaderModule pyramidShader, VkShaderModule cullShader, uint32_t slotCount, uint32_t maxDrawCount, bool debug) {
+		m_Device = device;
+		m_pMemoryTracker = pMemoryTracker;
+		m_pDeletionQueue = pDeletionQueue;
+		m_MaxDrawCount = std::max(maxDrawCount, 1u);
+		m_Debug = debug;
+
+		CreateBuffers(m_MinCapacity);
+
+		m_CounterBuffer = m_pMemoryTracker->CreateBuffer(sizeof(Stats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_CounterMemory);
+		m_ReadbackBuffer = m_pMemoryTracker->CreateBuffer(sizeof(Stats) * slotCount, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Readback, m_ReadbackMemory);
+		vkMapMemory(m_Device, m_ReadbackMemory, 0, VK_WHOLE_SIZE, 0, &m_pReadbackData);
+		m_SlotStates.assign(slotCount, SlotState::Free);
+
+		// texelFetch only, the sampler is there because depth can't be a storage image
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z sampler!");
+		}
+
+		CreatePipelines(pyramidShader, cullShader);
+
+		if (m_Debug) std::cout << "Occlusion culling, " << (m_MaxDrawCount > 1 ? "multi draw indirect" : "one indirect draw per object") << '\n';
+	}
+
+	void OcclusionCuller::Cleanup() {
+		vkDestroyPipeline(m_Device, m_PyramidPipeline, nullptr);
+		for (auto pipeline : m_CullPipelines) vkDestroyPipeline(m_Device, pipeline, nullptr);
+		vkDestroyPipelineLayout(m_Device, m_PyramidLayout, nullptr);
+		vkDestroyPipelineLayout(m_Device, m_CullLayout, nullptr);
+		vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(m_Device, m_PyramidSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(m_Device, m_CullSetLayout, nullptr);
+		vkDestroySampler(m_Device, m_Sampler, nullptr);
+
+		DestroyPyramid(false);
+		DestroyBuffers(false);
+
+		vkUnmapMemory(m_Device, m_ReadbackMemory);
+		vkDestroyBuffer(m_Device, m_ReadbackBuffer, nullptr);
+		m_pMemoryTracker->Free(m_ReadbackMemory);
+		vkDestroyBuffer(m_Device, m_CounterBuffer, nullptr);
+		m_pMemoryTracker->Free(m_CounterMemory);
+
+		m_DescriptorPool = VK_NULL_HANDLE;
+		m_Objects.clear();
+	}
+
+	void OcclusionCuller::Configure(VkImageView depthView, VkExtent2D extent) {
+		m_DepthView = depthView;
+		m_DepthExtent = extent;
+
+		DestroyPyramid(true);
+		CreatePyramid();
+		CreateDescriptors();
+	}
+
+	void OcclusionCuller::SetObjectCount(uint32_t count) {
+		m_Objects.resize(count, Object{});
+
+		m_UploadedCount = std::min(m_UploadedCount, count);
+		m_DirtyEnd = std::min(m_DirtyEnd, count);
+		if (m_DirtyBegin >= m_DirtyEnd) m_DirtyBegin = m_DirtyEnd = 0;
+	}
+
+	void OcclusionCuller::SetObject(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const VkDrawIndexedIndirectCommand& draw) {
+		Object object{};
+		object.boundsMin = glm::vec4{ boundsMin, 0.f };
+		object.boundsMax = glm::vec4{ boundsMax, 0.f };
+		object.draw = draw;
+
+		// Static objects stay out of the upload
+		Object& current{ m_Objects.at(index) };
+		if (memcmp(&current, &object, sizeof(Object)) == 0) return;
+		current = object;
+
+		if (m_DirtyBegin == m_DirtyEnd) {
+			m_DirtyBegin = index;
+			m_DirtyEnd = index + 1;
+		}
+		else {
+			m_DirtyBegin = std::min(m_DirtyBegin, index);
+			m_DirtyEnd = std::max(m_DirtyEnd, index + 1);
+		}
+	}
+
+	void OcclusionCuller::CullEarly(VkCommandBuffer commandBuffer, FrameContext& frame) {
+		TRACE_SCOPE("CullEarly");
+
+		// Last frame's cull passes, copies and indirect draws read what is written below
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		if (m_Objects.size() > m_Capacity) Grow(commandBuffer);
+		Upload(commandBuffer, frame);
+
+		vkCmdFillBuffer(commandBuffer, m_CounterBuffer, 0, sizeof(Stats), 0);
+
+		// Uploads, the cleared counters and last frame's pyramid
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		m_DispatchCount = m_UploadedCount;
+		Dispatch(commandBuffer, Early);
+
+		// The depth pre-pass draws the early list, the late test reads the visibility
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void OcclusionCuller::BuildPyramid(VkCommandBuffer commandBuffer) {
+		TRACE_SCOPE("BuildHiZ");
+
+		if (m_NeedsTransition) {
+			VkImageMemoryBarrier imageBarrier{};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = 0;
+			imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = m_PyramidImage;
+			imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_LevelCount, 0, 1 };
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+			m_NeedsTransition = false;
+		}
+		else {
+			// The early test read the levels about to be overwritten
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PyramidPipeline);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkExtent2D source{ m_DepthExtent };
+		for (uint32_t level{}; level < m_LevelCount; ++level) {
+			VkExtent2D destination{ std::max(m_PyramidExtent.width >> level, 1u), std::max(m_PyramidExtent.height >> level, 1u) };
+
+			PyramidConstants constants{};
+			constants.sourceSize = glm::ivec2{ int(source.width), int(source.height) };
+			constants.destinationSize = glm::ivec2{ int(destination.width), int(destination.height) };
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PyramidLayout, 0, 1, &m_PyramidSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, m_PyramidLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidConstants), &constants);
+			vkCmdDispatch(commandBuffer, (destination.width + m_PyramidGroupSize - 1) / m_PyramidGroupSize, (destination.height + m_PyramidGroupSize - 1) / m_PyramidGroupSize, 1);
+
+			// Read by the next level, and the last one by the late test
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			source = destination;
+		}
+
+		m_PyramidValid = true; // For next frame's early test
+	}
+
+	void OcclusionCuller::CullLate(VkCommandBuffer commandBuffer, uint32_t slot) {
+		TRACE_SCOPE("CullLate");
+
+		Dispatch(commandBuffer, Late);
+
+		// The late depth pass draws the late list, the counters are final
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy region{ 0, VkDeviceSize(slot) * sizeof(Stats), sizeof(Stats) };
+		vkCmdCopyBuffer(commandBuffer, m_CounterBuffer, m_ReadbackBuffer, 1, &region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		m_SlotStates[slot] = SlotState::Recorded;
+	}
+
+	void OcclusionCuller::RecordDraws(VkCommandBuffer commandBuffer, bool late) const {
+		VkDeviceSize offset{ late ? VkDeviceSize(m_Capacity) * m_DrawStride : 0 };
+
+		// Culled objects are draws without instances, cheaper than compacting the list and needs no draw count extension
+		for (uint32_t first{}; first < m_DispatchCount; first += m_MaxDrawCount) {
+			uint32_t count{ std::min(m_DispatchCount - first, m_MaxDrawCount) };
+			vkCmdDrawIndexedIndirect(commandBuffer, m_DrawBuffer, offset + first * m_DrawStride, count, uint32_t(m_DrawStride));
+		}
+	}
+
+	void OcclusionCuller::Collect(uint32_t slot) {
+		if (slot >= m_SlotStates.size()) return;
+
+		if (m_SlotStates[slot] == SlotState::Submitted) {
+			memcpy(&m_Stats, static_cast<uint8_t*>(m_pReadbackData) + slot * sizeof(Stats), sizeof(Stats));
+		}
+
+		m_SlotStates[slot] = SlotState::Free;
+	}
+
+	void OcclusionCuller::MarkSubmitted(uint32_t slot) {
+		if (m_SlotStates[slot] == SlotState::Recorded) m_SlotStates[slot] = SlotState::Submitted;
+	}
+
+	void OcclusionCuller::PrintStats(std::ostream& os) const {
+		os << "Culling " << m_Stats.tested << " tested, " << m_Stats.frustumCulled + m_Stats.occluded << " culled ("
+			<< m_Stats.frustumCulled << " frustum, " << m_Stats.occluded << " occluded), "
+			<< m_Stats.drawnEarly << " early + " << m_Stats.drawnLate << " late drawn";
+	}
+
+	// Resources
+	void OcclusionCuller::CreateBuffers(uint32_t capacity) {
+		m_Capacity = capacity;
+
+		m_ObjectBuffer = m_pMemoryTracker->CreateBuffer(VkDeviceSize(capacity) * sizeof(Object), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_ObjectMemory);
+		m_VisibilityBuffer = m_pMemoryTracker->CreateBuffer(VkDeviceSize(capacity) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_VisibilityMemory);
+		m_DrawBuffer = m_pMemoryTracker->CreateBuffer(VkDeviceSize(capacity) * 2 * m_DrawStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_DrawMemory);
+	}
+
+	void OcclusionCuller::DestroyBuffers(bool deferred) {
+		auto destroy{ [device = m_Device, pMemoryTracker = m_pMemoryTracker,
+			buffers = std::array<VkBuffer, 3>{ m_ObjectBuffer, m_VisibilityBuffer, m_DrawBuffer },
+			memory = std::array<VkDeviceMemory, 3>{ m_ObjectMemory, m_VisibilityMemory, m_DrawMemory }]{
+			for (auto buffer : buffers) vkDestroyBuffer(device, buffer, nullptr);
+			for (auto block : memory) pMemoryTracker->Free(block);
+		} };
+
+		if (deferred) m_pDeletionQueue->Push(std::move(destroy));
+		else destroy();
+
+		m_ObjectBuffer = m_VisibilityBuffer = m_DrawBuffer = VK_NULL_HANDLE;
+		m_ObjectMemory = m_VisibilityMemory = m_DrawMemory = VK_NULL_HANDLE;
+		m_Capacity = 0;
+	}
+
+	void OcclusionCuller::CreatePyramid() {
+		// Largest power of two that fits, so every level halves the one above exactly
+		auto floorPowerOfTwo{ [](uint32_t value) {
+			uint32_t power{ 1 };
+			while (power * 2 <= value) power *= 2;
+			return power;
+		} };
+
+		m_PyramidExtent = { floorPowerOfTwo(std::max(m_DepthExtent.width, 1u)), floorPowerOfTwo(std::max(m_DepthExtent.height, 1u)) };
+
+		m_LevelCount = 1;
+		while ((std::max(m_PyramidExtent.width, m_PyramidExtent.height) >> m_LevelCount) > 0) ++m_LevelCount;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.extent = { m_PyramidExtent.width, m_PyramidExtent.height, 1 };
+		imageInfo.mipLevels = m_LevelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_Device, &imageInfo, nullptr, &m_PyramidImage) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z pyramid!");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(m_Device, m_PyramidImage, &requirements);
+		m_PyramidMemory = m_pMemoryTracker->Allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
+		vkBindImageMemory(m_Device, m_PyramidImage, m_PyramidMemory, 0);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_PyramidImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_LevelCount, 0, 1 };
+
+		if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_PyramidView) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z pyramid view!");
+		}
+
+		m_LevelViews.resize(m_LevelCount);
+		for (uint32_t level{}; level < m_LevelCount; ++level) {
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+			if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_LevelViews[level]) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create Hi-Z pyramid view!");
+			}
+		}
+
+		m_PyramidValid = false;
+		m_NeedsTransition = true;
+
+		if (m_Debug) std::cout << "Hi-Z pyramid " << m_PyramidExtent.width << "x" << m_PyramidExtent.height << ", " << m_LevelCount << " levels\n";
+	}
+
+	void OcclusionCuller::DestroyPyramid(bool deferred) {
+		if (m_PyramidImage == VK_NULL_HANDLE) return;
+
+		auto destroy{ [device = m_Device, pMemoryTracker = m_pMemoryTracker, image = m_PyramidImage, memory = m_PyramidMemory,
+			view = m_PyramidView, levelViews = m_LevelViews]{
+			for (auto levelView : levelViews) vkDestroyImageView(device, levelView, nullptr);
+			vkDestroyImageView(device, view, nullptr);
+			vkDestroyImage(device, image, nullptr);
+			pMemoryTracker->Free(memory);
+		} };
+
+		if (deferred) m_pDeletionQueue->Push(std::move(destroy));
+		else destroy();
+
+		m_PyramidImage = VK_NULL_HANDLE;
+		m_PyramidMemory = VK_NULL_HANDLE;
+		m_PyramidView = VK_NULL_HANDLE;
+		m_LevelViews.clear();
+		m_LevelCount = 0;
+	}
+
+	void OcclusionCuller::CreateDescriptors() {
+		if (m_PyramidImage == VK_NULL_HANDLE) return; // Written once Configure() created the pyramid
+
+		// Frames in flight may still bind the old sets
+		if (m_DescriptorPool != VK_NULL_HANDLE) {
+			m_pDeletionQueue->Push([device = m_Device, pool = m_DescriptorPool]{
+				vkDestroyDescriptorPool(device, pool, nullptr);
+			});
+		}
+
+		std::array<VkDescriptorPoolSize, 3> poolSizes{ {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_LevelCount + 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_LevelCount },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 },
+		} };
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = m_LevelCount + 1;
+		poolInfo.poolSizeCount = uint32_t(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(m_LevelCount, m_PyramidSetLayout);
+		layouts.push_back(m_CullSetLayout);
+
+		std::vector<VkDescriptorSet> sets(layouts.size());
+
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = m_DescriptorPool;
+		allocateInfo.descriptorSetCount = uint32_t(layouts.size());
+		allocateInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(m_Device, &allocateInfo, sets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate Hi-Z descriptor sets!");
+		}
+
+		m_PyramidSets.assign(sets.begin(), sets.begin() + m_LevelCount);
+		m_CullSet = sets.back();
+
+		// Level 0 reduces the depth buffer, every level after the one above it
+		std::vector<VkDescriptorImageInfo> imageInfos{};
+		imageInfos.reserve(m_LevelCount * 2 + 1);
+		std::vector<VkWriteDescriptorSet> writes{};
+
+		auto addImageWrite{ [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout) {
+			imageInfos.push_back(VkDescriptorImageInfo{ m_Sampler, view, layout });
+
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = set;
+			write.dstBinding = binding;
+			write.descriptorCount = 1;
+			write.descriptorType = type;
+			write.pImageInfo = &imageInfos.back();
+			writes.push_back(write);
+		} };
+
+		for (uint32_t level{}; level < m_LevelCount; ++level) {
+			if (level == 0) addImageWrite(m_PyramidSets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_DepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			else addImageWrite(m_PyramidSets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_LevelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+
+			addImageWrite(m_PyramidSets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_LevelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+		}
+
+		addImageWrite(m_CullSet, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_PyramidView, VK_IMAGE_LAYOUT_GENERAL);
+
+		const VkDeviceSize drawListSize{ VkDeviceSize(m_Capacity) * m_DrawStride };
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos{ {
+			{ m_ObjectBuffer, 0, VK_WHOLE_SIZE },
+			{ m_VisibilityBuffer, 0, VK_WHOLE_SIZE },
+			{ m_DrawBuffer, 0, drawListSize },
+			{ m_DrawBuffer, drawListSize, drawListSize },
+			{ m_CounterBuffer, 0, VK_WHOLE_SIZE },
+		} };
+
+		for (uint32_t i{}; i < bufferInfos.size(); ++i) {
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = m_CullSet;
+			write.dstBinding = i;
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &bufferInfos[i];
+			writes.push_back(write);
+		}
+
+		vkUpdateDescriptorSets(m_Device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	void OcclusionCuller::CreatePipelines(VkShaderModule pyramidShader, VkShaderModule cullShader) {
+		TRACE_SCOPE("CreateCullPipelines");
+
+		// hiz.comp: 0 source, 1 destination level
+		std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings{};
+		pyramidBindings[0] = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+		pyramidBindings[1] = { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+		// cull.comp: 0 objects, 1 visibility, 2 early list, 3 late list, 4 counters, 5 pyramid
+		std::array<VkDescriptorSetLayoutBinding, 6> cullBindings{};
+		for (uint32_t i{}; i < 5; ++i) {
+			cullBindings[i] = { i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+		}
+		cullBindings[5] = { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr };
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = uint32_t(pyramidBindings.size());
+		layoutInfo.pBindings = pyramidBindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_PyramidSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z descriptor set layout!");
+		}
+
+		layoutInfo.bindingCount = uint32_t(cullBindings.size());
+		layoutInfo.pBindings = cullBindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_CullSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create cull descriptor set layout!");
+		}
+
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidConstants) };
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &m_PyramidSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PyramidLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create Hi-Z pipeline layout!");
+		}
+
+		pushConstantRange.size = sizeof(CullConstants);
+		pipelineLayoutInfo.pSetLayouts = &m_CullSetLayout;
+
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_CullLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create cull pipeline layout!");
+		}
+
+		// One cull module, a pipeline per phase
+		std::array<uint32_t, PhaseCount> phases{ Early, Late };
+		std::array<VkSpecializationInfo, PhaseCount> specializations{};
+		std::array<VkComputePipelineCreateInfo, PhaseCount + 1> pipelineInfos{};
+
+		VkSpecializationMapEntry entry{};
+		entry.constantID = 0;
+		entry.offset = 0;
+		entry.size = sizeof(uint32_t);
+
+		for (uint32_t i{}; i < pipelineInfos.size(); ++i) {
+			bool pyramid{ i == PhaseCount };
+
+			pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineInfos[i].stage.module = pyramid ? pyramidShader : cullShader;
+			pipelineInfos[i].stage.pName = "main";
+			pipelineInfos[i].layout = pyramid ? m_PyramidLayout : m_CullLayout;
+			pipelineInfos[i].basePipelineIndex = -1;
+
+			if (!pyramid) {
+				specializations[i].mapEntryCount = 1;
+				specializations[i].pMapEntries = &entry;
+				specializations[i].dataSize = sizeof(uint32_t);
+				specializations[i].pData = &phases[i];
+				pipelineInfos[i].stage.pSpecializationInfo = &specializations[i];
+			}
+		}
+
+		std::array<VkPipeline, PhaseCount + 1> pipelines{};
+		if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, uint32_t(pipelineInfos.size()), pipelineInfos.data(), nullptr, pipelines.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create cull compute pipelines!");
+		}
+
+		m_CullPipelines[Early] = pipelines[Early];
+		m_CullPipelines[Late] = pipelines[Late];
+		m_PyramidPipeline = pipelines[PhaseCount];
+	}
+
+	// Recording
+	void OcclusionCuller::Grow(VkCommandBuffer commandBuffer) {
+		VkBuffer oldObjects{ m_ObjectBuffer };
+		std::array<VkBuffer, 2> oldBuffers{ m_VisibilityBuffer, m_DrawBuffer };
+		std::array<VkDeviceMemory, 3> oldMemory{ m_ObjectMemory, m_VisibilityMemory, m_DrawMemory };
+
+		uint32_t capacity{ std::max(uint32_t(m_Objects.size()), m_Capacity * 2) };
+		CreateBuffers((capacity + m_MinCapacity - 1) / m_MinCapacity * m_MinCapacity);
+
+		// Only the objects are kept, the rest is rewritten every frame
+		if (m_UploadedCount > 0) {
+			// Earlier uploads wrote the old objects, the copy reads them
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkBufferCopy region{ 0, 0, VkDeviceSize(m_UploadedCount) * sizeof(Object) };
+			vkCmdCopyBuffer(commandBuffer, oldObjects, m_ObjectBuffer, 1, &region);
+
+			// The uploads after this may overwrite part of the copy
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		m_pDeletionQueue->Push([device = m_Device, pMemoryTracker = m_pMemoryTracker, oldObjects, oldBuffers, oldMemory]{
+			vkDestroyBuffer(device, oldObjects, nullptr);
+			for (auto buffer : oldBuffers) vkDestroyBuffer(device, buffer, nullptr);
+			for (auto memory : oldMemory) pMemoryTracker->Free(memory);
+		});
+
+		CreateDescriptors();
+
+		if (m_Debug) std::cout << "Cull buffers grown to " << m_Capacity << " objects\n";
+	}
+
+	void OcclusionCuller::Upload(VkCommandBuffer commandBuffer, FrameContext& frame) {
+		if (m_DirtyBegin == m_DirtyEnd) return;
+
+		// Whatever is over the budget goes next frame, objects past m_UploadedCount aren't culled or drawn until then
+		uint32_t count{ std::min(m_DirtyEnd - m_DirtyBegin, m_UploadBudget) };
+		VkDeviceSize size{ VkDeviceSize(count) * sizeof(Object) };
+
+		UploadAllocation upload{ frame.Allocate(size) };
+		memcpy(upload.pData, m_Objects.data() + m_DirtyBegin, size_t(size));
+
+		VkBufferCopy region{ upload.offset, VkDeviceSize(m_DirtyBegin) * sizeof(Object), size };
+		vkCmdCopyBuffer(commandBuffer, upload.buffer, m_ObjectBuffer, 1, &region);
+
+		m_DirtyBegin += count;
+		if (m_DirtyBegin > m_UploadedCount) m_UploadedCount = m_DirtyBegin;
+		if (m_DirtyBegin == m_DirtyEnd) m_DirtyBegin = m_DirtyEnd = 0;
+	}
+
+	void OcclusionCuller::Dispatch(VkCommandBuffer commandBuffer, Phase phase) {
+		if (m_DispatchCount == 0) return;
+
+		CullConstants constants{};
+		constants.pyramidSize = glm::vec2{ float(m_PyramidExtent.width), float(m_PyramidExtent.height) };
+		constants.levelCount = m_LevelCount;
+		constants.objectCount = m_DispatchCount;
+		constants.pyramidValid = m_PyramidValid ? 1u : 0u;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipelines[phase]);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullLayout, 0, 1, &m_CullSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_CullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+		vkCmdDispatch(commandBuffer, (m_DispatchCount + m_GroupSize - 1) / m_GroupSize, 1, 1);
+	}
+}
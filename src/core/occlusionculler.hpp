@@ -0,0 +1,172 @@
+#ifndef OCCLUSIONCULLER_HPP
+#define OCCLUSIONCULLER_HPP
+
+#include <array>
+
+#include "memorytracker.hpp"
+#include "deletionqueue.hpp"
+#include "framecontext.hpp"
+
+namespace vulkat {
+	// GPU frustum and Hi-Z occlusion culling of objects that share one vertex, index and instance buffer.
+	// Every object has screen bounds and an indexed draw, the cull passes write the draw with an instance count of 0 or 1
+	// into two indirect lists, so the CPU never sees which objects survived. Per frame, in recording order:
+	// - CullEarly: tests against last frame's pyramid, the survivors go on the early list and into the depth pre-pass
+	// - BuildPyramid: max depth mip chain of that depth buffer, in a compute pass of the render graph
+	// - CullLate: re-tests whatever the early test rejected against the new pyramid, the survivors go on the late list
+	// Objects that only became visible this frame thus still get drawn this frame
+	class OcclusionCuller final {
+	public:
+		// Same layout as Counters in shaders/cull.comp
+		struct Stats {
+			uint32_t tested{ 0 };
+			uint32_t frustumCulled{ 0 };
+			uint32_t occluded{ 0 }; // Also by this frame's pyramid
+			uint32_t drawnEarly{ 0 };
+			uint32_t drawnLate{ 0 };
+		};
+
+		OcclusionCuller();
+
+		OcclusionCuller(const OcclusionCuller& other) = delete;
+		OcclusionCuller(OcclusionCuller&& other) = delete;
+		OcclusionCuller& operator=(const OcclusionCuller& other) = delete;
+		OcclusionCuller& operator=(OcclusionCuller&& other) = delete;
+
+		~OcclusionCuller() = default;
+
+		// pyramidShader is hiz.comp, cullShader cull.comp. slotCount is the number of frames in flight,
+		// maxDrawCount how many draws one indirect call may have (1 without multiDrawIndirect)
+		void Initialize(VkDevice device, MemoryTracker* pMemoryTracker, DeletionQueue* pDeletionQueue,
+			VkShaderModule pyramidShader, VkShaderModule cullShader, uint32_t slotCount, uint32_t maxDrawCount, bool debug);
+		void Cleanup();
+
+		// After every render graph compile, depthView is the sampled depth of the pre-pass. The old pyramid outlives the frames using it
+		void Configure(VkImageView depthView, VkExtent2D extent);
+
+		// Bounds in NDC with z as depth, the draw's instance count is replaced by the test's result
+		void SetObjectCount(uint32_t count);
+		void SetObject(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const VkDrawIndexedIndirectCommand& draw);
+		uint32_t GetObjectCount() const { return uint32_t(m_Objects.size()); }
+
+		// Outside any render pass, before the depth pre-pass. Uploads changed objects through the frame's upload ring
+		void CullEarly(VkCommandBuffer commandBuffer, FrameContext& frame);
+		// Inside the render graph's compute pass, after the depth pre-pass
+		void BuildPyramid(VkCommandBuffer commandBuffer);
+		// Copies the counters of both passes to the readback slot, read by Collect(slot)
+		void CullLate(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		// Indirect draws of one list, the caller binds the pipeline and buffers
+		void RecordDraws(VkCommandBuffer commandBuffer, bool late) const;
+
+		// Counters of the frame that last used slot, once its fence was waited on. Only frames that were
+		// submitted with the late test have any, the others leave the last stats in place
+		void Collect(uint32_t slot);
+		void MarkSubmitted(uint32_t slot);
+		const Stats& GetStats() const { return m_Stats; }
+		void PrintStats(std::ostream& os) const;
+
+	private:
+		enum class SlotState {
+			Free,
+			Recorded, // CullLate copied the counters, not submitted yet
+			Submitted // Readable once the slot's fence was waited on
+		};
+
+		// Same layout as Object in shaders/cull.comp
+		struct Object {
+			glm::vec4 boundsMin;
+			glm::vec4 boundsMax;
+			VkDrawIndexedIndirectCommand draw;
+			uint32_t padding[3];
+		};
+
+		enum Phase : uint32_t {
+			Early,
+			Late,
+			PhaseCount
+		};
+
+		// Same blocks as the push constants of hiz.comp and cull.comp
+		struct PyramidConstants {
+			glm::ivec2 sourceSize;
+			glm::ivec2 destinationSize;
+		};
+
+		struct CullConstants {
+			glm::vec2 pyramidSize;
+			uint32_t levelCount;
+			uint32_t objectCount;
+			uint32_t pyramidValid;
+		};
+
+		static constexpr uint32_t m_GroupSize{ 64 }; // local_size_x of cull.comp
+		static constexpr uint32_t m_PyramidGroupSize{ 8 }; // local_size_x and _y of hiz.comp
+		static constexpr uint32_t m_MinCapacity{ 256 }; // Capacity is a multiple, so the late list starts at a valid storage buffer offset
+		static constexpr uint32_t m_UploadBudget{ 4096 }; // Objects per frame, a quarter of the upload slice, the rest goes next frame
+		static constexpr VkDeviceSize m_DrawStride{ sizeof(VkDrawIndexedIndirectCommand) };
+
+		VkDevice m_Device;
+		MemoryTracker* m_pMemoryTracker;
+		DeletionQueue* m_pDeletionQueue;
+		uint32_t m_MaxDrawCount;
+		bool m_Debug;
+
+		std::vector<Object> m_Objects;
+		uint32_t m_DirtyBegin; // Objects not uploaded yet
+		uint32_t m_DirtyEnd;
+		uint32_t m_UploadedCount; // Objects below this were uploaded at least once, only those are culled
+		uint32_t m_DispatchCount; // Objects culled and drawn by the frame being recorded
+		uint32_t m_Capacity;
+
+		VkBuffer m_ObjectBuffer;
+		VkDeviceMemory m_ObjectMemory;
+		VkBuffer m_VisibilityBuffer; // Early result per object, read by the late test
+		VkDeviceMemory m_VisibilityMemory;
+		VkBuffer m_DrawBuffer; // Early list, then the late list, capacity draws each
+		VkDeviceMemory m_DrawMemory;
+		VkBuffer m_CounterBuffer;
+		VkDeviceMemory m_CounterMemory;
+		VkBuffer m_ReadbackBuffer; // Counters per slot, persistently mapped
+		VkDeviceMemory m_ReadbackMemory;
+		void* m_pReadbackData;
+		std::vector<SlotState> m_SlotStates;
+
+		VkImageView m_DepthView;
+		VkExtent2D m_DepthExtent;
+		VkImage m_PyramidImage; // R32_SFLOAT, power of two, always in GENERAL
+		VkDeviceMemory m_PyramidMemory;
+		VkImageView m_PyramidView; // Every level, sampled by the cull passes
+		std::vector<VkImageView> m_LevelViews; // Written by the pyramid pass and read by the next level
+		VkExtent2D m_PyramidExtent;
+		uint32_t m_LevelCount;
+		VkSampler m_Sampler;
+		bool m_PyramidValid; // Built at least once since Configure()
+		bool m_NeedsTransition;
+
+		VkDescriptorSetLayout m_PyramidSetLayout;
+		VkDescriptorSetLayout m_CullSetLayout;
+		VkPipelineLayout m_PyramidLayout;
+		VkPipelineLayout m_CullLayout;
+		VkPipeline m_PyramidPipeline;
+		VkPipeline m_CullPipelines[PhaseCount];
+		VkDescriptorPool m_DescriptorPool; // Replaced whenever a buffer or the pyramid is, sets in use are never updated
+		std::vector<VkDescriptorSet> m_PyramidSets; // One per level
+		VkDescriptorSet m_CullSet;
+
+		Stats m_Stats;
+
+		void CreateBuffers(uint32_t capacity);
+		void DestroyBuffers(bool deferred);
+		void CreatePyramid();
+		void DestroyPyramid(bool deferred);
+		void CreateDescriptors();
+		void CreatePipelines(VkShaderModule pyramidShader, VkShaderModule cullShader);
+
+		void Grow(VkCommandBuffer commandBuffer);
+		void Upload(VkCommandBuffer commandBuffer, FrameContext& frame);
+		void Dispatch(VkCommandBuffer commandBuffer, Phase phase);
+
+	};
+}
+#endif // OCCLUSIONCULLER_HPP
@@ -0,0 +1,308 @@
+#include "../pch.hpp"
+#include "particlesystem.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	// Matches the Particle struct in particle.comp
+	constexpr VkDeviceSize g_ParticleSize{ 3 * sizeof(glm::vec4) };
+
+	ParticleSystem::ParticleSystem()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pMemoryTracker{ nullptr }
+		, m_Debug{ false }
+		, m_Capacity{ 0 }
+		, m_ParticleBuffer{ VK_NULL_HANDLE }
+		, m_ParticleMemory{ VK_NULL_HANDLE }
+		, m_ListBuffer{ VK_NULL_HANDLE }
+		, m_ListMemory{ VK_NULL_HANDLE }
+		, m_CounterBuffer{ VK_NULL_HANDLE }
+		, m_CounterMemory{ VK_NULL_HANDLE }
+		, m_DescriptorSetLayout{ VK_NULL_HANDLE }
+		, m_DescriptorPool{ VK_NULL_HANDLE }
+		, m_DescriptorSet{ VK_NULL_HANDLE }
+		, m_PipelineLayout{ VK_NULL_HANDLE }
+		, m_Pipelines{}
+		, m_EmitterPosition{ 0.f, 0.8f }
+		, m_EmitRate{ 0.f }
+		, m_EmitAccumulator{ 0.f }
+		, m_Current{ 0 }
+		, m_Seed{ 0x2545f491u }
+		, m_NeedsReset{ true }
+	{}
+
+	void ParticleSystem::Initialize(VkDevice device, MemoryTracker* pMemoryTracker,
+		VkShaderModule simulationShader, const std::string& vertexShader, uint32_t capacity, bool debug) {
+		m_Device = device;
+		m_pMemoryTracker = pMemoryTracker;
+		m_VertexShader = vertexShader;
+		m_Debug = debug;
+
+		// The reset pass is a direct dispatch over every particle, 65535 groups is the least every device allows
+		m_Capacity = std::min(capacity, 65535 * m_GroupSize);
+		m_NeedsReset = true;
+
+		// Lifetimes average 3 seconds, this keeps about every particle alive
+		m_EmitRate = float(m_Capacity) / 3.f;
+
+		m_ParticleBuffer = m_pMemoryTracker->CreateBuffer(VkDeviceSize(m_Capacity) * g_ParticleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_ParticleMemory);
+		m_ListBuffer = m_pMemoryTracker->CreateBuffer(VkDeviceSize(m_Capacity) * 3 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_ListMemory);
+		m_CounterBuffer = m_pMemoryTracker->CreateBuffer(m_CounterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Storage, m_CounterMemory);
+
+		CreateDescriptors();
+		CreatePipelines(simulationShader);
+
+		if (m_Debug) {
+			std::cout << "Particle system of " << m_Capacity << " particles, "
+				<< (VkDeviceSize(m_Capacity) * (g_ParticleSize + 3 * sizeof(uint32_t))) / (1024 * 1024) << " MiB\n";
+		}
+	}
+
+	void ParticleSystem::Cleanup() {
+		for (auto pipeline : m_Pipelines) {
+			vkDestroyPipeline(m_Device, pipeline, nullptr);
+		}
+		m_Pipelines.fill(VK_NULL_HANDLE);
+
+		vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr); // Frees the set with it
+		vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+
+		for (auto& buffer : { std::make_pair(m_ParticleBuffer, m_ParticleMemory), std::make_pair(m_ListBuffer, m_ListMemory), std::make_pair(m_CounterBuffer, m_CounterMemory) }) {
+			vkDestroyBuffer(m_Device, buffer.first, nullptr);
+			m_pMemoryTracker->Free(buffer.second);
+		}
+
+		m_Capacity = 0;
+	}
+
+	void ParticleSystem::SetEmitter(const glm::vec2& position, float rate) {
+		m_EmitterPosition = position;
+		m_EmitRate = rate;
+	}
+
+	PipelineState ParticleSystem::GetPipelineState(const PipelineState& mainState) const {
+		PipelineState state{ mainState };
+
+		// Corners come from gl_VertexIndex, everything else from the storage buffers
+		state.vertexShader = m_VertexShader;
+		state.bindings.clear();
+		state.attributes.clear();
+		state.cullMode = VK_CULL_MODE_NONE;
+
+		// Order independent, so the quads never need sorting
+		state.blendEnable = true;
+		state.srcBlendFactor = VK_BLEND_FACTOR_ONE;
+		state.dstBlendFactor = VK_BLEND_FACTOR_ONE;
+		state.depthTest = false;
+		state.depthWrite = false;
+
+		state.layout = m_PipelineLayout;
+
+		return state;
+	}
+
+	void ParticleSystem::Simulate(VkCommandBuffer commandBuffer, float deltaTime) {
+		TRACE_SCOPE("SimulateParticles");
+
+		// Long hitches would launch everything at once, slow the simulation down instead
+		deltaTime = std::min(deltaTime, 0.1f);
+
+		m_EmitAccumulator = std::min(m_EmitAccumulator + m_EmitRate * deltaTime, float(m_Capacity));
+		uint32_t emitRequest{ uint32_t(m_EmitAccumulator) };
+		m_EmitAccumulator -= float(emitRequest);
+
+		Constants constants{};
+		constants.emitterPosition = m_EmitterPosition;
+		constants.deltaTime = deltaTime;
+		constants.emitRequest = emitRequest;
+		constants.capacity = m_Capacity;
+		constants.current = m_Current;
+		constants.seed = m_Seed;
+		constants.size = m_Size;
+
+		m_Seed = m_Seed * 1664525u + 1013904223u;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
+
+		// Last frame's draw read the buffers this frame's passes write
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		if (m_NeedsReset) {
+			m_NeedsReset = false;
+			Dispatch(commandBuffer, Stage::Reset, constants);
+			Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		}
+
+		const VkPipelineStageFlags computeAndIndirect{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT };
+		const VkAccessFlags computeAndIndirectAccess{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT };
+
+		Dispatch(commandBuffer, Stage::EmitArgs, constants);
+		Barrier(commandBuffer, computeAndIndirect, computeAndIndirectAccess);
+		Dispatch(commandBuffer, Stage::Emit, constants, m_EmitArgsOffset);
+		Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		Dispatch(commandBuffer, Stage::SimulateArgs, constants);
+		Barrier(commandBuffer, computeAndIndirect, computeAndIndirectAccess);
+		Dispatch(commandBuffer, Stage::Simulate, constants, m_SimulateArgsOffset);
+		Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		Dispatch(commandBuffer, Stage::DrawArgs, constants);
+
+		// The draw pulls the survivors in the vertex shader
+		Barrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+		m_Current = 1 - m_Current;
+	}
+
+	void ParticleSystem::Record(VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+		if (pipeline == VK_NULL_HANDLE) return;
+
+		// The vertex shader reads the list the last simulation filled
+		Constants constants{};
+		constants.capacity = m_Capacity;
+		constants.current = m_Current;
+		constants.size = m_Size;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Constants), &constants);
+
+		vkCmdDrawIndirect(commandBuffer, m_CounterBuffer, m_DrawArgsOffset, 1, sizeof(VkDrawIndirectCommand));
+	}
+
+	void ParticleSystem::CreateDescriptors() {
+		// 0: particles, 1: lists, 2: counters. The draw only reads the first two
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+		for (uint32_t i{}; i < bindings.size(); ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | (i < 2 ? VkShaderStageFlags(VK_SHADER_STAGE_VERTEX_BIT) : 0);
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = uint32_t(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create particle descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSize.descriptorCount = uint32_t(bindings.size());
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+
+		if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create particle descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = m_DescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &m_DescriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(m_Device, &allocateInfo, &m_DescriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate particle descriptor set!");
+		}
+
+		// The buffers never change, so the set is written once
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos{ {
+			{ m_ParticleBuffer, 0, VK_WHOLE_SIZE },
+			{ m_ListBuffer, 0, VK_WHOLE_SIZE },
+			{ m_CounterBuffer, 0, VK_WHOLE_SIZE },
+		} };
+
+		std::array<VkWriteDescriptorSet, 3> writes{};
+		for (uint32_t i{}; i < writes.size(); ++i) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_DescriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(m_Device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(Constants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create particle pipeline layout!");
+		}
+	}
+
+	void ParticleSystem::CreatePipelines(VkShaderModule module) {
+		TRACE_SCOPE("CreateParticlePipelines");
+
+		// One module, a pipeline per stage: the branches on STAGE fold away at compile time
+		const uint32_t stageCount{ uint32_t(Stage::StageCount) };
+		std::array<uint32_t, stageCount> stages{};
+		std::array<VkSpecializationInfo, stageCount> specializations{};
+		std::array<VkComputePipelineCreateInfo, stageCount> pipelineInfos{};
+
+		VkSpecializationMapEntry entry{};
+		entry.constantID = 0;
+		entry.offset = 0;
+		entry.size = sizeof(uint32_t);
+
+		for (uint32_t i{}; i < stageCount; ++i) {
+			stages[i] = i;
+
+			specializations[i].mapEntryCount = 1;
+			specializations[i].pMapEntries = &entry;
+			specializations[i].dataSize = sizeof(uint32_t);
+			specializations[i].pData = &stages[i];
+
+			pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipelineInfos[i].stage.module = module;
+			pipelineInfos[i].stage.pName = "main";
+			pipelineInfos[i].stage.pSpecializationInfo = &specializations[i];
+			pipelineInfos[i].layout = m_PipelineLayout;
+			pipelineInfos[i].basePipelineIndex = -1;
+		}
+
+		if (vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, stageCount, pipelineInfos.data(), nullptr, m_Pipelines.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create particle compute pipelines!");
+		}
+	}
+
+	void ParticleSystem::Dispatch(VkCommandBuffer commandBuffer, Stage stage, const Constants& constants, VkDeviceSize argsOffset) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipelines[size_t(stage)]);
+		vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Constants), &constants);
+
+		if (argsOffset != VK_WHOLE_SIZE) vkCmdDispatchIndirect(commandBuffer, m_CounterBuffer, argsOffset);
+		else if (stage == Stage::Reset) vkCmdDispatch(commandBuffer, (m_Capacity + m_GroupSize - 1) / m_GroupSize, 1, 1);
+		else vkCmdDispatch(commandBuffer, 1, 1, 1); // The argument stages are a single thread
+	}
+
+	void ParticleSystem::Barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef PARTICLESYSTEM_HPP
+#define PARTICLESYSTEM_HPP
+
+#include <array>
+
+#include "memorytracker.hpp"
+#include "pipelineregistry.hpp"
+
+namespace vulkat {
+	// Particles that live entirely on the GPU. Emission, integration and death are compute passes over
+	// persistent storage buffers: free slots sit on a dead list, the living ones on two alive lists that
+	// swap every frame. Each pass is sized by an indirect dispatch written by the pass before it, and the
+	// survivors are drawn as instanced quads with an indirect draw, so the CPU only ever sees counts.
+	// Stages of shaders/particle.comp, in recording order:
+	// reset (once) -> emit args -> emit -> simulate args -> simulate -> draw args
+	class ParticleSystem final {
+	public:
+		ParticleSystem();
+
+		ParticleSystem(const ParticleSystem& other) = delete;
+		ParticleSystem(ParticleSystem&& other) = delete;
+		ParticleSystem& operator=(const ParticleSystem& other) = delete;
+		ParticleSystem& operator=(ParticleSystem&& other) = delete;
+
+		~ParticleSystem() = default;
+
+		// simulationShader is particle.comp, vertexShader the path of particle.vert for the draw's pipeline state
+		void Initialize(VkDevice device, MemoryTracker* pMemoryTracker,
+			VkShaderModule simulationShader, const std::string& vertexShader, uint32_t capacity, bool debug);
+		void Cleanup();
+
+		// rate in particles per second, emission stops while every particle is alive
+		void SetEmitter(const glm::vec2& position, float rate);
+
+		// Quads through the main pass, with the system's own layout and additive blending
+		PipelineState GetPipelineState(const PipelineState& mainState) const;
+
+		// Compute passes, outside any render pass, before the frame's draws
+		void Simulate(VkCommandBuffer commandBuffer, float deltaTime);
+
+		// Indirect draw of the survivors, inside the main pass. Skipped while the pipeline compiles
+		void Record(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+
+		uint32_t GetCapacity() const { return m_Capacity; }
+
+	private:
+		enum class Stage : uint32_t {
+			Reset,
+			EmitArgs,
+			Emit,
+			SimulateArgs,
+			Simulate,
+			DrawArgs,
+			StageCount
+		};
+
+		// Same block in particle.comp and particle.vert
+		struct Constants {
+			glm::vec2 emitterPosition;
+			float deltaTime;
+			uint32_t emitRequest;
+			uint32_t capacity;
+			uint32_t current;
+			uint32_t seed;
+			float size;
+		};
+
+		static constexpr uint32_t m_GroupSize{ 64 }; // local_size_x of particle.comp
+		static constexpr float m_Size{ 0.004f }; // Half the quad, in NDC
+
+		// Byte offsets of the indirect arguments in the counter buffer, see Counters in particle.comp
+		static constexpr VkDeviceSize m_EmitArgsOffset{ 16 };
+		static constexpr VkDeviceSize m_SimulateArgsOffset{ 32 };
+		static constexpr VkDeviceSize m_DrawArgsOffset{ 48 };
+		static constexpr VkDeviceSize m_CounterSize{ 64 };
+
+		VkDevice m_Device;
+		MemoryTracker* m_pMemoryTracker;
+		std::string m_VertexShader;
+		bool m_Debug;
+
+		uint32_t m_Capacity;
+
+		VkBuffer m_ParticleBuffer;
+		VkDeviceMemory m_ParticleMemory;
+		VkBuffer m_ListBuffer; // Dead list, alive list 0, alive list 1
+		VkDeviceMemory m_ListMemory;
+		VkBuffer m_CounterBuffer; // List sizes and indirect arguments
+		VkDeviceMemory m_CounterMemory;
+
+		VkDescriptorSetLayout m_DescriptorSetLayout;
+		VkDescriptorPool m_DescriptorPool;
+		VkDescriptorSet m_DescriptorSet;
+		VkPipelineLayout m_PipelineLayout; // Shared by the compute stages and the draw
+		std::array<VkPipeline, size_t(Stage::StageCount)> m_Pipelines;
+
+		glm::vec2 m_EmitterPosition;
+		float m_EmitRate;
+		float m_EmitAccumulator; // Fractional particles carried over to the next frame
+		uint32_t m_Current; // Alive list the next simulation reads
+		uint32_t m_Seed;
+		bool m_NeedsReset;
+
+		void CreateDescriptors();
+		void CreatePipelines(VkShaderModule module);
+
+		void Dispatch(VkCommandBuffer commandBuffer, Stage stage, const Constants& constants, VkDeviceSize argsOffset = VK_WHOLE_SIZE);
+		static void Barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+	};
+}
+#endif // PARTICLESYSTEM_HPP
@@ -0,0 +1,312 @@
+#include "../pch.hpp"
+#include "pipelineregistry.hpp"
+#include "hash.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	PipelineRegistry::PipelineRegistry()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_Debug{ false }
+		, m_pShaderCache{ nullptr }
+		, m_pThreadPool{ nullptr }
+		, m_PipelineCache{ VK_NULL_HANDLE }
+		, m_Completed{ 0 }
+		, m_LastPolled{ 0 }
+		, m_Requests{ 0 }
+		, m_Hits{ 0 }
+	{}
+
+	void PipelineRegistry::Initialize(VkDevice device, ShaderCache* pShaderCache, ThreadPool* pThreadPool, bool debug) {
+		m_Device = device;
+		m_pShaderCache = pShaderCache;
+		m_pThreadPool = pThreadPool;
+		m_Debug = debug;
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+		if (vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_PipelineCache) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline cache!");
+		}
+	}
+
+	void PipelineRegistry::Cleanup() {
+		Clear();
+
+		vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
+	}
+
+	uint64_t PipelineRegistry::Request(const PipelineState& state) {
+		++m_Requests;
+
+		uint64_t key{ Hash(state) };
+		if (m_Pipelines.count(key)) {
+			++m_Hits;
+			return key;
+		}
+
+		// Resolve the modules here, the shader cache belongs to the render thread
+		VkShaderModule vertShaderModule{ m_pShaderCache->Get(state.vertexShader) };
+		VkShaderModule fragShaderModule{ state.fragmentShader.empty() ? VK_NULL_HANDLE : m_pShaderCache->Get(state.fragmentShader) };
+
+		Entry* pEntry{ m_Pipelines.emplace(key, std::make_unique<Entry>()).first->second.get() };
+		pEntry->job = m_pThreadPool->Submit([this, state, vertShaderModule, fragShaderModule, pEntry]{
+			Compile(state, vertShaderModule, fragShaderModule, pEntry);
+		});
+
+		return key;
+	}
+
+	VkPipeline PipelineRegistry::Get(uint64_t key, uint64_t fallbackKey) const {
+		for (uint64_t candidate : { key, fallbackKey }) {
+			auto it = m_Pipelines.find(candidate);
+			if (it != m_Pipelines.end() && it->second->ready.load(std::memory_order_acquire)) {
+				return it->second->pipeline;
+			}
+		}
+
+		return VK_NULL_HANDLE;
+	}
+
+	VkPipeline PipelineRegistry::Wait(uint64_t key) {
+		auto it = m_Pipelines.find(key);
+		if (it == m_Pipelines.end()) {
+			throw std::runtime_error("Waiting on a pipeline that was never requested!");
+		}
+
+		Entry& entry{ *it->second };
+		if (entry.job.valid()) {
+			entry.job.get(); // Rethrows compile errors
+		}
+
+		return entry.pipeline;
+	}
+
+	bool PipelineRegistry::Poll() {
+		uint32_t completed{ m_Completed.load(std::memory_order_acquire) };
+		bool changed{ completed != m_LastPolled };
+		m_LastPolled = completed;
+
+		if (changed) {
+			for (auto& pipeline : m_Pipelines) {
+				Entry& entry{ *pipeline.second };
+				if (entry.failed.load(std::memory_order_acquire) && entry.job.valid()) {
+					entry.job.get(); // Rethrows the compile error
+				}
+			}
+		}
+
+		return changed;
+	}
+
+	void PipelineRegistry::Clear(DeletionQueue* pDeletionQueue) {
+		std::vector<VkPipeline> pipelines;
+
+		for (auto& pipeline : m_Pipelines) {
+			Entry& entry{ *pipeline.second };
+
+			// Let in flight compiles finish before destroying what they produce
+			if (entry.job.valid()) {
+				try {
+					entry.job.get();
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Pipeline compile failed: " << e.what() << '\n';
+				}
+			}
+
+			if (entry.pipeline != VK_NULL_HANDLE) {
+				pipelines.push_back(entry.pipeline);
+			}
+		}
+
+		m_Pipelines.clear();
+
+		auto destroy{ [device = m_Device, pipelines]{
+			for (auto pipeline : pipelines) vkDestroyPipeline(device, pipeline, nullptr);
+		} };
+
+		if (pDeletionQueue) pDeletionQueue->Push(std::move(destroy));
+		else destroy();
+	}
+
+	void PipelineRegistry::PrintStats() const {
+		std::cout << "Pipelines: " << m_Pipelines.size() << " compiled, "
+			<< m_Hits << "/" << m_Requests << " requests deduplicated\n";
+	}
+
+	uint64_t PipelineRegistry::Hash(const PipelineState& state) {
+		// Shaders are hashed by content, so identical SPIR-V under different names dedups
+		uint64_t hash{ HashCombine(g_FnvOffsetBasis, m_pShaderCache->GetHash(state.vertexShader)) };
+		hash = HashCombine(hash, state.fragmentShader.empty() ? 0 : m_pShaderCache->GetHash(state.fragmentShader));
+
+		for (const auto& binding : state.bindings) {
+			hash = HashCombine(hash, binding);
+		}
+		for (const auto& attribute : state.attributes) {
+			hash = HashCombine(hash, attribute);
+		}
+		hash = HashCombine(hash, state.topology);
+
+		hash = HashCombine(hash, state.polygonMode);
+		hash = HashCombine(hash, state.cullMode);
+		hash = HashCombine(hash, state.frontFace);
+
+		hash = HashCombine(hash, state.blendEnable);
+		hash = HashCombine(hash, state.srcBlendFactor);
+		hash = HashCombine(hash, state.dstBlendFactor);
+		hash = HashCombine(hash, state.colorAttachmentCount);
+
+		hash = HashCombine(hash, state.depthTest);
+		hash = HashCombine(hash, state.depthWrite);
+		hash = HashCombine(hash, state.depthCompareOp);
+
+		hash = HashCombine(hash, state.extent);
+		hash = HashCombine(hash, state.layout);
+		hash = HashCombine(hash, state.renderPass);
+		hash = HashCombine(hash, state.subpass);
+
+		return hash != 0 ? hash : 1; // 0 means "no pipeline" to Get()
+	}
+
+	void PipelineRegistry::Compile(const PipelineState& state, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, Entry* pEntry) {
+		TRACE_SCOPE("CompilePipeline");
+
+		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+
+		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		vertShaderStageInfo.module = vertShaderModule;
+		vertShaderStageInfo.pName = "main";
+
+		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+
+		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		fragShaderStageInfo.module = fragShaderModule;
+		fragShaderStageInfo.pName = "main";
+
+		VkPipelineShaderStageCreateInfo shaderStages[]{ vertShaderStageInfo, fragShaderStageInfo };
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(state.bindings.size());
+		vertexInputInfo.pVertexBindingDescriptions = state.bindings.data();
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.attributes.size());
+		vertexInputInfo.pVertexAttributeDescriptions = state.attributes.data();
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssemplyInfo{};
+
+		inputAssemplyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemplyInfo.topology = state.topology;
+		inputAssemplyInfo.primitiveRestartEnable = VK_FALSE;
+
+		VkViewport viewport{};
+
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = float(state.extent.width);
+		viewport.height = float(state.extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor{};
+
+		scissor.offset = { 0, 0 };
+		scissor.extent = state.extent;
+
+		VkPipelineViewportStateCreateInfo viewportStateInfo{};
+
+		viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportStateInfo.viewportCount = 1;
+		viewportStateInfo.pViewports = &viewport;
+		viewportStateInfo.scissorCount = 1;
+		viewportStateInfo.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
+
+		rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizerInfo.depthClampEnable = VK_FALSE;
+		rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+		rasterizerInfo.polygonMode = state.polygonMode;
+		rasterizerInfo.lineWidth = 1.0f;
+		rasterizerInfo.cullMode = state.cullMode;
+		rasterizerInfo.frontFace = state.frontFace;
+		rasterizerInfo.depthBiasEnable = VK_FALSE;
+		rasterizerInfo.depthBiasConstantFactor = 0.0f;
+		rasterizerInfo.depthBiasClamp = 0.0f;
+		rasterizerInfo.depthBiasSlopeFactor = 0.0f;
+
+		VkPipelineMultisampleStateCreateInfo multisamplingInfo{};
+
+		multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisamplingInfo.sampleShadingEnable = VK_FALSE;
+		multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisamplingInfo.minSampleShading = 1.0f;
+		multisamplingInfo.pSampleMask = nullptr;
+		multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
+		multisamplingInfo.alphaToOneEnable = VK_FALSE;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
+		depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencilInfo.depthTestEnable = state.depthTest ? VK_TRUE : VK_FALSE;
+		depthStencilInfo.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE;
+		depthStencilInfo.depthCompareOp = state.depthCompareOp;
+		depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+		depthStencilInfo.stencilTestEnable = VK_FALSE;
+
+		// Same blend state for every color attachment
+		std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(state.colorAttachmentCount);
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+		colorBlendAttachment.srcColorBlendFactor = state.srcBlendFactor;
+		colorBlendAttachment.dstColorBlendFactor = state.dstBlendFactor;
+		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		std::fill(colorBlendAttachments.begin(), colorBlendAttachments.end(), colorBlendAttachment);
+
+		VkPipelineColorBlendStateCreateInfo colorBlendingInfo{};
+		colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendingInfo.logicOpEnable = VK_FALSE;
+		colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
+		colorBlendingInfo.attachmentCount = state.colorAttachmentCount;
+		colorBlendingInfo.pAttachments = colorBlendAttachments.data();
+		colorBlendingInfo.blendConstants[0] = 0.0f;
+		colorBlendingInfo.blendConstants[1] = 0.0f;
+		colorBlendingInfo.blendConstants[2] = 0.0f;
+		colorBlendingInfo.blendConstants[3] = 0.0f;
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = fragShaderModule != VK_NULL_HANDLE ? 2 : 1;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssemplyInfo;
+		pipelineInfo.pViewportState = &viewportStateInfo;
+		pipelineInfo.pRasterizationState = &rasterizerInfo;
+		pipelineInfo.pMultisampleState = &multisamplingInfo;
+		pipelineInfo.pDepthStencilState = &depthStencilInfo;
+		pipelineInfo.pColorBlendState = &colorBlendingInfo;
+		pipelineInfo.layout = state.layout;
+		pipelineInfo.renderPass = state.renderPass;
+		pipelineInfo.subpass = state.subpass;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineInfo.basePipelineIndex = -1;
+
+		if (vkCreateGraphicsPipelines(m_Device, m_PipelineCache, 1, &pipelineInfo, nullptr, &pEntry->pipeline) != VK_SUCCESS) {
+			pEntry->pipeline = VK_NULL_HANDLE;
+			pEntry->failed.store(true, std::memory_order_release);
+			m_Completed.fetch_add(1, std::memory_order_release); // Poll() looks for it
+			throw std::runtime_error("Failed to create graphics pipeline!");
+		}
+
+		pEntry->ready.store(true, std::memory_order_release);
+		m_Completed.fetch_add(1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef PIPELINEREGISTRY_HPP
+#define PIPELINEREGISTRY_HPP
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "shadercache.hpp"
+#include "threadpool.hpp"
+#include "deletionqueue.hpp"
+
+namespace vulkat {
+	// Everything that ends up in a VkGraphicsPipelineCreateInfo
+	struct PipelineState {
+		std::string vertexShader; // SHADER(name) paths, hashed by content
+		std::string fragmentShader; // Empty: no fragment stage, eg. depth only
+
+		std::vector<VkVertexInputBindingDescription> bindings{};
+		std::vector<VkVertexInputAttributeDescription> attributes{};
+		VkPrimitiveTopology topology{ VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST };
+
+		VkPolygonMode polygonMode{ VK_POLYGON_MODE_FILL };
+		VkCullModeFlags cullMode{ VK_CULL_MODE_BACK_BIT };
+		VkFrontFace frontFace{ VK_FRONT_FACE_CLOCKWISE };
+
+		bool blendEnable{ false };
+		VkBlendFactor srcBlendFactor{ VK_BLEND_FACTOR_ONE };
+		VkBlendFactor dstBlendFactor{ VK_BLEND_FACTOR_ZERO };
+		uint32_t colorAttachmentCount{ 1 };
+
+		bool depthTest{ false };
+		bool depthWrite{ false };
+		VkCompareOp depthCompareOp{ VK_COMPARE_OP_LESS };
+
+		VkExtent2D extent{}; // Viewport and scissor are baked in
+		VkPipelineLayout layout{ VK_NULL_HANDLE };
+		VkRenderPass renderPass{ VK_NULL_HANDLE };
+		uint32_t subpass{ 0 };
+	};
+
+	// Deduplicates pipelines by a hash of their full state and compiles missing ones on the thread pool,
+	// so the render thread never blocks on vkCreateGraphicsPipelines unless it asks to
+	class PipelineRegistry final {
+	public:
+		PipelineRegistry();
+
+		PipelineRegistry(const PipelineRegistry& other) = delete;
+		PipelineRegistry(PipelineRegistry&& other) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry& other) = delete;
+		PipelineRegistry& operator=(PipelineRegistry&& other) = delete;
+
+		~PipelineRegistry() = default;
+
+		void Initialize(VkDevice device, ShaderCache* pShaderCache, ThreadPool* pThreadPool, bool debug);
+		void Cleanup();
+
+		// Returns the key of the pipeline, queues a compile if it doesn't exist yet (render thread only)
+		uint64_t Request(const PipelineState& state);
+
+		// VK_NULL_HANDLE while compiling, the fallback pipeline is used if it is ready. The fallback has to be
+		// compatible with the draw: same render pass, vertex input and layout
+		VkPipeline Get(uint64_t key, uint64_t fallbackKey = 0) const;
+
+		// Block until the pipeline is compiled, rethrows compile errors
+		VkPipeline Wait(uint64_t key);
+
+		// True if any pipeline finished compiling since the last call. Once a frame: rethrows the error of a compile
+		// that failed, which nobody might ever Wait() on and whose draws would otherwise just never show up
+		bool Poll();
+
+		// Destroy every pipeline, eg. when the render pass they were built for is recreated.
+		// With a deletion queue they're destroyed once the frames still using them retired.
+		// Compile errors nobody collected yet are printed, Clear() also runs during cleanup where throwing doesn't help
+		void Clear(DeletionQueue* pDeletionQueue = nullptr);
+
+		void PrintStats() const;
+
+	private:
+		struct Entry {
+			std::future<void> job;
+			VkPipeline pipeline{ VK_NULL_HANDLE };
+			std::atomic<bool> ready{ false };
+			std::atomic<bool> failed{ false }; // The job holds the exception
+		};
+
+		VkDevice m_Device;
+		bool m_Debug;
+
+		ShaderCache* m_pShaderCache;
+		ThreadPool* m_pThreadPool;
+		VkPipelineCache m_PipelineCache; // Internally synchronized, shared by all workers
+
+		std::unordered_map<uint64_t, std::unique_ptr<Entry>> m_Pipelines;
+
+		std::atomic<uint32_t> m_Completed;
+		uint32_t m_LastPolled;
+		uint32_t m_Requests;
+		uint32_t m_Hits;
+
+		uint64_t Hash(const PipelineState& state);
+		void Compile(const PipelineState& state, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, Entry* pEntry);
+	};
+}
+#endif // PIPELINEREGISTRY_HPP
@@ -0,0 +1,724 @@
+#include "../pch.hpp"
+#include "rendergraph.hpp"
+#include "trace.hpp"
+#include <queue>
+
+namespace vulkat {
+	// Access bits that need to be made available before anything else touches the image
+	static const VkAccessFlags g_WriteAccess{
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+	};
+
+	static bool IsDepthFormat(VkFormat format) {
+		return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT
+			|| format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	static bool HasStencil(VkFormat format) {
+		return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	RenderGraph::RenderGraph()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pGpuProfiler{ nullptr }
+		, m_pMemoryTracker{ nullptr }
+		, m_Debug{ false }
+		, m_Extent{}
+		, m_BarrierCount{ 0 }
+		, m_UnaliasedSize{ 0 }
+	{}
+
+	void RenderGraph::Initialize(VkDevice device, GpuProfiler* pGpuProfiler, MemoryTracker* pMemoryTracker, bool debug) {
+		m_Device = device;
+		m_pGpuProfiler = pGpuProfiler;
+		m_pMemoryTracker = pMemoryTracker;
+		m_Debug = debug;
+	}
+
+	void RenderGraph::Reset(DeletionQueue* pDeletionQueue) {
+		DestroyCompiled(pDeletionQueue);
+
+		m_Passes.clear();
+		m_Resources.clear();
+	}
+
+	// Declaration
+	RenderGraph::Resource RenderGraph::ImportBackbuffer(const std::string& name, VkFormat format, const std::vector<VkImage>& images, const std::vector<VkImageView>& views, VkImageLayout finalLayout) {
+		if (images.empty() || images.size() != views.size()) {
+			throw std::runtime_error("Backbuffer needs one view per image!");
+		}
+
+		ResourceNode resource{};
+		resource.name = name;
+		resource.desc.format = format;
+		resource.imported = true;
+		resource.finalLayout = finalLayout;
+		resource.images = images;
+		resource.views = views;
+
+		m_Resources.push_back(std::move(resource));
+		return Resource(m_Resources.size() - 1);
+	}
+
+	RenderGraph::Resource RenderGraph::CreateImage(const std::string& name, const ImageDesc& desc) {
+		ResourceNode resource{};
+		resource.name = name;
+		resource.desc = desc;
+
+		m_Resources.push_back(std::move(resource));
+		return Resource(m_Resources.size() - 1);
+	}
+
+	RenderGraph::Pass RenderGraph::AddPass(const std::string& name, std::function<void(VkCommandBuffer)> execute) {
+		PassNode pass{};
+		pass.name = name;
+		pass.execute = std::move(execute);
+
+		m_Passes.push_back(std::move(pass));
+		return Pass(m_Passes.size() - 1);
+	}
+
+	RenderGraph::Pass RenderGraph::AddComputePass(const std::string& name, std::function<void(VkCommandBuffer)> execute) {
+		Pass pass{ AddPass(name, std::move(execute)) };
+		m_Passes[pass].compute = true;
+
+		return pass;
+	}
+
+	void RenderGraph::WriteColor(Pass pass, Resource resource, const VkClearColorValue* pClear) {
+		VkClearValue clearValue{};
+		if (pClear) clearValue.color = *pClear;
+
+		AddAccess(pass, resource, AccessType::ColorWrite, pClear != nullptr, clearValue);
+	}
+
+	void RenderGraph::WriteDepth(Pass pass, Resource resource, const VkClearDepthStencilValue* pClear) {
+		VkClearValue clearValue{};
+		if (pClear) clearValue.depthStencil = *pClear;
+
+		AddAccess(pass, resource, AccessType::DepthWrite, pClear != nullptr, clearValue);
+	}
+
+	void RenderGraph::ReadDepth(Pass pass, Resource resource) {
+		AddAccess(pass, resource, AccessType::DepthRead, false, VkClearValue{});
+	}
+
+	void RenderGraph::ReadTexture(Pass pass, Resource resource) {
+		bool compute{ pass < m_Passes.size() && m_Passes[pass].compute };
+		AddAccess(pass, resource, compute ? AccessType::ComputeRead : AccessType::ShaderRead, false, VkClearValue{});
+	}
+
+	void RenderGraph::SetSideEffect(Pass pass) {
+		m_Passes.at(pass).sideEffect = true;
+	}
+
+	void RenderGraph::AddAccess(Pass pass, Resource resource, AccessType type, bool clear, VkClearValue clearValue) {
+		if (pass >= m_Passes.size() || resource >= m_Resources.size()) {
+			throw std::runtime_error("Unknown render graph pass or resource!");
+		}
+
+		if (m_Passes[pass].compute && IsAttachment(type)) {
+			throw std::runtime_error("Compute pass " + m_Passes[pass].name + " can't render to " + m_Resources[resource].name + "!");
+		}
+
+		std::vector<Access>& accesses{ m_Passes[pass].accesses };
+
+		// One access per resource and pass, reading and writing the same image in a pass is a feedback loop
+		for (const auto& access : accesses) {
+			if (access.resource == resource) {
+				throw std::runtime_error("Resource " + m_Resources[resource].name + " used twice in pass " + m_Passes[pass].name + "!");
+			}
+		}
+
+		accesses.push_back(Access{ resource, type, clear, clearValue });
+	}
+
+	// Compilation
+	void RenderGraph::Compile(VkExtent2D extent) {
+		TRACE_SCOPE("CompileRenderGraph");
+
+		DestroyCompiled();
+		m_Extent = extent;
+
+		SortPasses();
+		CullPasses();
+		ComputeLifetimes();
+		CreateImages();
+		BuildPasses();
+
+		if (m_Debug) PrintStats();
+	}
+
+	void RenderGraph::SortPasses() {
+		const size_t passCount{ m_Passes.size() };
+
+		std::vector<std::vector<Pass>> edges(passCount);
+		std::vector<uint32_t> inDegree(passCount, 0);
+
+		auto addEdge = [&](Pass from, Pass to) {
+			if (from == to) return;
+			edges[from].push_back(to);
+			++inDegree[to];
+		};
+
+		// Dependencies per resource, following declaration order:
+		// writes wait on the previous write and on everything that read it (WAR), reads wait on the write before them.
+		// A read declared before any write (eg. the shadow pass added after the pass that samples it) reads the first write
+		for (Resource resource{}; resource < m_Resources.size(); ++resource) {
+			Pass firstWriter{ UINT32_MAX };
+			for (Pass pass{}; pass < passCount && firstWriter == UINT32_MAX; ++pass) {
+				for (const auto& access : m_Passes[pass].accesses) {
+					if (access.resource == resource && IsWrite(access.type)) firstWriter = pass;
+				}
+			}
+
+			Pass lastWriter{ UINT32_MAX };
+			std::vector<Pass> readers{};
+
+			for (Pass pass{}; pass < passCount; ++pass) {
+				for (const auto& access : m_Passes[pass].accesses) {
+					if (access.resource != resource) continue;
+
+					if (IsWrite(access.type)) {
+						if (lastWriter != UINT32_MAX) addEdge(lastWriter, pass);
+						for (Pass reader : readers) addEdge(reader, pass);
+
+						readers.clear();
+						lastWriter = pass;
+					}
+					else if (lastWriter != UINT32_MAX) {
+						addEdge(lastWriter, pass);
+						readers.push_back(pass);
+					}
+					else if (firstWriter != UINT32_MAX) {
+						addEdge(firstWriter, pass);
+					}
+				}
+			}
+		}
+
+		// Kahn's algorithm, the lowest declaration index goes first so independent passes keep their declared order
+		std::priority_queue<Pass, std::vector<Pass>, std::greater<Pass>> ready{};
+		for (Pass pass{}; pass < passCount; ++pass) {
+			if (inDegree[pass] == 0) ready.push(pass);
+		}
+
+		m_Order.clear();
+		while (!ready.empty()) {
+			Pass pass{ ready.top() };
+			ready.pop();
+
+			m_Order.push_back(pass);
+			for (Pass next : edges[pass]) {
+				if (--inDegree[next] == 0) ready.push(next);
+			}
+		}
+
+		if (m_Order.size() != passCount) {
+			throw std::runtime_error("Render graph has a dependency cycle!");
+		}
+	}
+
+	void RenderGraph::CullPasses() {
+		// Walk backwards from the imported resources: a pass lives if it has side effects or writes something a later live pass
+		// (or the outside world) needs. A clear ends the need for earlier contents, so writes that get cleared over are culled too
+		std::vector<bool> needed(m_Resources.size(), false);
+		for (Resource resource{}; resource < m_Resources.size(); ++resource) {
+			needed[resource] = m_Resources[resource].imported;
+		}
+
+		for (auto it = m_Order.rbegin(); it != m_Order.rend(); ++it) {
+			PassNode& pass{ m_Passes[*it] };
+
+			bool live{ pass.sideEffect };
+			for (const auto& access : pass.accesses) {
+				if (IsWrite(access.type) && needed[access.resource]) live = true;
+			}
+
+			pass.culled = !live;
+			if (!live) continue;
+
+			for (const auto& access : pass.accesses) {
+				if (IsWrite(access.type) && access.clear) needed[access.resource] = false;
+			}
+			for (const auto& access : pass.accesses) {
+				if (!IsWrite(access.type) || !access.clear) needed[access.resource] = true; // Reads and loads
+			}
+		}
+
+		m_Order.erase(std::remove_if(m_Order.begin(), m_Order.end(), [this](Pass pass){ return m_Passes[pass].culled; }), m_Order.end());
+	}
+
+	void RenderGraph::ComputeLifetimes() {
+		for (uint32_t i{}; i < m_Order.size(); ++i) {
+			PassNode& pass{ m_Passes[m_Order[i]] };
+
+			for (const auto& access : pass.accesses) {
+				ResourceNode& resource{ m_Resources[access.resource] };
+
+				resource.firstUse = std::min(resource.firstUse, i);
+				resource.lastUse = std::max(resource.lastUse, i);
+
+				bool depthAccess{ access.type == AccessType::DepthWrite || access.type == AccessType::DepthRead };
+				if ((access.type == AccessType::ColorWrite && IsDepthFormat(resource.desc.format)) || (depthAccess && !IsDepthFormat(resource.desc.format))) {
+					throw std::runtime_error("Format of " + resource.name + " doesn't match its use in pass " + pass.name + "!");
+				}
+
+				resource.aspect = IsDepthFormat(resource.desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+				if (HasStencil(resource.desc.format)) resource.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+				switch (access.type) {
+					case AccessType::ColorWrite: resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+					case AccessType::DepthWrite:
+					case AccessType::DepthRead: resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+					case AccessType::ShaderRead:
+					case AccessType::ComputeRead: resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+				}
+
+				if (resource.imported) pass.usesBackbuffer = true;
+			}
+		}
+	}
+
+	void RenderGraph::CreateImages() {
+		std::vector<Resource> transients{};
+
+		for (Resource index{}; index < m_Resources.size(); ++index) {
+			ResourceNode& resource{ m_Resources[index] };
+			if (resource.imported || resource.firstUse == UINT32_MAX) continue; // Only used by culled passes
+
+			VkExtent2D imageExtent{ GetExtent(resource) };
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = resource.desc.format;
+			imageInfo.extent = { imageExtent.width, imageExtent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = resource.usage | resource.desc.usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			VkImage image;
+			if (vkCreateImage(m_Device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create render graph image!");
+			}
+
+			resource.images.push_back(image);
+			vkGetImageMemoryRequirements(m_Device, image, &resource.requirements);
+
+			m_UnaliasedSize += resource.requirements.size;
+			transients.push_back(index);
+		}
+
+		// Largest first, each image goes into the first block whose occupants are all dead before it's first used
+		// (or first used after it's dead). Every image is bound at offset 0, so the block's size is its largest occupant
+		std::sort(transients.begin(), transients.end(), [this](Resource a, Resource b) {
+			return m_Resources[a].requirements.size > m_Resources[b].requirements.size;
+		});
+
+		for (Resource index : transients) {
+			ResourceNode& resource{ m_Resources[index] };
+
+			for (uint32_t block{}; block < m_Blocks.size() && resource.block == UINT32_MAX; ++block) {
+				MemoryBlock& candidate{ m_Blocks[block] };
+				if ((candidate.memoryTypeBits & resource.requirements.memoryTypeBits) == 0) continue;
+
+				bool overlaps{ false };
+				for (Resource other : candidate.resources) {
+					const ResourceNode& occupant{ m_Resources[other] };
+					if (!(resource.lastUse < occupant.firstUse || occupant.lastUse < resource.firstUse)) overlaps = true;
+				}
+
+				if (!overlaps) resource.block = block;
+			}
+
+			if (resource.block == UINT32_MAX) {
+				resource.block = uint32_t(m_Blocks.size());
+				m_Blocks.emplace_back();
+			}
+
+			MemoryBlock& block{ m_Blocks[resource.block] };
+			block.size = std::max(block.size, resource.requirements.size);
+			block.memoryTypeBits &= resource.requirements.memoryTypeBits;
+			block.resources.push_back(index);
+		}
+
+		for (auto& block : m_Blocks) {
+			const VkMemoryRequirements requirements{ block.size, 0, block.memoryTypeBits };
+			block.memory = m_pMemoryTracker->Allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
+
+			for (Resource index : block.resources) {
+				vkBindImageMemory(m_Device, m_Resources[index].images[0], block.memory, 0);
+			}
+		}
+
+		for (Resource index : transients) {
+			ResourceNode& resource{ m_Resources[index] };
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.images[0];
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.desc.format;
+			viewInfo.subresourceRange.aspectMask = resource.aspect;
+			viewInfo.subresourceRange.baseMipLevel = 0;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			VkImageView view;
+			if (vkCreateImageView(m_Device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create render graph image view!");
+			}
+
+			resource.views.push_back(view);
+		}
+	}
+
+	void RenderGraph::BuildPasses() {
+		std::vector<State> states(m_Resources.size());
+
+		// Transient memory is reused by later frames and by aliased images, so a first use waits on every access to its block
+		std::vector<State> blockStates(m_Blocks.size());
+		for (uint32_t i{}; i < m_Order.size(); ++i) {
+			for (const auto& access : m_Passes[m_Order[i]].accesses) {
+				const ResourceNode& resource{ m_Resources[access.resource] };
+				if (resource.block == UINT32_MAX) continue;
+
+				State required{ GetRequiredState(access.type) };
+				blockStates[resource.block].stages |= required.stages;
+				blockStates[resource.block].access |= required.access & g_WriteAccess;
+			}
+		}
+
+		m_BarrierCount = 0;
+
+		for (uint32_t i{}; i < m_Order.size(); ++i) {
+			PassNode& pass{ m_Passes[m_Order[i]] };
+
+			std::vector<VkAttachmentDescription> attachments{};
+			std::vector<VkAttachmentReference> colorRefs{};
+			VkAttachmentReference depthRef{};
+			bool hasDepth{ false };
+			std::vector<Resource> attachmentResources{};
+
+			VkSubpassDependency dependency{};
+			dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+			dependency.dstSubpass = 0;
+
+			pass.extent = m_Extent;
+			bool extentSet{ false };
+
+			for (const auto& access : pass.accesses) {
+				const ResourceNode& resource{ m_Resources[access.resource] };
+				State& state{ states[access.resource] };
+				State required{ GetRequiredState(access.type) };
+
+				State previous{ state };
+				if (resource.firstUse == i) {
+					if (resource.imported) previous.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // Where the acquire semaphore is waited on
+					else previous = State{ VK_IMAGE_LAYOUT_UNDEFINED, blockStates[resource.block].stages, blockStates[resource.block].access };
+				}
+
+				if (IsAttachment(access.type)) {
+					// Transition and synchronization are part of the render pass
+					dependency.srcStageMask |= previous.stages;
+					dependency.srcAccessMask |= previous.access;
+					dependency.dstStageMask |= required.stages;
+					dependency.dstAccessMask |= required.access;
+
+					VkImageLayout finalLayout{ (resource.imported && resource.lastUse == i) ? resource.finalLayout : required.layout };
+					bool keep{ resource.imported || resource.lastUse > i };
+
+					VkAttachmentDescription attachment{};
+					attachment.format = resource.desc.format;
+					attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+					attachment.loadOp = access.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR
+						: previous.layout == VK_IMAGE_LAYOUT_UNDEFINED ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD;
+					attachment.storeOp = keep ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE; // Nobody reads it after this pass
+					attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+					attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+					attachment.initialLayout = previous.layout;
+					attachment.finalLayout = finalLayout;
+
+					VkAttachmentReference reference{ uint32_t(attachments.size()), required.layout };
+					if (access.type == AccessType::ColorWrite) {
+						colorRefs.push_back(reference);
+					}
+					else {
+						if (hasDepth) throw std::runtime_error("Pass " + pass.name + " has more than one depth attachment!");
+						depthRef = reference;
+						hasDepth = true;
+					}
+
+					attachments.push_back(attachment);
+					attachmentResources.push_back(access.resource);
+					pass.clearValues.push_back(access.clearValue);
+
+					VkExtent2D extent{ GetExtent(resource) };
+					if (extentSet && (extent.width != pass.extent.width || extent.height != pass.extent.height)) {
+						throw std::runtime_error("Attachments of pass " + pass.name + " differ in size!");
+					}
+					pass.extent = extent;
+					extentSet = true;
+
+					state = State{ finalLayout, required.stages, required.access & g_WriteAccess };
+				}
+				else {
+					// Sampled: only a layout change or an unflushed write needs a barrier, reads after reads don't
+					if (previous.layout != required.layout || previous.access != 0) {
+						pass.barriers.push_back(Barrier{ access.resource, previous.layout, required.layout, previous.access, required.access });
+						pass.barrierSrcStages |= previous.stages ? previous.stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+						pass.barrierDstStages |= required.stages;
+						++m_BarrierCount;
+
+						state = State{ required.layout, required.stages, 0 };
+					}
+					else {
+						state.stages |= required.stages; // Later writes wait on every reader
+					}
+				}
+			}
+
+			if (pass.compute) continue; // Dispatches only, the barriers are all it needs
+
+			if (dependency.srcStageMask == 0) dependency.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			if (dependency.dstStageMask == 0) dependency.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+			VkSubpassDescription subpass{};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = uint32_t(colorRefs.size());
+			subpass.pColorAttachments = colorRefs.data();
+			subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+			VkRenderPassCreateInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+			renderPassInfo.attachmentCount = uint32_t(attachments.size());
+			renderPassInfo.pAttachments = attachments.data();
+			renderPassInfo.subpassCount = 1;
+			renderPassInfo.pSubpasses = &subpass;
+			renderPassInfo.dependencyCount = 1;
+			renderPassInfo.pDependencies = &dependency;
+
+			if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create render pass!");
+			}
+
+			size_t framebufferCount{ 1 };
+			for (Resource resource : attachmentResources) {
+				if (m_Resources[resource].imported) framebufferCount = m_Resources[resource].views.size();
+			}
+
+			pass.framebuffers.resize(framebufferCount);
+			for (size_t f{}; f < framebufferCount; ++f) {
+				std::vector<VkImageView> views{};
+				for (Resource resource : attachmentResources) {
+					const ResourceNode& node{ m_Resources[resource] };
+					views.push_back(node.views[node.imported ? f : 0]);
+				}
+
+				VkFramebufferCreateInfo framebufferInfo{};
+				framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+				framebufferInfo.renderPass = pass.renderPass;
+				framebufferInfo.attachmentCount = uint32_t(views.size());
+				framebufferInfo.pAttachments = views.data();
+				framebufferInfo.width = pass.extent.width;
+				framebufferInfo.height = pass.extent.height;
+				framebufferInfo.layers = 1;
+
+				if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &pass.framebuffers[f]) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create framebuffer!");
+				}
+			}
+		}
+	}
+
+	void RenderGraph::DestroyCompiled(DeletionQueue* pDeletionQueue) {
+		// Gathered first, so they can be handed to the deletion queue as a whole
+		std::vector<VkFramebuffer> framebuffers;
+		std::vector<VkRenderPass> renderPasses;
+		std::vector<VkImageView> views;
+		std::vector<VkImage> images;
+		std::vector<VkDeviceMemory> memory;
+
+		for (auto& pass : m_Passes) {
+			framebuffers.insert(framebuffers.end(), pass.framebuffers.begin(), pass.framebuffers.end());
+			if (pass.renderPass != VK_NULL_HANDLE) renderPasses.push_back(pass.renderPass);
+
+			pass.culled = false;
+			pass.usesBackbuffer = false;
+			pass.renderPass = VK_NULL_HANDLE;
+			pass.framebuffers.clear();
+			pass.clearValues.clear();
+			pass.barriers.clear();
+			pass.barrierSrcStages = 0;
+			pass.barrierDstStages = 0;
+		}
+
+		for (auto& resource : m_Resources) {
+			if (!resource.imported) {
+				views.insert(views.end(), resource.views.begin(), resource.views.end());
+				images.insert(images.end(), resource.images.begin(), resource.images.end());
+
+				resource.views.clear();
+				resource.images.clear();
+			}
+
+			resource.usage = 0;
+			resource.aspect = 0;
+			resource.firstUse = UINT32_MAX;
+			resource.lastUse = 0;
+			resource.block = UINT32_MAX;
+		}
+
+		for (auto& block : m_Blocks) {
+			memory.push_back(block.memory);
+		}
+
+		auto destroy{ [device = m_Device, pMemoryTracker = m_pMemoryTracker, framebuffers, renderPasses, views, images, memory]{
+			for (auto framebuffer : framebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
+			for (auto renderPass : renderPasses) vkDestroyRenderPass(device, renderPass, nullptr);
+			for (auto view : views) vkDestroyImageView(device, view, nullptr);
+			for (auto image : images) vkDestroyImage(device, image, nullptr);
+			for (auto block : memory) pMemoryTracker->Free(block);
+		} };
+
+		if (pDeletionQueue) pDeletionQueue->Push(std::move(destroy));
+		else destroy();
+
+		m_Blocks.clear();
+		m_Order.clear();
+		m_BarrierCount = 0;
+		m_UnaliasedSize = 0;
+	}
+
+	// Recording
+	void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t profilerSlot) {
+		for (Pass index : m_Order) {
+			PassNode& pass{ m_Passes[index] };
+
+			if (!pass.barriers.empty()) {
+				m_BarrierScratch.clear();
+
+				for (const auto& barrier : pass.barriers) {
+					const ResourceNode& resource{ m_Resources[barrier.resource] };
+
+					VkImageMemoryBarrier imageBarrier{};
+					imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					imageBarrier.srcAccessMask = barrier.srcAccess;
+					imageBarrier.dstAccessMask = barrier.dstAccess;
+					imageBarrier.oldLayout = barrier.oldLayout;
+					imageBarrier.newLayout = barrier.newLayout;
+					imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					imageBarrier.image = resource.images[resource.imported ? imageIndex : 0];
+					imageBarrier.subresourceRange.aspectMask = resource.aspect;
+					imageBarrier.subresourceRange.baseMipLevel = 0;
+					imageBarrier.subresourceRange.levelCount = 1;
+					imageBarrier.subresourceRange.baseArrayLayer = 0;
+					imageBarrier.subresourceRange.layerCount = 1;
+
+					m_BarrierScratch.push_back(imageBarrier);
+				}
+
+				vkCmdPipelineBarrier(commandBuffer, pass.barrierSrcStages, pass.barrierDstStages, 0,
+					0, nullptr, 0, nullptr, uint32_t(m_BarrierScratch.size()), m_BarrierScratch.data());
+			}
+
+			uint32_t profilerPass{ m_pGpuProfiler ? m_pGpuProfiler->BeginPass(commandBuffer, profilerSlot, pass.name.c_str()) : 0 };
+
+			if (pass.compute) {
+				if (pass.execute) pass.execute(commandBuffer);
+				if (m_pGpuProfiler) m_pGpuProfiler->EndPass(commandBuffer, profilerSlot, profilerPass);
+				continue;
+			}
+
+			VkRenderPassBeginInfo renderPassBeginInfo{};
+			renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassBeginInfo.renderPass = pass.renderPass;
+			renderPassBeginInfo.framebuffer = pass.framebuffers[pass.framebuffers.size() > 1 ? imageIndex : 0];
+			renderPassBeginInfo.renderArea.offset = { 0, 0 };
+			renderPassBeginInfo.renderArea.extent = pass.extent;
+			renderPassBeginInfo.clearValueCount = uint32_t(pass.clearValues.size());
+			renderPassBeginInfo.pClearValues = pass.clearValues.data();
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			if (pass.execute) pass.execute(commandBuffer);
+			vkCmdEndRenderPass(commandBuffer);
+
+			if (m_pGpuProfiler) m_pGpuProfiler->EndPass(commandBuffer, profilerSlot, profilerPass);
+		}
+	}
+
+	VkRenderPass RenderGraph::GetRenderPass(Pass pass) const {
+		return m_Passes.at(pass).renderPass; // VK_NULL_HANDLE when culled or compute
+	}
+
+	VkImageView RenderGraph::GetImageView(Resource resource, uint32_t imageIndex) const {
+		const ResourceNode& node{ m_Resources.at(resource) };
+		if (node.views.empty()) return VK_NULL_HANDLE;
+
+		return node.views[node.imported ? imageIndex : 0];
+	}
+
+	bool RenderGraph::IsCulled(Pass pass) const {
+		return m_Passes.at(pass).culled;
+	}
+
+	void RenderGraph::PrintStats() const {
+		VkDeviceSize aliasedSize{ 0 };
+		for (const auto& block : m_Blocks) {
+			aliasedSize += block.size;
+		}
+
+		std::cout << "Render graph: " << m_Order.size() << "/" << m_Passes.size() << " passes, "
+			<< m_BarrierCount << " barriers, transient memory " << aliasedSize / 1024 << " KiB in " << m_Blocks.size()
+			<< " blocks (" << m_UnaliasedSize / 1024 << " KiB without aliasing)\n";
+
+		for (Pass index : m_Order) {
+			std::cout << "\t" << m_Passes[index].name << "\n";
+		}
+		for (const auto& pass : m_Passes) {
+			if (pass.culled) std::cout << "\t" << pass.name << " (culled)\n";
+		}
+	}
+
+	// Helpers
+	VkExtent2D RenderGraph::GetExtent(const ResourceNode& resource) const {
+		if (resource.imported || resource.desc.extent.width == 0 || resource.desc.extent.height == 0) return m_Extent;
+		return resource.desc.extent;
+	}
+
+	RenderGraph::State RenderGraph::GetRequiredState(AccessType type) {
+		const VkPipelineStageFlags fragmentTests{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT };
+
+		switch (type) {
+			case AccessType::ColorWrite:
+				return State{ VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT };
+			case AccessType::DepthWrite:
+				return State{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, fragmentTests,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+			case AccessType::DepthRead:
+				return State{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT };
+			case AccessType::ShaderRead:
+				return State{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+			case AccessType::ComputeRead:
+				return State{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+		}
+
+		return State{};
+	}
+
+	bool RenderGraph::IsWrite(AccessType type) {
+		return type == AccessType::ColorWrite || type == AccessType::DepthWrite;
+	}
+
+	bool RenderGraph::IsAttachment(AccessType type) {
+		return type != AccessType::ShaderRead && type != AccessType::ComputeRead;
+	}
+}
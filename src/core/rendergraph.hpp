@@ -0,0 +1,171 @@
+#ifndef RENDERGRAPH_HPP
+#define RENDERGRAPH_HPP
+
+#include <functional>
+
+#include "gpuprofiler.hpp"
+#include "deletionqueue.hpp"
+#include "memorytracker.hpp"
+
+namespace vulkat {
+	// Passes declare the images they read and write, Compile() then:
+	// - orders them by their dependencies (declaration order breaks ties) and culls passes nothing consumes
+	// - builds one VkRenderPass per pass, attachment layout transitions are folded into the render pass
+	//   and synchronized with its external subpass dependency, only sampled reads get a pipeline barrier
+	// - compute passes get no render pass, just the barriers for the images they sample
+	// - places transient images whose lifetimes don't overlap in the same VkDeviceMemory
+	class RenderGraph final {
+	public:
+		using Resource = uint32_t;
+		using Pass = uint32_t;
+
+		struct ImageDesc {
+			VkFormat format{ VK_FORMAT_UNDEFINED };
+			VkExtent2D extent{}; // 0x0 follows the extent passed to Compile()
+			VkImageUsageFlags usage{ 0 }; // On top of the usage implied by the passes
+		};
+
+		RenderGraph();
+
+		RenderGraph(const RenderGraph& other) = delete;
+		RenderGraph(RenderGraph&& other) = delete;
+		RenderGraph& operator=(const RenderGraph& other) = delete;
+		RenderGraph& operator=(RenderGraph&& other) = delete;
+
+		~RenderGraph() = default;
+
+		void Initialize(VkDevice device, GpuProfiler* pGpuProfiler, MemoryTracker* pMemoryTracker, bool debug);
+
+		// Destroys everything Compile() created and forgets all passes and resources.
+		// With a deletion queue the Vulkan objects outlive the frames still using them
+		void Reset(DeletionQueue* pDeletionQueue = nullptr);
+
+		// Declaration
+		Resource ImportBackbuffer(const std::string& name, VkFormat format, const std::vector<VkImage>& images, const std::vector<VkImageView>& views, VkImageLayout finalLayout);
+		Resource CreateImage(const std::string& name, const ImageDesc& desc);
+
+		Pass AddPass(const std::string& name, std::function<void(VkCommandBuffer)> execute);
+		Pass AddComputePass(const std::string& name, std::function<void(VkCommandBuffer)> execute); // Only reads textures, needs a side effect to live
+		void WriteColor(Pass pass, Resource resource, const VkClearColorValue* pClear = nullptr); // nullptr: keep contents
+		void WriteDepth(Pass pass, Resource resource, const VkClearDepthStencilValue* pClear = nullptr);
+		void ReadDepth(Pass pass, Resource resource); // Depth test without writes
+		void ReadTexture(Pass pass, Resource resource); // Sampled in the fragment shader, or the compute shader of a compute pass
+		void SetSideEffect(Pass pass); // Never culled
+
+		void Compile(VkExtent2D extent);
+
+		// Records every live pass, imageIndex picks the backbuffer, slot is passed on to the GPU profiler
+		void Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t profilerSlot);
+
+		VkRenderPass GetRenderPass(Pass pass) const;
+		VkImageView GetImageView(Resource resource, uint32_t imageIndex = 0) const;
+		bool IsCulled(Pass pass) const;
+
+		void PrintStats() const;
+
+	private:
+		enum class AccessType {
+			ColorWrite,
+			DepthWrite,
+			DepthRead,
+			ShaderRead,
+			ComputeRead
+		};
+
+		struct Access {
+			Resource resource;
+			AccessType type;
+			bool clear;
+			VkClearValue clearValue;
+		};
+
+		// Layout, stages and access mask a resource was last used with
+		struct State {
+			VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			VkPipelineStageFlags stages{ 0 };
+			VkAccessFlags access{ 0 };
+		};
+
+		struct Barrier {
+			Resource resource;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			VkAccessFlags srcAccess;
+			VkAccessFlags dstAccess;
+		};
+
+		struct PassNode {
+			std::string name;
+			std::function<void(VkCommandBuffer)> execute;
+			std::vector<Access> accesses;
+			bool sideEffect{ false };
+			bool compute{ false };
+
+			// Compiled
+			bool culled{ false };
+			bool usesBackbuffer{ false };
+			VkRenderPass renderPass{ VK_NULL_HANDLE }; // None for compute passes
+			std::vector<VkFramebuffer> framebuffers{}; // One per backbuffer image if it renders to it, else one
+			std::vector<VkClearValue> clearValues{};
+			VkExtent2D extent{};
+			std::vector<Barrier> barriers{}; // Recorded before the render pass
+			VkPipelineStageFlags barrierSrcStages{ 0 };
+			VkPipelineStageFlags barrierDstStages{ 0 };
+		};
+
+		struct ResourceNode {
+			std::string name;
+			ImageDesc desc;
+			bool imported{ false };
+			VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED }; // Imported only
+			std::vector<VkImage> images{}; // Imported: one per backbuffer image
+			std::vector<VkImageView> views{};
+
+			// Compiled
+			VkImageUsageFlags usage{ 0 };
+			VkImageAspectFlags aspect{ 0 };
+			uint32_t firstUse{ UINT32_MAX }; // Index into m_Order
+			uint32_t lastUse{ 0 };
+			uint32_t block{ UINT32_MAX };
+			VkMemoryRequirements requirements{};
+		};
+
+		// Transient images sharing one allocation
+		struct MemoryBlock {
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			VkDeviceSize size{ 0 };
+			uint32_t memoryTypeBits{ ~0u };
+			std::vector<Resource> resources{};
+		};
+
+		VkDevice m_Device;
+		GpuProfiler* m_pGpuProfiler;
+		MemoryTracker* m_pMemoryTracker; // Transient attachment memory is counted as render targets
+		bool m_Debug;
+
+		std::vector<PassNode> m_Passes;
+		std::vector<ResourceNode> m_Resources;
+		std::vector<Pass> m_Order; // Live passes in execution order
+		std::vector<MemoryBlock> m_Blocks;
+		VkExtent2D m_Extent; // Of the last Compile()
+
+		std::vector<VkImageMemoryBarrier> m_BarrierScratch; // Reused by Execute()
+		uint32_t m_BarrierCount;
+		VkDeviceSize m_UnaliasedSize;
+
+		void AddAccess(Pass pass, Resource resource, AccessType type, bool clear, VkClearValue clearValue);
+
+		void SortPasses();
+		void CullPasses();
+		void ComputeLifetimes();
+		void CreateImages();
+		void BuildPasses();
+		void DestroyCompiled(DeletionQueue* pDeletionQueue = nullptr);
+
+		VkExtent2D GetExtent(const ResourceNode& resource) const;
+		static State GetRequiredState(AccessType type);
+		static bool IsWrite(AccessType type);
+		static bool IsAttachment(AccessType type);
+	};
+}
+#endif // RENDERGRAPH_HPP
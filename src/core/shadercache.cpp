@@ -0,0 +1,219 @@
+#include "../pch.hpp"
+#include "shadercache.hpp"
+#include "hash.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+namespace vulkat {
+	constexpr uint32_t g_SpirvMagic{ 0x07230203 };
+
+#ifdef VULKAT_EMBED_SHADERS
+	// Generated by `make -C src/shaders embed` (glslc -mfmt=num)
+	alignas(16) constexpr uint32_t g_VertSpv[]{
+#include "vert.inc"
+	};
+	alignas(16) constexpr uint32_t g_FragSpv[]{
+#include "frag.inc"
+	};
+	alignas(16) constexpr uint32_t g_ParticleVertSpv[]{
+#include "particle_vert.inc"
+	};
+	alignas(16) constexpr uint32_t g_ParticleCompSpv[]{
+#include "particle_comp.inc"
+	};
+	alignas(16) constexpr uint32_t g_HizCompSpv[]{
+#include "hiz_comp.inc"
+	};
+	alignas(16) constexpr uint32_t g_CullCompSpv[]{
+#include "cull_comp.inc"
+	};
+	alignas(16) constexpr uint32_t g_LitFragSpv[]{
+#include "lit_frag.inc"
+	};
+	alignas(16) constexpr uint32_t g_LightCompSpv[]{
+#include "light_comp.inc"
+	};
+	alignas(16) constexpr uint32_t g_LitShadowFragSpv[]{
+#include "lit_shadow_frag.inc"
+	};
+	alignas(16) constexpr uint32_t g_ShadowVertSpv[]{
+#include "shadow_vert.inc"
+	};
+
+	struct EmbeddedShader {
+		const char* name;
+		const uint32_t* code;
+		size_t size;
+	};
+
+	constexpr EmbeddedShader g_EmbeddedShaders[]{
+		{ "vert.spv", g_VertSpv, sizeof(g_VertSpv) },
+		{ "frag.spv", g_FragSpv, sizeof(g_FragSpv) },
+		{ "particle_vert.spv", g_ParticleVertSpv, sizeof(g_ParticleVertSpv) },
+		{ "particle_comp.spv", g_ParticleCompSpv, sizeof(g_ParticleCompSpv) },
+		{ "hiz_comp.spv", g_HizCompSpv, sizeof(g_HizCompSpv) },
+		{ "cull_comp.spv", g_CullCompSpv, sizeof(g_CullCompSpv) },
+		{ "lit_frag.spv", g_LitFragSpv, sizeof(g_LitFragSpv) },
+		{ "light_comp.spv", g_LightCompSpv, sizeof(g_LightCompSpv) },
+		{ "lit_shadow_frag.spv", g_LitShadowFragSpv, sizeof(g_LitShadowFragSpv) },
+		{ "shadow_vert.spv", g_ShadowVertSpv, sizeof(g_ShadowVertSpv) },
+	};
+#endif
+
+	MappedFile::MappedFile(const std::string& filename)
+		: m_pData{ nullptr }
+		, m_Size{ 0 }
+	{
+		int fd{ open(filename.c_str(), O_RDONLY) };
+		if (fd < 0) {
+			throw std::runtime_error("Failed to open file: " + filename + "!");
+		}
+
+		struct stat fileStat{};
+		if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+			close(fd);
+			throw std::runtime_error("Failed to stat file: " + filename + "!");
+		}
+
+		m_Size = size_t(fileStat.st_size);
+		m_pData = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // The mapping stays valid after closing the descriptor
+
+		if (m_pData == MAP_FAILED) {
+			m_pData = nullptr;
+			throw std::runtime_error("Failed to map file: " + filename + "!");
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		if (m_pData) munmap(m_pData, m_Size);
+	}
+
+	ShaderCache::ShaderCache()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_Debug{ false }
+	{}
+
+	void ShaderCache::Initialize(VkDevice device, bool debug) {
+		m_Device = device;
+		m_Debug = debug;
+	}
+
+	void ShaderCache::Cleanup() {
+		for (auto& module : m_Modules) {
+			vkDestroyShaderModule(m_Device, module.second, nullptr);
+		}
+
+		m_Modules.clear();
+		m_Paths.clear();
+	}
+
+	VkShaderModule ShaderCache::Get(const std::string& path) {
+		return Load(path).module;
+	}
+
+	uint64_t ShaderCache::GetHash(const std::string& path) {
+		return Load(path).hash;
+	}
+
+	const ShaderCache::Entry& ShaderCache::Load(const std::string& path) {
+		auto it = m_Paths.find(path);
+		if (it != m_Paths.end()) {
+			return it->second;
+		}
+
+		Entry entry{};
+
+#ifdef VULKAT_EMBED_SHADERS
+		const std::string name{ path.substr(path.find_last_of('/') + 1) };
+		for (const auto& shader : g_EmbeddedShaders) {
+			if (name == shader.name) {
+				entry.hash = HashBytes(shader.code, shader.size);
+				entry.module = CreateShaderModule(shader.code, shader.size, entry.hash);
+				if (m_Debug) std::cout << "Shader " << name << " loaded from binary.\n";
+
+				return m_Paths.emplace(path, entry).first->second;
+			}
+		}
+#endif
+
+		const std::string filename{ ResolvePath(path) };
+		MappedFile file{ filename };
+
+		// mmap is page aligned, so the words can be handed to Vulkan as is
+		entry.hash = HashBytes(file.Data(), file.Size());
+		entry.module = CreateShaderModule(static_cast<const uint32_t*>(file.Data()), file.Size(), entry.hash);
+		if (m_Debug) std::cout << "File " << filename << " read correctly.\n";
+
+		return m_Paths.emplace(path, entry).first->second;
+	}
+
+	VkShaderModule ShaderCache::CreateShaderModule(const uint32_t* code, size_t size, uint64_t hash) {
+		// Same bytecode under another path, reuse the module
+		auto it = m_Modules.find(hash);
+		if (it != m_Modules.end()) {
+			return it->second;
+		}
+
+		if (size % sizeof(uint32_t) != 0 || code[0] != g_SpirvMagic) {
+			throw std::runtime_error("Shader is not valid SPIR-V!");
+		}
+
+		VkShaderModuleCreateInfo createInfo{};
+
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = size;
+		createInfo.pCode = code;
+
+		VkShaderModule shaderModule;
+		if (vkCreateShaderModule(m_Device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shader module!");
+		}
+
+		m_Modules.emplace(hash, shaderModule);
+
+		return shaderModule;
+	}
+
+	std::string ShaderCache::ResolvePath(const std::string& path) {
+		// Relative to the working directory (running from the repo root)
+		if (access(path.c_str(), R_OK) == 0) {
+			return path;
+		}
+
+		// Relative to the executable, which lives in build/
+		const std::string buildPrefix{ "build/" };
+		std::string relative{ path };
+		if (relative.compare(0, buildPrefix.size(), buildPrefix) == 0) {
+			relative = relative.substr(buildPrefix.size());
+		}
+
+		std::string candidate{ GetExecutableDir() + relative };
+		if (access(candidate.c_str(), R_OK) == 0) {
+			return candidate;
+		}
+
+		return path; // Let MappedFile report the original path
+	}
+
+	std::string ShaderCache::GetExecutableDir() {
+		char buffer[4096]{};
+
+#ifdef __APPLE__
+		uint32_t size{ sizeof(buffer) };
+		if (_NSGetExecutablePath(buffer, &size) != 0) return "";
+#else
+		ssize_t length{ readlink("/proc/self/exe", buffer, sizeof(buffer) - 1) };
+		if (length <= 0) return "";
+#endif
+
+		std::string exePath{ buffer };
+		return exePath.substr(0, exePath.find_last_of('/') + 1);
+	}
+}
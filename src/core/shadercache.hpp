@@ -0,0 +1,67 @@
+#ifndef SHADERCACHE_HPP
+#define SHADERCACHE_HPP
+
+#include <unordered_map>
+
+namespace vulkat {
+	// Read only memory mapping of a file, unmapped when it goes out of scope
+	class MappedFile final {
+	public:
+		explicit MappedFile(const std::string& filename);
+
+		MappedFile(const MappedFile& other) = delete;
+		MappedFile(MappedFile&& other) = delete;
+		MappedFile& operator=(const MappedFile& other) = delete;
+		MappedFile& operator=(MappedFile&& other) = delete;
+
+		~MappedFile();
+
+		const void* Data() const { return m_pData; }
+		size_t Size() const { return m_Size; }
+
+	private:
+		void* m_pData;
+		size_t m_Size;
+	};
+
+	// Owns every VkShaderModule, so pipelines can be rebuilt (eg. on swapchain recreation)
+	// without reading or compiling SPIR-V again.
+	// Shaders are looked up in the binary first (make EMBED_SHADERS=1), then mmapped from disk.
+	class ShaderCache final {
+	public:
+		ShaderCache();
+
+		ShaderCache(const ShaderCache& other) = delete;
+		ShaderCache(ShaderCache&& other) = delete;
+		ShaderCache& operator=(const ShaderCache& other) = delete;
+		ShaderCache& operator=(ShaderCache&& other) = delete;
+
+		~ShaderCache() = default;
+
+		void Initialize(VkDevice device, bool debug);
+		void Cleanup();
+
+		// Path as given by SHADER(name), relative to the working directory or the executable
+		VkShaderModule Get(const std::string& path);
+		uint64_t GetHash(const std::string& path);
+
+	private:
+		struct Entry {
+			uint64_t hash;
+			VkShaderModule module;
+		};
+
+		VkDevice m_Device;
+		bool m_Debug;
+
+		std::unordered_map<std::string, Entry> m_Paths; // Path -> module, skips the file lookup entirely
+		std::unordered_map<uint64_t, VkShaderModule> m_Modules; // Content hash -> module, dedups identical SPIR-V
+
+		const Entry& Load(const std::string& path);
+		VkShaderModule CreateShaderModule(const uint32_t* code, size_t size, uint64_t hash);
+
+		static std::string ResolvePath(const std::string& path);
+		static std::string GetExecutableDir();
+	};
+}
+#endif // SHADERCACHE_HPP
@@ -0,0 +1,490 @@
+#include "../pch.hpp"
+#include "shadowcascades.hpp"
+#include "trace.hpp"
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace vulkat {
+	ShadowCascades::ShadowCascades()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_pMemoryTracker{ nullptr }
+		, m_Debug{ false }
+		, m_LightDirection{ 0.f }
+		, m_LightView{ 1.f }
+		, m_Cascades{}
+		, m_Splits{}
+		, m_UniformsDirty{ true }
+		, m_Image{ VK_NULL_HANDLE }
+		, m_ImageMemory{ VK_NULL_HANDLE }
+		, m_ArrayView{ VK_NULL_HANDLE }
+		, m_LayerViews{}
+		, m_RenderPass{ VK_NULL_HANDLE }
+		, m_Framebuffers{}
+		, m_Sampler{ VK_NULL_HANDLE }
+		, m_UniformBuffer{ VK_NULL_HANDLE }
+		, m_UniformMemory{ VK_NULL_HANDLE }
+		, m_SetLayout{ VK_NULL_HANDLE }
+		, m_DescriptorPool{ VK_NULL_HANDLE }
+		, m_DescriptorSet{ VK_NULL_HANDLE }
+		, m_PipelineLayout{ VK_NULL_HANDLE }
+		, m_RenderedCount{ 0 }
+	{}
+
+	void ShadowCascades::Initialize(VkDevice device, MemoryTracker* pMemoryTracker,
+		const std::string& vertexShader, bool debug) {
+		m_Device = device;
+		m_pMemoryTracker = pMemoryTracker;
+		m_VertexShader = vertexShader;
+		m_Debug = debug;
+
+		CreateImage();
+		CreateRenderPass();
+		CreateDescriptors();
+
+		// Low sun from the top left, into the screen
+		SetLightDirection(glm::vec3{ 0.4f, 0.6f, 1.f });
+
+		if (m_Debug) {
+			std::cout << m_CascadeCount << " shadow cascades of " << m_Resolution << "x" << m_Resolution << ", splits at";
+			for (float split : m_Splits) std::cout << ' ' << split;
+			std::cout << '\n';
+		}
+	}
+
+	void ShadowCascades::Cleanup() {
+		vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+		vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr); // Frees the set with it
+		vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, nullptr);
+		vkDestroySampler(m_Device, m_Sampler, nullptr);
+
+		vkDestroyBuffer(m_Device, m_UniformBuffer, nullptr);
+		m_pMemoryTracker->Free(m_UniformMemory);
+
+		for (auto framebuffer : m_Framebuffers) vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
+		vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+
+		for (auto view : m_LayerViews) vkDestroyImageView(m_Device, view, nullptr);
+		vkDestroyImageView(m_Device, m_ArrayView, nullptr);
+		vkDestroyImage(m_Device, m_Image, nullptr);
+		m_pMemoryTracker->Free(m_ImageMemory);
+
+		m_Framebuffers.fill(VK_NULL_HANDLE);
+		m_LayerViews.fill(VK_NULL_HANDLE);
+		m_DescriptorPool = VK_NULL_HANDLE;
+		m_Casters.clear();
+		m_DynamicCasters.clear();
+	}
+
+	void ShadowCascades::SetLightDirection(const glm::vec3& direction) {
+		glm::vec3 normalized{ glm::normalize(direction) };
+		if (normalized == m_LightDirection) return;
+		m_LightDirection = normalized;
+
+		// Looking down the light, any up that isn't parallel to it will do
+		glm::vec3 up{ std::abs(m_LightDirection.y) > 0.99f ? glm::vec3{ 1.f, 0.f, 0.f } : glm::vec3{ 0.f, 1.f, 0.f } };
+		m_LightView = glm::lookAt(glm::vec3{ 0.f }, m_LightDirection, up);
+
+		for (auto& caster : m_Casters) caster.lightBounds = GetLightBounds(caster.boundsMin, caster.boundsMax);
+
+		FitCascades();
+	}
+
+	void ShadowCascades::SetCasterCount(uint32_t count) {
+		// Removed static casters leave their shadow behind in the cached cascades
+		for (uint32_t i{ count }; i < m_Casters.size(); ++i) {
+			if (!m_Casters[i].dynamic && m_Casters[i].draw.indexCount > 0) MarkDirty(m_Casters[i].lightBounds);
+		}
+
+		m_Casters.resize(count, Caster{});
+		m_DynamicCasters.erase(std::remove_if(m_DynamicCasters.begin(), m_DynamicCasters.end(), [count](uint32_t index) { return index >= count; }),
+			m_DynamicCasters.end());
+	}
+
+	void ShadowCascades::SetCaster(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const VkDrawIndexedIndirectCommand& draw, bool dynamic) {
+		Caster& caster{ m_Casters.at(index) };
+
+		const bool changed{ caster.boundsMin != boundsMin || caster.boundsMax != boundsMax || caster.dynamic != dynamic
+			|| memcmp(&caster.draw, &draw, sizeof(VkDrawIndexedIndirectCommand)) != 0 };
+		if (!changed) return;
+
+		// A static caster changing is the only thing that invalidates a cascade of static geometry, where it was and where it is now
+		if (!caster.dynamic && caster.draw.indexCount > 0) MarkDirty(caster.lightBounds);
+
+		if (dynamic && !caster.dynamic) m_DynamicCasters.push_back(index);
+		else if (!dynamic && caster.dynamic) m_DynamicCasters.erase(std::find(m_DynamicCasters.begin(), m_DynamicCasters.end(), index));
+
+		caster.boundsMin = boundsMin;
+		caster.boundsMax = boundsMax;
+		caster.draw = draw;
+		caster.dynamic = dynamic;
+		caster.lightBounds = GetLightBounds(boundsMin, boundsMax);
+
+		if (!dynamic && draw.indexCount > 0) MarkDirty(caster.lightBounds);
+	}
+
+	PipelineState ShadowCascades::GetPipelineState(const PipelineState& mainState) const {
+		PipelineState state{ mainState };
+
+		// Same vertex input, the cascade's matrix on top
+		state.vertexShader = m_VertexShader;
+		state.fragmentShader.clear();
+		state.colorAttachmentCount = 0;
+		state.blendEnable = false;
+
+		// Seen from the light the quads face either way
+		state.cullMode = VK_CULL_MODE_NONE;
+
+		state.depthTest = true;
+		state.depthWrite = true;
+		state.depthCompareOp = VK_COMPARE_OP_LESS;
+
+		state.extent = { m_Resolution, m_Resolution };
+		state.layout = m_PipelineLayout;
+		state.renderPass = m_RenderPass;
+		state.subpass = 0;
+
+		return state;
+	}
+
+	void ShadowCascades::Record(VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+		TRACE_SCOPE("RecordShadows");
+
+		m_RenderedCount = 0;
+		if (pipeline == VK_NULL_HANDLE) return; // Everything stays dirty until it's ready
+
+		// Dynamic casters may have moved, whatever cascade they touch can't be cached
+		for (uint32_t index : m_DynamicCasters) MarkDirty(m_Casters[index].lightBounds);
+
+		if (m_UniformsDirty) {
+			Uniforms uniforms{};
+			for (uint32_t i{}; i < m_CascadeCount; ++i) {
+				uniforms.viewProjection[i] = m_Cascades[i].viewProjection;
+				uniforms.splits[i] = m_Splits[i];
+			}
+			uniforms.params = glm::vec4{ m_DepthBias, 1.f / float(m_Resolution), m_SunIntensity, 0.f };
+
+			// Inline in the command buffer, so frames still in flight keep reading what they were recorded with
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+			vkCmdUpdateBuffer(commandBuffer, m_UniformBuffer, 0, sizeof(Uniforms), &uniforms);
+
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			m_UniformsDirty = false;
+		}
+
+		VkClearValue clearValue{};
+		clearValue.depthStencil = { 1.f, 0 };
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = m_RenderPass;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = { m_Resolution, m_Resolution };
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearValue;
+
+		for (uint32_t i{}; i < m_CascadeCount; ++i) {
+			Cascade& cascade{ m_Cascades[i] };
+			if (!cascade.dirty) continue;
+
+			renderPassInfo.framebuffer = m_Framebuffers[i];
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &cascade.viewProjection);
+
+			for (const auto& caster : m_Casters) {
+				const glm::vec4& bounds{ caster.lightBounds };
+				if (caster.draw.indexCount == 0) continue;
+				if (bounds.z < cascade.bounds.x || bounds.x > cascade.bounds.z || bounds.w < cascade.bounds.y || bounds.y > cascade.bounds.w) continue;
+
+				vkCmdDrawIndexed(commandBuffer, caster.draw.indexCount, caster.draw.instanceCount, caster.draw.firstIndex, caster.draw.vertexOffset, caster.draw.firstInstance);
+			}
+
+			vkCmdEndRenderPass(commandBuffer);
+
+			cascade.dirty = false;
+			++m_RenderedCount;
+		}
+	}
+
+	void ShadowCascades::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &m_DescriptorSet, 0, nullptr);
+	}
+
+	void ShadowCascades::PrintStats(std::ostream& os) const {
+		os << "Shadows " << m_RenderedCount << "/" << m_CascadeCount << " cascades rendered";
+	}
+
+	// Cascades
+	void ShadowCascades::FitCascades() {
+		float previous{ 0.f };
+		for (uint32_t i{}; i < m_CascadeCount; ++i) {
+			// Practical split scheme over view depth, which is NDC depth [0, 1] until there is a camera
+			float fraction{ float(i + 1) / float(m_CascadeCount) };
+			float logarithmic{ m_SplitNear * std::pow(1.f / m_SplitNear, fraction) };
+			m_Splits[i] = m_SplitLambda * logarithmic + (1.f - m_SplitLambda) * fraction;
+
+			// Bounding sphere of the slice, rounded up so its size doesn't change as the view turns
+			glm::vec3 corners[8]{};
+			glm::vec3 center{ 0.f };
+			for (uint32_t corner{}; corner < 8; ++corner) {
+				corners[corner] = glm::vec3{ corner & 1 ? 1.f : -1.f, corner & 2 ? 1.f : -1.f, corner & 4 ? m_Splits[i] : previous };
+				center += corners[corner] / 8.f;
+			}
+
+			float radius{ 0.f };
+			for (const auto& corner : corners) radius = std::max(radius, glm::length(corner - center));
+			radius = std::ceil(radius * 16.f) / 16.f;
+
+			// Move the projection in whole texels only, so the rasterized casters don't shimmer
+			glm::vec3 lightCenter{ m_LightView * glm::vec4{ center, 1.f } };
+			const float texelSize{ 2.f * radius / float(m_Resolution) };
+			lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+			lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+			// Looking down -z, casters up to m_CasterDistance toward the light still get rendered
+			glm::mat4 projection{ glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+				-lightCenter.z - m_CasterDistance, -lightCenter.z + radius) };
+
+			m_Cascades[i].viewProjection = projection * m_LightView;
+			m_Cascades[i].bounds = glm::vec4{ lightCenter.x - radius, lightCenter.y - radius, lightCenter.x + radius, lightCenter.y + radius };
+			m_Cascades[i].dirty = true;
+
+			previous = m_Splits[i];
+		}
+
+		m_UniformsDirty = true;
+	}
+
+	glm::vec4 ShadowCascades::GetLightBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+		glm::vec2 lightMin{};
+		glm::vec2 lightMax{};
+
+		for (uint32_t corner{}; corner < 8; ++corner) {
+			glm::vec3 position{ corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z };
+			glm::vec3 lightPosition{ m_LightView * glm::vec4{ position, 1.f } };
+			glm::vec2 projected{ lightPosition.x, lightPosition.y };
+
+			lightMin = corner == 0 ? projected : glm::min(lightMin, projected);
+			lightMax = corner == 0 ? projected : glm::max(lightMax, projected);
+		}
+
+		return glm::vec4{ lightMin.x, lightMin.y, lightMax.x, lightMax.y };
+	}
+
+	void ShadowCascades::MarkDirty(const glm::vec4& lightBounds) {
+		for (auto& cascade : m_Cascades) {
+			if (lightBounds.z < cascade.bounds.x || lightBounds.x > cascade.bounds.z || lightBounds.w < cascade.bounds.y || lightBounds.y > cascade.bounds.w) continue;
+			cascade.dirty = true;
+		}
+	}
+
+	// Resources
+	void ShadowCascades::CreateImage() {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_Format;
+		imageInfo.extent = { m_Resolution, m_Resolution, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = m_CascadeCount;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_Device, &imageInfo, nullptr, &m_Image) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow map!");
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(m_Device, m_Image, &requirements);
+		m_ImageMemory = m_pMemoryTracker->Allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget);
+		vkBindImageMemory(m_Device, m_Image, m_ImageMemory, 0);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_Image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.format = m_Format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, m_CascadeCount };
+
+		if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_ArrayView) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow map view!");
+		}
+
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		for (uint32_t i{}; i < m_CascadeCount; ++i) {
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1 };
+
+			if (vkCreateImageView(m_Device, &viewInfo, nullptr, &m_LayerViews[i]) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create shadow map view!");
+			}
+		}
+
+		// Compares against the reference depth, outside the map is lit
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		samplerInfo.compareEnable = VK_TRUE;
+		samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		if (vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow sampler!");
+		}
+	}
+
+	void ShadowCascades::CreateRenderPass() {
+		// Cleared and rendered whole or not at all, so the old contents never matter
+		VkAttachmentDescription depthAttachment{};
+		depthAttachment.format = m_Format;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference depthReference{ 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		// Last frame's main pass sampled the layer, the next main pass samples it
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &depthAttachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = uint32_t(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow render pass!");
+		}
+
+		for (uint32_t i{}; i < m_CascadeCount; ++i) {
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = m_RenderPass;
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &m_LayerViews[i];
+			framebufferInfo.width = m_Resolution;
+			framebufferInfo.height = m_Resolution;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_Framebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create shadow framebuffer!");
+			}
+		}
+	}
+
+	void ShadowCascades::CreateDescriptors() {
+		m_UniformBuffer = m_pMemoryTracker->CreateBuffer(sizeof(Uniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, m_UniformMemory);
+
+		// lit.frag: 0 shadow map, 1 cascades
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		bindings[0] = { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+		bindings[1] = { 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = uint32_t(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_SetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow descriptor set layout!");
+		}
+
+		std::array<VkDescriptorPoolSize, 2> poolSizes{ {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+		} };
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = uint32_t(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = m_DescriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &m_SetLayout;
+
+		if (vkAllocateDescriptorSets(m_Device, &allocateInfo, &m_DescriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate shadow descriptor set!");
+		}
+
+		// Nothing here is ever replaced, so the set is written once
+		VkDescriptorImageInfo imageInfo{ m_Sampler, m_ArrayView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkDescriptorBufferInfo uniformInfo{ m_UniformBuffer, 0, sizeof(Uniforms) };
+
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		for (uint32_t i{}; i < writes.size(); ++i) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_DescriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+		}
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].pImageInfo = &imageInfo;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writes[1].pBufferInfo = &uniformInfo;
+
+		vkUpdateDescriptorSets(m_Device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+
+		// shadow.vert only takes the cascade's matrix
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) };
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 0;
+		pipelineLayoutInfo.pSetLayouts = nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create shadow pipeline layout!");
+		}
+	}
+}
@@ -0,0 +1,126 @@
+#ifndef SHADOWCASCADES_HPP
+#define SHADOWCASCADES_HPP
+
+#include <array>
+
+#include "memorytracker.hpp"
+#include "pipelineregistry.hpp"
+
+namespace vulkat {
+	// Cascaded shadow maps of one directional light. The view depth range is split into cascades, each gets an
+	// orthographic light projection around the bounding sphere of its slice with the origin snapped to whole texels,
+	// so the maps don't shimmer while the view moves. A cascade is only rendered again when the light moved, a static
+	// caster inside it changed, or a dynamic caster overlaps it: a cascade of only static geometry stays cached.
+	// Every cascade is one layer of a depth array with its own render pass instance, outside the render graph
+	// since the cached layers have to survive across frames and swapchains
+	class ShadowCascades final {
+	public:
+		static constexpr uint32_t m_CascadeCount{ 4 }; // CASCADE_COUNT in lit.frag
+
+		ShadowCascades();
+
+		ShadowCascades(const ShadowCascades& other) = delete;
+		ShadowCascades(ShadowCascades&& other) = delete;
+		ShadowCascades& operator=(const ShadowCascades& other) = delete;
+		ShadowCascades& operator=(ShadowCascades&& other) = delete;
+
+		~ShadowCascades() = default;
+
+		// vertexShader is the path of shadow.vert for the cascade pipeline state
+		void Initialize(VkDevice device, MemoryTracker* pMemoryTracker,
+			const std::string& vertexShader, bool debug);
+		void Cleanup();
+
+		// Direction the light travels in, every cascade is rendered again when it changes
+		void SetLightDirection(const glm::vec3& direction);
+
+		// Bounds in world space, which is NDC until there is a camera. Casters share the caller's vertex, index and instance buffer
+		void SetCasterCount(uint32_t count);
+		void SetCaster(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const VkDrawIndexedIndirectCommand& draw, bool dynamic);
+		uint32_t GetCasterCount() const { return uint32_t(m_Casters.size()); }
+
+		// Depth only, the main pass's vertex input with the cascade's matrix as push constant
+		PipelineState GetPipelineState(const PipelineState& mainState) const;
+
+		// Set 1 of every pipeline that shades with lit_shadow_frag.spv
+		VkDescriptorSetLayout GetSetLayout() const { return m_SetLayout; }
+
+		// Outside any render pass, before the main pass. The caller binds the casters' buffers. Skipped while the pipeline compiles
+		void Record(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+
+		// Inside the main pass, pipelineLayout has GetSetLayout() as set 1
+		void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+		void PrintStats(std::ostream& os) const;
+
+	private:
+		struct Caster {
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			VkDrawIndexedIndirectCommand draw;
+			bool dynamic;
+			glm::vec4 lightBounds; // xy min, zw max in light view space, what cascades are tested against
+		};
+
+		// Same block as Cascades in lit.frag, std140
+		struct Uniforms {
+			glm::mat4 viewProjection[m_CascadeCount];
+			glm::vec4 splits;
+			glm::vec4 params;
+		};
+
+		struct Cascade {
+			glm::mat4 viewProjection;
+			glm::vec4 bounds; // xy min, zw max in light view space
+			bool dirty; // Rendered again by the next Record()
+		};
+
+		static constexpr uint32_t m_Resolution{ 2048 }; // Per cascade, in x and y
+		static constexpr VkFormat m_Format{ VK_FORMAT_D16_UNORM }; // Every device can render to and sample it
+		static constexpr float m_SplitLambda{ 0.75f }; // Between even (0) and logarithmic (1) splits
+		static constexpr float m_SplitNear{ 0.01f }; // Where the logarithmic splits start
+		static constexpr float m_CasterDistance{ 4.f }; // Casters this far outside a cascade toward the light still land in it
+		static constexpr float m_DepthBias{ 0.002f };
+		static constexpr float m_SunIntensity{ 0.9f };
+
+		VkDevice m_Device;
+		MemoryTracker* m_pMemoryTracker;
+		std::string m_VertexShader;
+		bool m_Debug;
+
+		glm::vec3 m_LightDirection;
+		glm::mat4 m_LightView; // Rotation only, every cascade shares it
+		std::array<Cascade, m_CascadeCount> m_Cascades;
+		float m_Splits[m_CascadeCount];
+		bool m_UniformsDirty;
+
+		std::vector<Caster> m_Casters;
+		std::vector<uint32_t> m_DynamicCasters; // Indices, checked against the cascades every frame
+
+		VkImage m_Image; // One layer per cascade, SHADER_READ_ONLY outside the cascade passes
+		VkDeviceMemory m_ImageMemory;
+		VkImageView m_ArrayView; // Sampled by lit.frag
+		std::array<VkImageView, m_CascadeCount> m_LayerViews;
+		VkRenderPass m_RenderPass;
+		std::array<VkFramebuffer, m_CascadeCount> m_Framebuffers;
+		VkSampler m_Sampler;
+		VkBuffer m_UniformBuffer;
+		VkDeviceMemory m_UniformMemory;
+
+		VkDescriptorSetLayout m_SetLayout;
+		VkDescriptorPool m_DescriptorPool;
+		VkDescriptorSet m_DescriptorSet;
+		VkPipelineLayout m_PipelineLayout; // Push constants only, for shadow.vert
+
+		uint32_t m_RenderedCount; // Cascades rendered by the last Record()
+
+		void FitCascades();
+		glm::vec4 GetLightBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+		void MarkDirty(const glm::vec4& lightBounds); // Every cascade overlapping them
+
+		void CreateImage();
+		void CreateRenderPass();
+		void CreateDescriptors();
+	};
+}
+#endif // SHADOWCASCADES_HPP
@@ -0,0 +1,75 @@
+#include "../pch.hpp"
+#include "startupprofiler.hpp"
+
+#include <iomanip>
+
+namespace vulkat {
+	StartupProfiler::StartupProfiler()
+		: m_Start{ Clock::now() }
+		, m_MainThread{ std::this_thread::get_id() }
+		, m_Threads{ m_MainThread }
+	{}
+
+	void StartupProfiler::Mark(const char* name) {
+		Clock::time_point now{ Clock::now() };
+		Add(name, now, now);
+	}
+
+	void StartupProfiler::Print() const {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		std::cout << "Startup stages:\n";
+		for (const auto& record : m_Records) {
+			std::cout << "\t[" << record.thread << "] "
+				<< std::left << std::setw(28) << record.name << std::right
+				<< std::fixed << std::setprecision(3)
+				<< std::setw(10) << record.startMs << " ms +"
+				<< std::setw(9) << record.durationMs << " ms\n";
+		}
+		std::cout.unsetf(std::ios::floatfield);
+	}
+
+	void StartupProfiler::WriteJson(const std::string& filename) const {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		std::ofstream file{ filename };
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open file: " + filename + "!");
+		}
+
+		double totalMs{};
+		for (const auto& record : m_Records) {
+			totalMs = std::max(totalMs, record.startMs + record.durationMs);
+		}
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\n\t\"total_ms\": " << totalMs << ",\n\t\"stages\": [\n";
+		for (size_t i{}; i < m_Records.size(); ++i) {
+			const Record& record{ m_Records[i] };
+			file << "\t\t{ \"name\": \"" << record.name << "\", \"thread\": " << record.thread
+				<< ", \"start_ms\": " << record.startMs << ", \"duration_ms\": " << record.durationMs << " }"
+				<< (i + 1 < m_Records.size() ? ",\n" : "\n");
+		}
+		file << "\t]\n}\n";
+	}
+
+	void StartupProfiler::Add(const char* name, Clock::time_point begin, Clock::time_point end) {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		m_Records.push_back(Record{ name, GetThreadIndex(std::this_thread::get_id()), ToMs(begin), ToMs(end) - ToMs(begin) });
+	}
+
+	uint32_t StartupProfiler::GetThreadIndex(std::thread::id id) {
+		auto it = std::find(m_Threads.begin(), m_Threads.end(), id);
+		if (it != m_Threads.end()) {
+			return uint32_t(it - m_Threads.begin());
+		}
+
+		m_Threads.push_back(id);
+		return uint32_t(m_Threads.size() - 1);
+	}
+
+	double StartupProfiler::ToMs(Clock::time_point time) const {
+		return std::chrono::duration<double, std::milli>(time - m_Start).count();
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef STARTUPPROFILER_HPP
+#define STARTUPPROFILER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "trace.hpp"
+
+namespace vulkat {
+	// Wall clock timing of the init stages, from Core construction to the first presented frame.
+	// Stages may run on worker threads, so recording is guarded by a mutex (startup only, never per frame)
+	class StartupProfiler final {
+	public:
+		StartupProfiler();
+
+		StartupProfiler(const StartupProfiler& other) = delete;
+		StartupProfiler(StartupProfiler&& other) = delete;
+		StartupProfiler& operator=(const StartupProfiler& other) = delete;
+		StartupProfiler& operator=(StartupProfiler&& other) = delete;
+
+		~StartupProfiler() = default;
+
+		// Time func() as a named stage
+		template<typename Func>
+		void Stage(const char* name, Func&& func);
+
+		// Zero length marker, eg. "First frame"
+		void Mark(const char* name);
+
+		void Print() const;
+		void WriteJson(const std::string& filename) const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Record {
+			const char* name;
+			uint32_t thread; // 0 is the thread that created the profiler
+			double startMs;
+			double durationMs;
+		};
+
+		Clock::time_point m_Start;
+		std::thread::id m_MainThread;
+
+		mutable std::mutex m_Mutex;
+		std::vector<Record> m_Records;
+		std::vector<std::thread::id> m_Threads;
+
+		void Add(const char* name, Clock::time_point begin, Clock::time_point end);
+		uint32_t GetThreadIndex(std::thread::id id);
+		double ToMs(Clock::time_point time) const;
+	};
+
+	template<typename Func>
+	void StartupProfiler::Stage(const char* name, Func&& func) {
+		TRACE_SCOPE(name);
+
+		Clock::time_point begin{ Clock::now() };
+		func();
+		Add(name, begin, Clock::now());
+	}
+}
+#endif // STARTUPPROFILER_HPP
@@ -0,0 +1,75 @@
+#include "../pch.hpp"
+#include "threadpool.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	ThreadPool::ThreadPool(uint32_t threadCount)
+		: m_Stop{ false }
+		, m_pBatchFunc{ nullptr }
+		, m_pBatchContext{ nullptr }
+		, m_BatchNext{ 0 }
+		, m_BatchCount{ 0 }
+		, m_BatchRunning{ 0 }
+	{
+		if (threadCount == 0) {
+			uint32_t hardwareThreads{ std::thread::hardware_concurrency() };
+			threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1; // Leave a core for the render thread
+		}
+
+		m_Workers.reserve(threadCount);
+		for (uint32_t i{}; i < threadCount; ++i) {
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Stop = true;
+		}
+		m_Condition.notify_all();
+
+		for (auto& worker : m_Workers) {
+			worker.join();
+		}
+	}
+
+	void ThreadPool::WorkerLoop() {
+		Trace::SetThreadName("Worker");
+
+		while (true) {
+			std::packaged_task<void()> job;
+
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_Condition.wait(lock, [this]{ return m_Stop || !m_Jobs.empty() || m_BatchNext < m_BatchCount; });
+
+				// A ForEach() blocks its caller, so it goes before queued jobs
+				if (m_BatchNext < m_BatchCount) {
+					RunBatch(lock);
+					continue;
+				}
+
+				if (m_Jobs.empty()) return; // Stopped and drained
+
+				job = std::move(m_Jobs.front());
+				m_Jobs.pop();
+			}
+
+			job();
+		}
+	}
+
+	void ThreadPool::RunBatch(std::unique_lock<std::mutex>& lock) {
+		while (m_BatchNext < m_BatchCount) {
+			uint32_t index{ m_BatchNext++ };
+			++m_BatchRunning;
+
+			lock.unlock();
+			m_pBatchFunc(m_pBatchContext, index);
+			lock.lock();
+
+			if (--m_BatchRunning == 0 && m_BatchNext == m_BatchCount) m_BatchDone.notify_one();
+		}
+	}
+}
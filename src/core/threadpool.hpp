@@ -0,0 +1,88 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace vulkat {
+	// Fixed set of worker threads pulling jobs from a single queue
+	class ThreadPool final {
+	public:
+		explicit ThreadPool(uint32_t threadCount = 0); // 0: one less than the hardware threads, at least 1
+
+		ThreadPool(const ThreadPool& other) = delete;
+		ThreadPool(ThreadPool&& other) = delete;
+		ThreadPool& operator=(const ThreadPool& other) = delete;
+		ThreadPool& operator=(ThreadPool&& other) = delete;
+
+		~ThreadPool(); // Finishes queued jobs, then joins
+
+		// Exceptions thrown by func are rethrown by future.get()
+		template<typename Func>
+		std::future<void> Submit(Func&& func);
+
+		// Calls func(index) for every index below count on the workers and the calling thread, returns once all are done.
+		// Unlike Submit() nothing is allocated, for work that runs every frame. func must not throw
+		template<typename Func>
+		void ForEach(uint32_t count, Func& func);
+
+		uint32_t GetThreadCount() const { return uint32_t(m_Workers.size()); }
+
+	private:
+		std::vector<std::thread> m_Workers;
+		std::queue<std::packaged_task<void()>> m_Jobs;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_Stop;
+
+		// The ForEach() in progress, func type erased through a plain function pointer. Guarded by m_Mutex
+		std::mutex m_BatchMutex; // One ForEach() at a time
+		std::condition_variable m_BatchDone;
+		void (*m_pBatchFunc)(void* pFunc, uint32_t index);
+		void* m_pBatchContext;
+		uint32_t m_BatchNext; // Next index to hand out
+		uint32_t m_BatchCount;
+		uint32_t m_BatchRunning; // Handed out, not finished yet
+
+		void WorkerLoop();
+		void RunBatch(std::unique_lock<std::mutex>& lock); // Until every index is handed out, m_Mutex held on entry and exit
+	};
+
+	template<typename Func>
+	std::future<void> ThreadPool::Submit(Func&& func) {
+		std::packaged_task<void()> job{ std::forward<Func>(func) };
+		std::future<void> future{ job.get_future() };
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Jobs.push(std::move(job));
+		}
+		m_Condition.notify_one();
+
+		return future;
+	}
+
+	template<typename Func>
+	void ThreadPool::ForEach(uint32_t count, Func& func) {
+		std::lock_guard<std::mutex> batchLock{ m_BatchMutex };
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+
+		m_pBatchFunc = [](void* pFunc, uint32_t index){ (*static_cast<Func*>(pFunc))(index); };
+		m_pBatchContext = &func;
+		m_BatchNext = 0;
+		m_BatchCount = count;
+		m_Condition.notify_all();
+
+		// Workers busy with long jobs just leave more of the indices to this thread
+		RunBatch(lock);
+		m_BatchDone.wait(lock, [this]{ return m_BatchRunning == 0; });
+
+		m_pBatchFunc = nullptr;
+		m_pBatchContext = nullptr;
+	}
+}
+#endif // THREADPOOL_HPP
@@ -0,0 +1,167 @@
+#include "../pch.hpp"
+#include "timeline.hpp"
+
+namespace vulkat {
+	Timeline::Timeline()
+		: m_Device{ VK_NULL_HANDLE }
+		, m_Semaphore{ VK_NULL_HANDLE }
+		, m_pWaitSemaphores{ nullptr }
+		, m_pGetSemaphoreCounterValue{ nullptr }
+		, m_Submitted{ 0 }
+		, m_Completed{ 0 }
+	{}
+
+	void Timeline::Initialize(VkDevice device, bool useSemaphore, bool khr) {
+		m_Device = device;
+		m_Submitted = 0;
+		m_Completed = 0;
+
+		if (!useSemaphore) return;
+
+		m_pWaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphores>(
+			vkGetDeviceProcAddr(m_Device, khr ? "vkWaitSemaphoresKHR" : "vkWaitSemaphores"));
+		m_pGetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValue>(
+			vkGetDeviceProcAddr(m_Device, khr ? "vkGetSemaphoreCounterValueKHR" : "vkGetSemaphoreCounterValue"));
+
+		if (!m_pWaitSemaphores || !m_pGetSemaphoreCounterValue) {
+			throw std::runtime_error("Failed to load timeline semaphore functions!");
+		}
+
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		if (vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_Semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create timeline semaphore!");
+		}
+	}
+
+	void Timeline::Cleanup() {
+		if (m_Semaphore != VK_NULL_HANDLE) {
+			vkDestroySemaphore(m_Device, m_Semaphore, nullptr);
+			m_Semaphore = VK_NULL_HANDLE;
+		}
+
+		for (const auto& pending : m_PendingFences) {
+			vkDestroyFence(m_Device, pending.second, nullptr);
+		}
+		m_PendingFences.clear();
+
+		for (VkFence fence : m_FreeFences) {
+			vkDestroyFence(m_Device, fence, nullptr);
+		}
+		m_FreeFences.clear();
+	}
+
+	uint64_t Timeline::Submit(VkQueue queue, const VkSubmitInfo& submitInfo) {
+		const uint64_t value{ m_Submitted + 1 };
+
+		VkSubmitInfo info{ submitInfo };
+		VkFence fence{ VK_NULL_HANDLE };
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+
+		if (IsSemaphore()) {
+			// Binary semaphores ignore their value, but every signal needs one once a timeline is in the list
+			m_SignalScratch.assign(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+			m_ValueScratch.assign(submitInfo.signalSemaphoreCount, 0);
+			m_SignalScratch.push_back(m_Semaphore);
+			m_ValueScratch.push_back(value);
+
+			timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timelineInfo.pNext = submitInfo.pNext;
+			timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(m_ValueScratch.size());
+			timelineInfo.pSignalSemaphoreValues = m_ValueScratch.data();
+
+			info.pNext = &timelineInfo;
+			info.signalSemaphoreCount = static_cast<uint32_t>(m_SignalScratch.size());
+			info.pSignalSemaphores = m_SignalScratch.data();
+		}
+		else {
+			fence = AcquireFence();
+		}
+
+		if (vkQueueSubmit(queue, 1, &info, fence) != VK_SUCCESS) {
+			if (fence != VK_NULL_HANDLE) m_FreeFences.push_back(fence);
+			throw std::runtime_error("Failed to submit to the queue!");
+		}
+
+		if (fence != VK_NULL_HANDLE) m_PendingFences.emplace_back(value, fence);
+
+		m_Submitted = value;
+		return value;
+	}
+
+	void Timeline::Wait(uint64_t value) {
+		if (value <= m_Completed) return;
+
+		if (IsSemaphore()) {
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &m_Semaphore;
+			waitInfo.pValues = &value;
+
+			m_pWaitSemaphores(m_Device, &waitInfo, UINT64_MAX);
+			m_Completed = std::max(m_Completed, value);
+		}
+		else {
+			RetireFences(true, value);
+		}
+	}
+
+	uint64_t Timeline::GetCompleted() {
+		if (IsSemaphore()) {
+			uint64_t counter{ 0 };
+			m_pGetSemaphoreCounterValue(m_Device, m_Semaphore, &counter);
+			m_Completed = std::max(m_Completed, counter);
+		}
+		else {
+			RetireFences(false, m_Submitted);
+		}
+
+		return m_Completed;
+	}
+
+	VkFence Timeline::AcquireFence() {
+		if (!m_FreeFences.empty()) {
+			VkFence fence{ m_FreeFences.back() };
+			m_FreeFences.pop_back();
+			vkResetFences(m_Device, 1, &fence);
+			return fence;
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence fence;
+		if (vkCreateFence(m_Device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create fence!");
+		}
+
+		return fence;
+	}
+
+	void Timeline::RetireFences(bool wait, uint64_t value) {
+		// A queue completes in submission order, so the oldest fence is always the next to signal
+		while (!m_PendingFences.empty() && m_PendingFences.front().first <= value) {
+			VkFence fence{ m_PendingFences.front().second };
+
+			if (wait) {
+				vkWaitForFences(m_Device, 1, &fence, VK_TRUE, UINT64_MAX);
+			}
+			else if (vkGetFenceStatus(m_Device, fence) != VK_SUCCESS) {
+				break;
+			}
+
+			m_Completed = m_PendingFences.front().first;
+			m_PendingFences.pop_front();
+			m_FreeFences.push_back(fence);
+		}
+	}
+}
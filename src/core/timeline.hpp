@@ -0,0 +1,61 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <deque>
+
+namespace vulkat {
+	// One monotonically increasing counter per queue: every submission signals the next value,
+	// anything that depends on it waits for "value N" instead of holding on to its own fence.
+	// Backed by a timeline semaphore on Vulkan 1.2 or VK_KHR_timeline_semaphore,
+	// otherwise emulated with a fence per submission in flight
+	class Timeline final {
+	public:
+		Timeline();
+
+		Timeline(const Timeline& other) = delete;
+		Timeline(Timeline&& other) = delete;
+		Timeline& operator=(const Timeline& other) = delete;
+		Timeline& operator=(Timeline&& other) = delete;
+
+		~Timeline() = default;
+
+		// useSemaphore: the timelineSemaphore feature is enabled. khr: through the extension instead of core 1.2
+		void Initialize(VkDevice device, bool useSemaphore, bool khr);
+		void Cleanup(); // Device must be idle
+
+		// Adds the signal to the submission and returns the value it signals
+		uint64_t Submit(VkQueue queue, const VkSubmitInfo& submitInfo);
+
+		// Blocks until the GPU passed value, returns right away for values that already completed
+		void Wait(uint64_t value);
+		bool IsComplete(uint64_t value) { return value <= GetCompleted(); }
+
+		uint64_t GetCompleted();
+		uint64_t GetSubmitted() const { return m_Submitted; }
+
+		bool IsSemaphore() const { return m_Semaphore != VK_NULL_HANDLE; }
+		VkSemaphore GetSemaphore() const { return m_Semaphore; } // To wait on from another queue
+
+	private:
+		VkDevice m_Device;
+
+		VkSemaphore m_Semaphore;
+		PFN_vkWaitSemaphores m_pWaitSemaphores; // Core or KHR entry point
+		PFN_vkGetSemaphoreCounterValue m_pGetSemaphoreCounterValue;
+
+		// Reused by Submit(), so a frame's submit doesn't allocate
+		std::vector<VkSemaphore> m_SignalScratch;
+		std::vector<uint64_t> m_ValueScratch;
+
+		uint64_t m_Submitted;
+		uint64_t m_Completed; // Cached, only ever grows
+
+		// Fallback without timeline semaphores
+		std::deque<std::pair<uint64_t, VkFence>> m_PendingFences; // In submission order
+		std::vector<VkFence> m_FreeFences;
+
+		VkFence AcquireFence();
+		void RetireFences(bool wait, uint64_t value);
+	};
+}
+#endif // TIMELINE_HPP
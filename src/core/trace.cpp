@@ -0,0 +1,97 @@
+#include "../pch.hpp"
+#include "trace.hpp"
+
+namespace vulkat {
+	struct Trace::ThreadBuffer {
+		static const uint64_t m_Capacity{ 1 << 16 }; // Power of 2, oldest events get overwritten
+
+		std::unique_ptr<Event[]> events{ new Event[m_Capacity] };
+		std::atomic<uint64_t> head{ 0 }; // Written by the owning thread only
+
+		uint32_t id;
+		std::string name;
+	};
+
+	std::atomic<bool> Trace::m_Enabled{ false };
+	std::mutex Trace::m_Mutex;
+	std::vector<std::shared_ptr<Trace::ThreadBuffer>> Trace::m_Buffers;
+	const uint64_t Trace::m_EpochNs{ Trace::Now() };
+
+	thread_local std::shared_ptr<Trace::ThreadBuffer> Trace::m_pThreadBuffer{};
+	thread_local const char* Trace::m_ThreadName{ nullptr };
+
+	void Trace::Enable(bool enabled) {
+		m_Enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	void Trace::SetThreadName(const char* name) {
+		// Just remembered, the buffer is only allocated once the thread records something
+		m_ThreadName = name;
+	}
+
+	void Trace::Record(const char* name, uint64_t beginNs, uint64_t endNs) {
+		ThreadBuffer& buffer{ GetThreadBuffer() };
+
+		uint64_t head{ buffer.head.load(std::memory_order_relaxed) };
+		buffer.events[head & (ThreadBuffer::m_Capacity - 1)] = Event{ name, beginNs, endNs };
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	uint64_t Trace::Now() {
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	Trace::ThreadBuffer& Trace::GetThreadBuffer() {
+		if (!m_pThreadBuffer) {
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+
+			m_pThreadBuffer = std::make_shared<ThreadBuffer>();
+			m_pThreadBuffer->id = uint32_t(m_Buffers.size());
+			m_pThreadBuffer->name = m_ThreadName ? m_ThreadName : "Thread " + std::to_string(m_pThreadBuffer->id);
+
+			m_Buffers.push_back(m_pThreadBuffer);
+		}
+
+		return *m_pThreadBuffer;
+	}
+
+	void Trace::Flush(const std::string& filename) {
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+
+		std::ofstream file{ filename };
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open file: " + filename + "!");
+		}
+
+		const uint64_t capacity{ ThreadBuffer::m_Capacity };
+		bool first{ true };
+		std::vector<Event> events;
+
+		file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+		for (const auto& pBuffer : m_Buffers) {
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pBuffer->id
+				<< ",\"args\":{\"name\":\"" << pBuffer->name << "\"}}";
+			first = false;
+
+			uint64_t head{ pBuffer->head.load(std::memory_order_acquire) };
+			uint64_t begin{ head > capacity ? head - capacity : 0 };
+
+			events.clear();
+			for (uint64_t i{ begin }; i < head; ++i) {
+				events.push_back(pBuffer->events[i & (capacity - 1)]);
+			}
+
+			// The owner kept writing while we copied, anything it lapped may be torn
+			uint64_t headAfter{ pBuffer->head.load(std::memory_order_acquire) };
+			uint64_t firstValid{ headAfter > capacity ? headAfter - capacity : 0 };
+
+			for (uint64_t i{ std::max(begin, firstValid) }; i < head; ++i) {
+				const Event& event{ events[i - begin] };
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBuffer->id
+					<< ",\"ts\":" << double(event.beginNs - m_EpochNs) * 1e-3
+					<< ",\"dur\":" << double(event.endNs - event.beginNs) * 1e-3 << "}";
+			}
+		}
+		file << "\n]}\n";
+	}
+}
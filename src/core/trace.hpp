@@ -0,0 +1,82 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// Compiled in by default (make TRACE=0 removes it), recording only happens once Trace::Enable() is called
+#ifndef VULKAT_TRACE
+#define VULKAT_TRACE 1
+#endif
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#if VULKAT_TRACE
+// Name must be a string literal (only the pointer is stored)
+#define TRACE_SCOPE(name) ::vulkat::TraceZone TRACE_CONCAT(traceZone, __LINE__){ name }
+#else
+#define TRACE_SCOPE(name) do {} while (false)
+#endif
+
+namespace vulkat {
+	// Timeline of scoped zones per thread, written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+	// Every thread appends to its own ring buffer without locking, the flush validates what it copied
+	class Trace final {
+	public:
+		static void Enable(bool enabled);
+		static bool IsEnabled() { return m_Enabled.load(std::memory_order_relaxed); }
+
+		static void SetThreadName(const char* name);
+
+		// Rewrites the file with every event still in the rings, so a later flush keeps what an earlier one wrote
+		static void Flush(const std::string& filename);
+
+		static void Record(const char* name, uint64_t beginNs, uint64_t endNs);
+		static uint64_t Now();
+
+	private:
+		struct Event {
+			const char* name;
+			uint64_t beginNs;
+			uint64_t endNs;
+		};
+
+		struct ThreadBuffer;
+
+		static std::atomic<bool> m_Enabled;
+
+		// Buffers outlive their threads, so zones of finished workers still end up in the flush
+		static std::mutex m_Mutex;
+		static std::vector<std::shared_ptr<ThreadBuffer>> m_Buffers;
+		static const uint64_t m_EpochNs;
+
+		static thread_local std::shared_ptr<ThreadBuffer> m_pThreadBuffer;
+		static thread_local const char* m_ThreadName;
+
+		static ThreadBuffer& GetThreadBuffer();
+	};
+
+	class TraceZone final {
+	public:
+		explicit TraceZone(const char* name)
+			: m_Name{ name }
+			, m_BeginNs{ Trace::IsEnabled() ? Trace::Now() : 0 }
+		{}
+
+		TraceZone(const TraceZone& other) = delete;
+		TraceZone(TraceZone&& other) = delete;
+		TraceZone& operator=(const TraceZone& other) = delete;
+		TraceZone& operator=(TraceZone&& other) = delete;
+
+		~TraceZone() {
+			if (m_BeginNs) Trace::Record(m_Name, m_BeginNs, Trace::Now());
+		}
+
+	private:
+		const char* m_Name;
+		uint64_t m_BeginNs; // 0 when tracing was off as the zone opened
+	};
+}
+#endif // TRACE_HPP
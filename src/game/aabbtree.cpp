@@ -0,0 +1,388 @@
+#include "../pch.hpp"
+#include "aabbtree.hpp"
+
+#include <cmath>
+
+namespace vulkat {
+	bool Aabb::Overlaps(const Aabb& other) const {
+		return min.x <= other.max.x && max.x >= other.min.x
+			&& min.y <= other.max.y && max.y >= other.min.y
+			&& min.z <= other.max.z && max.z >= other.min.z;
+	}
+
+	bool Aabb::Contains(const Aabb& other) const {
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+	}
+
+	float Aabb::GetSurfaceArea() const {
+		glm::vec3 size{ max - min };
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	Aabb Aabb::Expanded(float margin) const {
+		glm::vec3 offset{ margin, margin, margin };
+		return Aabb{ min - offset, max + offset };
+	}
+
+	Aabb Aabb::Union(const Aabb& a, const Aabb& b) {
+		return Aabb{ glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+	Frustum Frustum::FromMatrix(const glm::mat4& viewProjection) {
+		// Rows of the matrix, glm is column major
+		glm::vec4 rows[4];
+		for (int i{}; i < 4; ++i) {
+			rows[i] = glm::vec4{ viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] };
+		}
+
+		Frustum frustum{};
+		frustum.planes[0] = rows[3] + rows[0]; // Left
+		frustum.planes[1] = rows[3] - rows[0]; // Right
+		frustum.planes[2] = rows[3] + rows[1]; // Bottom
+		frustum.planes[3] = rows[3] - rows[1]; // Top
+		frustum.planes[4] = rows[2]; // Near, depth starts at 0
+		frustum.planes[5] = rows[3] - rows[2]; // Far
+
+		for (auto& plane : frustum.planes) {
+			plane = plane / glm::length(glm::vec3{ plane.x, plane.y, plane.z });
+		}
+
+		return frustum;
+	}
+
+	AabbTree::AabbTree(float margin)
+		: m_Root{ m_NullNode }
+		, m_FreeList{ m_NullNode }
+		, m_ProxyCount{ 0 }
+		, m_Margin{ margin }
+	{}
+
+	int32_t AabbTree::Insert(const Aabb& bounds, uint32_t userData) {
+		int32_t proxy{ AllocateNode() };
+		Node& node{ m_Nodes[proxy] };
+		node.bounds = bounds.Expanded(m_Margin);
+		node.userData = userData;
+		node.height = 0;
+
+		InsertLeaf(proxy);
+		++m_ProxyCount;
+
+		return proxy;
+	}
+
+	void AabbTree::Remove(int32_t proxy) {
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+		--m_ProxyCount;
+	}
+
+	bool AabbTree::Move(int32_t proxy, const Aabb& bounds) {
+		if (m_Nodes[proxy].bounds.Contains(bounds)) return false;
+
+		RemoveLeaf(proxy);
+		m_Nodes[proxy].bounds = bounds.Expanded(m_Margin);
+		InsertLeaf(proxy);
+
+		return true;
+	}
+
+	void AabbTree::Clear() {
+		m_Nodes.clear();
+		m_Root = m_NullNode;
+		m_FreeList = m_NullNode;
+		m_ProxyCount = 0;
+	}
+
+	float AabbTree::GetAreaRatio() const {
+		if (m_Root == m_NullNode) return 0.f;
+
+		float total{};
+		for (const auto& node : m_Nodes) {
+			if (node.height > 0) total += node.bounds.GetSurfaceArea(); // Internal and in use
+		}
+
+		float rootArea{ m_Nodes[m_Root].bounds.GetSurfaceArea() };
+		return rootArea > 0.f ? total / rootArea : 0.f;
+	}
+
+	void AabbTree::Validate() const {
+		if (m_Root == m_NullNode) return;
+
+		if (m_Nodes[m_Root].parent != m_NullNode) {
+			throw std::runtime_error("Failed to validate AABB tree, the root has a parent!");
+		}
+		ValidateNode(m_Root);
+	}
+
+	int32_t AabbTree::AllocateNode() {
+		if (m_FreeList == m_NullNode) {
+			m_Nodes.push_back(Node{});
+			m_Nodes.back().height = -1;
+			m_Nodes.back().parent = m_NullNode;
+			m_FreeList = int32_t(m_Nodes.size() - 1);
+		}
+
+		int32_t index{ m_FreeList };
+		Node& node{ m_Nodes[index] };
+		m_FreeList = node.parent;
+
+		node.parent = m_NullNode;
+		node.child1 = m_NullNode;
+		node.child2 = m_NullNode;
+		node.height = 0;
+		node.userData = 0;
+
+		return index;
+	}
+
+	void AabbTree::FreeNode(int32_t node) {
+		m_Nodes[node].parent = m_FreeList;
+		m_Nodes[node].height = -1;
+		m_FreeList = node;
+	}
+
+	void AabbTree::InsertLeaf(int32_t leaf) {
+		if (m_Root == m_NullNode) {
+			m_Root = leaf;
+			m_Nodes[leaf].parent = m_NullNode;
+			return;
+		}
+
+		// Walk down to the sibling that grows the tree's surface area least
+		const Aabb leafBounds{ m_Nodes[leaf].bounds };
+		int32_t index{ m_Root };
+		while (!m_Nodes[index].IsLeaf()) {
+			const Node& node{ m_Nodes[index] };
+			float area{ node.bounds.GetSurfaceArea() };
+			float combinedArea{ Aabb::Union(node.bounds, leafBounds).GetSurfaceArea() };
+
+			// New parent for this node and the leaf
+			float cost{ 2.f * combinedArea };
+			// Every ancestor grows by this much, wherever the leaf goes below
+			float inheritedCost{ 2.f * (combinedArea - area) };
+
+			auto descendCost = [&](int32_t child) {
+				const Node& childNode{ m_Nodes[child] };
+				float childArea{ Aabb::Union(childNode.bounds, leafBounds).GetSurfaceArea() };
+				if (!childNode.IsLeaf()) childArea -= childNode.bounds.GetSurfaceArea();
+				return childArea + inheritedCost;
+			};
+
+			float cost1{ descendCost(node.child1) };
+			float cost2{ descendCost(node.child2) };
+
+			if (cost < cost1 && cost < cost2) break;
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		int32_t sibling{ index };
+		int32_t oldParent{ m_Nodes[sibling].parent };
+		int32_t newParent{ AllocateNode() }; // May reallocate, no references across this
+		m_Nodes[newParent].parent = oldParent;
+		m_Nodes[newParent].bounds = Aabb::Union(leafBounds, m_Nodes[sibling].bounds);
+		m_Nodes[newParent].height = m_Nodes[sibling].height + 1;
+		m_Nodes[newParent].child1 = sibling;
+		m_Nodes[newParent].child2 = leaf;
+		m_Nodes[sibling].parent = newParent;
+		m_Nodes[leaf].parent = newParent;
+
+		if (oldParent == m_NullNode) {
+			m_Root = newParent;
+		}
+		else if (m_Nodes[oldParent].child1 == sibling) {
+			m_Nodes[oldParent].child1 = newParent;
+		}
+		else {
+			m_Nodes[oldParent].child2 = newParent;
+		}
+
+		Refit(m_Nodes[leaf].parent);
+	}
+
+	void AabbTree::RemoveLeaf(int32_t leaf) {
+		if (leaf == m_Root) {
+			m_Root = m_NullNode;
+			return;
+		}
+
+		int32_t parent{ m_Nodes[leaf].parent };
+		int32_t grandParent{ m_Nodes[parent].parent };
+		int32_t sibling{ m_Nodes[parent].child1 == leaf ? m_Nodes[parent].child2 : m_Nodes[parent].child1 };
+
+		// The sibling takes the parent's place
+		m_Nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+
+		if (grandParent == m_NullNode) {
+			m_Root = sibling;
+			return;
+		}
+
+		if (m_Nodes[grandParent].child1 == parent) m_Nodes[grandParent].child1 = sibling;
+		else m_Nodes[grandParent].child2 = sibling;
+
+		Refit(grandParent);
+	}
+
+	void AabbTree::Refit(int32_t index) {
+		while (index != m_NullNode) {
+			index = Balance(index);
+
+			Node& node{ m_Nodes[index] };
+			const Node& child1{ m_Nodes[node.child1] };
+			const Node& child2{ m_Nodes[node.child2] };
+			node.height = 1 + std::max(child1.height, child2.height);
+			node.bounds = Aabb::Union(child1.bounds, child2.bounds);
+
+			index = node.parent;
+		}
+	}
+
+	int32_t AabbTree::Balance(int32_t iA) {
+		// Rotates the higher child up when the heights of A's children differ by more than one.
+		// With C higher: C takes A's place, A keeps B and the lower of C's children, C keeps A and the higher one
+		Node& A{ m_Nodes[iA] };
+		if (A.IsLeaf() || A.height < 2) return iA;
+
+		int32_t iB{ A.child1 };
+		int32_t iC{ A.child2 };
+		Node& B{ m_Nodes[iB] };
+		Node& C{ m_Nodes[iC] };
+
+		int32_t balance{ C.height - B.height };
+
+		auto replaceInParent = [this, iA](int32_t parent, int32_t replacement) {
+			if (parent == m_NullNode) m_Root = replacement;
+			else if (m_Nodes[parent].child1 == iA) m_Nodes[parent].child1 = replacement;
+			else m_Nodes[parent].child2 = replacement;
+		};
+
+		if (balance > 1) {
+			int32_t iF{ C.child1 };
+			int32_t iG{ C.child2 };
+			Node& F{ m_Nodes[iF] };
+			Node& G{ m_Nodes[iG] };
+
+			C.child1 = iA;
+			C.parent = A.parent;
+			A.parent = iC;
+			replaceInParent(C.parent, iC);
+
+			if (F.height > G.height) {
+				C.child2 = iF;
+				A.child2 = iG;
+				G.parent = iA;
+				A.bounds = Aabb::Union(B.bounds, G.bounds);
+				C.bounds = Aabb::Union(A.bounds, F.bounds);
+				A.height = 1 + std::max(B.height, G.height);
+				C.height = 1 + std::max(A.height, F.height);
+			}
+			else {
+				C.child2 = iG;
+				A.child2 = iF;
+				F.parent = iA;
+				A.bounds = Aabb::Union(B.bounds, F.bounds);
+				C.bounds = Aabb::Union(A.bounds, G.bounds);
+				A.height = 1 + std::max(B.height, F.height);
+				C.height = 1 + std::max(A.height, G.height);
+			}
+
+			return iC;
+		}
+
+		if (balance < -1) {
+			int32_t iD{ B.child1 };
+			int32_t iE{ B.child2 };
+			Node& D{ m_Nodes[iD] };
+			Node& E{ m_Nodes[iE] };
+
+			B.child1 = iA;
+			B.parent = A.parent;
+			A.parent = iB;
+			replaceInParent(B.parent, iB);
+
+			if (D.height > E.height) {
+				B.child2 = iD;
+				A.child1 = iE;
+				E.parent = iA;
+				A.bounds = Aabb::Union(C.bounds, E.bounds);
+				B.bounds = Aabb::Union(A.bounds, D.bounds);
+				A.height = 1 + std::max(C.height, E.height);
+				B.height = 1 + std::max(A.height, D.height);
+			}
+			else {
+				B.child2 = iE;
+				A.child1 = iD;
+				D.parent = iA;
+				A.bounds = Aabb::Union(C.bounds, D.bounds);
+				B.bounds = Aabb::Union(A.bounds, E.bounds);
+				A.height = 1 + std::max(C.height, D.height);
+				B.height = 1 + std::max(A.height, E.height);
+			}
+
+			return iB;
+		}
+
+		return iA;
+	}
+
+	int32_t AabbTree::ValidateNode(int32_t index) const {
+		const Node& node{ m_Nodes[index] };
+		if (node.IsLeaf()) {
+			if (node.height != 0) throw std::runtime_error("Failed to validate AABB tree, leaf with a height!");
+			return 0;
+		}
+
+		if (m_Nodes[node.child1].parent != index || m_Nodes[node.child2].parent != index) {
+			throw std::runtime_error("Failed to validate AABB tree, child with the wrong parent!");
+		}
+		if (!node.bounds.Contains(m_Nodes[node.child1].bounds) || !node.bounds.Contains(m_Nodes[node.child2].bounds)) {
+			throw std::runtime_error("Failed to validate AABB tree, bounds don't contain their children!");
+		}
+
+		int32_t height{ 1 + std::max(ValidateNode(node.child1), ValidateNode(node.child2)) };
+		if (height != node.height) throw std::runtime_error("Failed to validate AABB tree, wrong height!");
+
+		return height;
+	}
+
+	float AabbTree::IntersectRay(const Aabb& bounds, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+		// Slabs, infinities from axis aligned rays fall out of the min and max
+		float t1{ (bounds.min.x - origin.x) * inverseDirection.x };
+		float t2{ (bounds.max.x - origin.x) * inverseDirection.x };
+		float tMin{ std::min(t1, t2) };
+		float tMax{ std::max(t1, t2) };
+
+		t1 = (bounds.min.y - origin.y) * inverseDirection.y;
+		t2 = (bounds.max.y - origin.y) * inverseDirection.y;
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+
+		t1 = (bounds.min.z - origin.z) * inverseDirection.z;
+		t2 = (bounds.max.z - origin.z) * inverseDirection.z;
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+
+		tMin = std::max(tMin, 0.f); // Starting inside is a hit at 0
+		if (tMax < tMin || tMin > maxDistance) return -1.f;
+
+		return tMin;
+	}
+
+	AabbTree::Containment AabbTree::Classify(const Aabb& bounds, const Frustum& frustum) {
+		glm::vec3 center{ (bounds.min + bounds.max) * 0.5f };
+		glm::vec3 extents{ (bounds.max - bounds.min) * 0.5f };
+
+		Containment result{ Containment::Inside };
+		for (const auto& plane : frustum.planes) {
+			float distance{ plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w };
+			float radius{ std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z };
+
+			if (distance + radius < 0.f) return Containment::Outside;
+			if (distance - radius < 0.f) result = Containment::Intersecting;
+		}
+
+		return result;
+	}
+}
@@ -0,0 +1,227 @@
+#ifndef AABBTREE_HPP
+#define AABBTREE_HPP
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+namespace vulkat {
+	struct Aabb {
+		glm::vec3 min;
+		glm::vec3 max;
+
+		bool Overlaps(const Aabb& other) const;
+		bool Contains(const Aabb& other) const;
+		float GetSurfaceArea() const;
+		Aabb Expanded(float margin) const;
+
+		static Aabb Union(const Aabb& a, const Aabb& b);
+	};
+
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction; // Needn't be normalized, distances are in multiples of it
+		float maxDistance;
+	};
+
+	// Six planes pointing inwards, xyz normal and w distance
+	struct Frustum {
+		std::array<glm::vec4, 6> planes;
+
+		// From a (Vulkan, depth 0 to 1) view projection matrix
+		static Frustum FromMatrix(const glm::mat4& viewProjection);
+	};
+
+	// Dynamic bounding volume hierarchy, for culling and queries on objects that move.
+	// Leaves hold fattened bounds, so objects moving a little don't touch the tree. When they leave them they're
+	// reinserted where the surface area grows least, and AVL style rotations keep the tree balanced.
+	// Nodes live in one array and refer to each other by index, queries walk them with an explicit stack
+	class AabbTree final {
+	public:
+		static constexpr int32_t m_NullNode{ -1 };
+
+		explicit AabbTree(float margin = 0.1f);
+
+		AabbTree(const AabbTree& other) = delete;
+		AabbTree(AabbTree&& other) = delete;
+		AabbTree& operator=(const AabbTree& other) = delete;
+		AabbTree& operator=(AabbTree&& other) = delete;
+
+		~AabbTree() = default;
+
+		// Returns the proxy of the object, valid until it's removed
+		int32_t Insert(const Aabb& bounds, uint32_t userData);
+		void Remove(int32_t proxy);
+
+		// True if the object left its fat bounds and was reinserted
+		bool Move(int32_t proxy, const Aabb& bounds);
+
+		void Clear();
+
+		uint32_t GetUserData(int32_t proxy) const { return m_Nodes[proxy].userData; }
+		const Aabb& GetFatBounds(int32_t proxy) const { return m_Nodes[proxy].bounds; }
+
+		// func(userData) for every object whose fat bounds overlap, return false from it to stop
+		template<typename Func>
+		void QueryOverlap(const Aabb& bounds, Func&& func) const;
+
+		// func(userData) for every object whose fat bounds intersect the frustum. Subtrees fully inside aren't tested further
+		template<typename Func>
+		void QueryFrustum(const Frustum& frustum, Func&& func) const;
+
+		// func(ray, userData) for every object whose fat bounds the ray hits, nearest nodes first. It returns the distance
+		// of its own hit to clip the ray (or ray.maxDistance to keep it), 0 stops the query
+		template<typename Func>
+		void QueryRay(const Ray& ray, Func&& func) const;
+
+		uint32_t GetProxyCount() const { return m_ProxyCount; }
+		int32_t GetHeight() const { return m_Root == m_NullNode ? 0 : m_Nodes[m_Root].height; }
+		float GetAreaRatio() const; // Summed area of the internal nodes over the root's, lower is a better tree
+		void Validate() const; // Throws if the structure is inconsistent, for debugging
+
+	private:
+		struct Node {
+			Aabb bounds;
+			int32_t parent; // Next free node while on the free list
+			int32_t child1; // m_NullNode for leaves
+			int32_t child2;
+			int32_t height; // Leaves are 0, -1 while free
+			uint32_t userData;
+
+			bool IsLeaf() const { return child1 == m_NullNode; }
+		};
+
+		// Fixed stack for the traversals, only spills to the heap for very deep trees
+		class NodeStack final {
+		public:
+			void Push(int32_t node) {
+				if (m_Size < m_Inline.size()) m_Inline[m_Size] = node;
+				else m_Spill.push_back(node);
+				++m_Size;
+			}
+			int32_t Pop() {
+				--m_Size;
+				if (m_Size < m_Inline.size()) return m_Inline[m_Size];
+				int32_t node{ m_Spill.back() };
+				m_Spill.pop_back();
+				return node;
+			}
+			bool IsEmpty() const { return m_Size == 0; }
+
+		private:
+			std::array<int32_t, 128> m_Inline;
+			std::vector<int32_t> m_Spill;
+			size_t m_Size{ 0 };
+		};
+
+		std::vector<Node> m_Nodes;
+		int32_t m_Root;
+		int32_t m_FreeList;
+		uint32_t m_ProxyCount;
+		float m_Margin;
+
+		int32_t AllocateNode();
+		void FreeNode(int32_t node);
+
+		void InsertLeaf(int32_t leaf);
+		void RemoveLeaf(int32_t leaf);
+		void Refit(int32_t node); // Rebalances and refits from node up to the root
+		int32_t Balance(int32_t node);
+
+		int32_t ValidateNode(int32_t node) const;
+
+		// Distance along the ray where it enters the box, or a negative value if it misses
+		static float IntersectRay(const Aabb& bounds, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+
+		enum class Containment { Outside, Intersecting, Inside };
+		static Containment Classify(const Aabb& bounds, const Frustum& frustum);
+	};
+
+	template<typename Func>
+	void AabbTree::QueryOverlap(const Aabb& bounds, Func&& func) const {
+		if (m_Root == m_NullNode) return;
+
+		NodeStack stack{};
+		stack.Push(m_Root);
+
+		while (!stack.IsEmpty()) {
+			const Node& node{ m_Nodes[stack.Pop()] };
+			if (!node.bounds.Overlaps(bounds)) continue;
+
+			if (node.IsLeaf()) {
+				if (!func(node.userData)) return;
+			}
+			else {
+				stack.Push(node.child1);
+				stack.Push(node.child2);
+			}
+		}
+	}
+
+	template<typename Func>
+	void AabbTree::QueryFrustum(const Frustum& frustum, Func&& func) const {
+		if (m_Root == m_NullNode) return;
+
+		// Nodes pushed with the inside bit set skip the plane tests, everything under them is visible
+		NodeStack stack{};
+		stack.Push(m_Root << 1);
+
+		while (!stack.IsEmpty()) {
+			int32_t entry{ stack.Pop() };
+			const Node& node{ m_Nodes[entry >> 1] };
+			bool inside{ (entry & 1) != 0 };
+
+			if (!inside) {
+				Containment containment{ Classify(node.bounds, frustum) };
+				if (containment == Containment::Outside) continue;
+				inside = containment == Containment::Inside;
+			}
+
+			if (node.IsLeaf()) {
+				func(node.userData);
+			}
+			else {
+				stack.Push(node.child1 << 1 | int32_t(inside));
+				stack.Push(node.child2 << 1 | int32_t(inside));
+			}
+		}
+	}
+
+	template<typename Func>
+	void AabbTree::QueryRay(const Ray& ray, Func&& func) const {
+		if (m_Root == m_NullNode) return;
+
+		const glm::vec3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+		Ray clipped{ ray };
+
+		NodeStack stack{};
+		stack.Push(m_Root);
+
+		while (!stack.IsEmpty()) {
+			const Node& node{ m_Nodes[stack.Pop()] };
+			if (IntersectRay(node.bounds, clipped.origin, inverseDirection, clipped.maxDistance) < 0.f) continue;
+
+			if (node.IsLeaf()) {
+				float distance{ func(clipped, node.userData) };
+				if (distance == 0.f) return;
+				clipped.maxDistance = std::min(clipped.maxDistance, distance);
+				continue;
+			}
+
+			// Nearer child on top, its hits clip the ray before the other one is tested
+			float distance1{ IntersectRay(m_Nodes[node.child1].bounds, clipped.origin, inverseDirection, clipped.maxDistance) };
+			float distance2{ IntersectRay(m_Nodes[node.child2].bounds, clipped.origin, inverseDirection, clipped.maxDistance) };
+			bool firstNearer{ distance1 >= 0.f && (distance2 < 0.f || distance1 <= distance2) };
+
+			if (firstNearer) {
+				if (distance2 >= 0.f) stack.Push(node.child2);
+				stack.Push(node.child1);
+			}
+			else {
+				if (distance1 >= 0.f) stack.Push(node.child1);
+				if (distance2 >= 0.f) stack.Push(node.child2);
+			}
+		}
+	}
+}
+#endif // AABBTREE_HPP
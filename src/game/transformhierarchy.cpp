@@ -0,0 +1,258 @@
+#include "../pch.hpp"
+#include "transformhierarchy.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VULKAT_SSE 1
+#endif
+
+namespace vulkat {
+	namespace {
+		const uint32_t g_Removed{ UINT32_MAX };
+		const uint32_t g_Unknown{ UINT32_MAX - 1 };
+
+		// Column major out = a * b, one column of the result per iteration
+		void Multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef VULKAT_SSE
+			const float* pA{ &a[0].x };
+			const float* pB{ &b[0].x };
+			float* pOut{ &out[0].x };
+
+			__m128 a0{ _mm_loadu_ps(pA) };
+			__m128 a1{ _mm_loadu_ps(pA + 4) };
+			__m128 a2{ _mm_loadu_ps(pA + 8) };
+			__m128 a3{ _mm_loadu_ps(pA + 12) };
+
+			for (int column{}; column < 4; ++column) {
+				const float* pColumn{ pB + column * 4 };
+				__m128 result{ _mm_mul_ps(a0, _mm_set1_ps(pColumn[0])) };
+				result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(pColumn[1])));
+				result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(pColumn[2])));
+				result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(pColumn[3])));
+				_mm_storeu_ps(pOut + column * 4, result);
+			}
+#else
+			out = a * b;
+#endif
+		}
+	}
+
+	TransformHierarchy::TransformHierarchy()
+		: m_FirstDirty{ 0 }
+		, m_OrderDirty{ false }
+		, m_UpdatedCount{ 0 }
+	{}
+
+	uint32_t TransformHierarchy::Create(uint32_t parent) {
+		uint32_t id;
+		if (!m_FreeIds.empty()) {
+			id = m_FreeIds.back();
+			m_FreeIds.pop_back();
+		}
+		else {
+			id = uint32_t(m_IdToIndex.size());
+			m_IdToIndex.push_back(0);
+		}
+
+		// Appended, the depth order is restored by the next Update()
+		uint32_t index{ uint32_t(m_World.size()) };
+		m_IdToIndex[id] = index;
+
+		m_Parent.push_back(parent == m_NoParent ? m_NoParent : m_IdToIndex[parent]);
+		m_Depth.push_back(g_Unknown);
+		m_Position.push_back(glm::vec3{ 0.f });
+		m_Rotation.push_back(glm::quat{ 1.f, 0.f, 0.f, 0.f });
+		m_Scale.push_back(glm::vec3{ 1.f });
+		m_World.push_back(glm::mat4{ 1.f });
+		m_Dirty.push_back(1);
+		m_IndexToId.push_back(id);
+
+		m_OrderDirty = true;
+		return id;
+	}
+
+	void TransformHierarchy::Destroy(uint32_t id) {
+		// Its subtree goes with it when the order is restored
+		m_Depth[m_IdToIndex[id]] = g_Removed;
+		m_OrderDirty = true;
+	}
+
+	void TransformHierarchy::SetParent(uint32_t id, uint32_t parent) {
+		uint32_t index{ m_IdToIndex[id] };
+		m_Parent[index] = parent == m_NoParent ? m_NoParent : m_IdToIndex[parent];
+		m_OrderDirty = true;
+	}
+
+	void TransformHierarchy::SetLocal(uint32_t id, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+		uint32_t index{ m_IdToIndex[id] };
+		m_Position[index] = position;
+		m_Rotation[index] = rotation;
+		m_Scale[index] = scale;
+		MarkDirty(index);
+	}
+
+	void TransformHierarchy::SetPosition(uint32_t id, const glm::vec3& position) {
+		uint32_t index{ m_IdToIndex[id] };
+		m_Position[index] = position;
+		MarkDirty(index);
+	}
+
+	void TransformHierarchy::SetRotation(uint32_t id, const glm::quat& rotation) {
+		uint32_t index{ m_IdToIndex[id] };
+		m_Rotation[index] = rotation;
+		MarkDirty(index);
+	}
+
+	void TransformHierarchy::Update() {
+		if (m_OrderDirty) Reorder();
+
+		m_UpdatedCount = 0;
+		const uint32_t count{ GetCount() };
+		if (m_FirstDirty >= count) return; // Nothing moved
+
+		// Parents come first, so a dirty parent was handled (and is still flagged) when its children are reached
+		uint32_t runStart{ m_FirstDirty };
+		for (uint32_t i{ m_FirstDirty }; i < count; ++i) {
+			uint32_t parent{ m_Parent[i] };
+			if (!m_Dirty[i]) {
+				if (parent == m_NoParent || !m_Dirty[parent]) {
+					if (runStart < i) AddUpload(runStart, i - runStart);
+					runStart = i + 1;
+					continue;
+				}
+				m_Dirty[i] = 1;
+			}
+
+			// Translation * rotation * scale
+			glm::mat4 local{ glm::mat4_cast(m_Rotation[i]) };
+			local[0] *= m_Scale[i].x;
+			local[1] *= m_Scale[i].y;
+			local[2] *= m_Scale[i].z;
+			local[3] = glm::vec4{ m_Position[i], 1.f };
+
+			if (parent == m_NoParent) m_World[i] = local;
+			else Multiply(m_World[parent], local, m_World[i]);
+
+			++m_UpdatedCount;
+		}
+		if (runStart < count) AddUpload(runStart, count - runStart);
+
+		std::fill(m_Dirty.begin() + m_FirstDirty, m_Dirty.end(), uint8_t(0));
+		m_FirstDirty = count;
+
+		// Earlier uploads may still be pending, keep the list sorted and merge runs with small gaps, fewer copy regions
+		std::sort(m_PendingUploads.begin(), m_PendingUploads.end(), [](const TransformRange& lhs, const TransformRange& rhs) { return lhs.first < rhs.first; });
+		size_t merged{ 0 };
+		for (size_t i{ 1 }; i < m_PendingUploads.size(); ++i) {
+			TransformRange& last{ m_PendingUploads[merged] };
+			const TransformRange& next{ m_PendingUploads[i] };
+			if (next.first <= last.first + last.count + 4) {
+				last.count = std::max(last.first + last.count, next.first + next.count) - last.first;
+			}
+			else {
+				m_PendingUploads[++merged] = next;
+			}
+		}
+		if (!m_PendingUploads.empty()) m_PendingUploads.resize(merged + 1);
+	}
+
+	uint32_t TransformHierarchy::TakeUploads(uint32_t maxCount, std::vector<TransformRange>& ranges) {
+		ranges.clear();
+
+		uint32_t taken{ 0 };
+		size_t consumed{ 0 };
+		for (; consumed < m_PendingUploads.size() && taken < maxCount; ++consumed) {
+			TransformRange& range{ m_PendingUploads[consumed] };
+			uint32_t count{ std::min(range.count, maxCount - taken) };
+
+			ranges.push_back(TransformRange{ range.first, count });
+			taken += count;
+
+			// Only part of it fits, the rest waits for the next frame
+			if (count < range.count) {
+				range.first += count;
+				range.count -= count;
+				break;
+			}
+		}
+
+		m_PendingUploads.erase(m_PendingUploads.begin(), m_PendingUploads.begin() + consumed);
+		return taken;
+	}
+
+	void TransformHierarchy::MarkDirty(uint32_t index) {
+		m_Dirty[index] = 1;
+		m_FirstDirty = std::min(m_FirstDirty, index);
+	}
+
+	void TransformHierarchy::Reorder() {
+		const uint32_t count{ GetCount() };
+
+		// Reparenting moves whole subtrees, so every depth is worked out again from the parent chain.
+		// Cheap next to the sort, and structural changes are rare
+		for (auto& depth : m_Depth) {
+			if (depth != g_Removed) depth = g_Unknown;
+		}
+
+		// Nodes below a removed one are removed too
+		std::vector<uint32_t> chain{};
+		for (uint32_t i{}; i < count; ++i) {
+			if (m_Depth[i] != g_Unknown) continue;
+
+			uint32_t node{ i };
+			while (node != m_NoParent && m_Depth[node] == g_Unknown) {
+				chain.push_back(node);
+				node = m_Parent[node];
+			}
+
+			uint32_t depth{ node == m_NoParent ? 0 : m_Depth[node] == g_Removed ? g_Removed : m_Depth[node] + 1 };
+			for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+				m_Depth[*it] = depth;
+				if (depth != g_Removed) ++depth;
+			}
+			chain.clear();
+		}
+
+		std::vector<uint32_t> order{};
+		order.reserve(count);
+		for (uint32_t i{}; i < count; ++i) {
+			if (m_Depth[i] != g_Removed) order.push_back(i);
+			else m_FreeIds.push_back(m_IndexToId[i]);
+		}
+		std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) { return m_Depth[lhs] < m_Depth[rhs]; });
+
+		std::vector<uint32_t> newIndex(count, m_NoParent);
+		for (uint32_t i{}; i < order.size(); ++i) newIndex[order[i]] = i;
+
+		auto permute = [&order](auto& values) {
+			typename std::remove_reference<decltype(values)>::type sorted{};
+			sorted.reserve(order.size());
+			for (uint32_t index : order) sorted.push_back(values[index]);
+			values.swap(sorted);
+		};
+
+		permute(m_Parent);
+		permute(m_Depth);
+		permute(m_Position);
+		permute(m_Rotation);
+		permute(m_Scale);
+		permute(m_World);
+		permute(m_IndexToId);
+
+		for (auto& parent : m_Parent) {
+			if (parent != m_NoParent) parent = newIndex[parent];
+		}
+		for (uint32_t id : m_FreeIds) m_IdToIndex[id] = UINT32_MAX;
+		for (uint32_t i{}; i < order.size(); ++i) m_IdToIndex[m_IndexToId[i]] = i;
+
+		// Everything moved, recompute and upload it all
+		m_Dirty.assign(order.size(), 1);
+		m_FirstDirty = 0;
+		m_PendingUploads.clear();
+		m_OrderDirty = false;
+	}
+
+	void TransformHierarchy::AddUpload(uint32_t first, uint32_t count) {
+		m_PendingUploads.push_back(TransformRange{ first, count });
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef TRANSFORMHIERARCHY_HPP
+#define TRANSFORMHIERARCHY_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vulkat {
+	// Run of consecutive world matrices, by index
+	struct TransformRange {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// Scene graph transforms as parallel arrays sorted by depth, so every parent comes before its children and one
+	// forward pass computes all world matrices. Only nodes marked dirty and their subtrees are recomputed, starting at
+	// the first dirty one. With nothing moved Update() returns right away and nothing needs uploading.
+	// Nodes are addressed by stable ids, their index (also their instance index on the GPU) changes when the hierarchy does
+	class TransformHierarchy final {
+	public:
+		static constexpr uint32_t m_NoParent{ UINT32_MAX };
+
+		TransformHierarchy();
+
+		TransformHierarchy(const TransformHierarchy& other) = delete;
+		TransformHierarchy(TransformHierarchy&& other) = delete;
+		TransformHierarchy& operator=(const TransformHierarchy& other) = delete;
+		TransformHierarchy& operator=(TransformHierarchy&& other) = delete;
+
+		~TransformHierarchy() = default;
+
+		// Returns the id of the new node, identity transform
+		uint32_t Create(uint32_t parent = m_NoParent);
+		void Destroy(uint32_t id); // With its subtree
+		void SetParent(uint32_t id, uint32_t parent);
+
+		void SetLocal(uint32_t id, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+		void SetPosition(uint32_t id, const glm::vec3& position);
+		void SetRotation(uint32_t id, const glm::quat& rotation);
+
+		// Recomputes dirty subtrees, restores the depth order first if the hierarchy changed
+		void Update();
+
+		// Valid after Update()
+		uint32_t GetIndex(uint32_t id) const { return m_IdToIndex[id]; }
+		const glm::mat4& GetWorld(uint32_t id) const { return m_World[m_IdToIndex[id]]; }
+		const glm::mat4* GetWorldMatrices() const { return m_World.data(); }
+		uint32_t GetCount() const { return uint32_t(m_World.size()); }
+		uint32_t GetUpdatedCount() const { return m_UpdatedCount; } // By the last Update()
+
+		// Hands out up to maxCount matrices that changed since they were last taken, the rest stays pending
+		uint32_t TakeUploads(uint32_t maxCount, std::vector<TransformRange>& ranges);
+
+	private:
+		// By index, in depth order (after Update)
+		std::vector<uint32_t> m_Parent; // Index, m_NoParent for roots
+		std::vector<uint32_t> m_Depth;
+		std::vector<glm::vec3> m_Position;
+		std::vector<glm::quat> m_Rotation;
+		std::vector<glm::vec3> m_Scale;
+		std::vector<glm::mat4> m_World;
+		std::vector<uint8_t> m_Dirty;
+		std::vector<uint32_t> m_IndexToId;
+
+		std::vector<uint32_t> m_IdToIndex; // UINT32_MAX for free ids
+		std::vector<uint32_t> m_FreeIds;
+
+		uint32_t m_FirstDirty; // Nothing before this index is dirty
+		bool m_OrderDirty; // Nodes were added, removed or reparented
+		uint32_t m_UpdatedCount;
+
+		std::vector<TransformRange> m_PendingUploads; // Sorted, not overlapping
+
+		void MarkDirty(uint32_t index);
+		void Reorder();
+		void AddUpload(uint32_t first, uint32_t count);
+	};
+}
+#endif // TRANSFORMHIERARCHY_HPP
@@ -9,10 +9,27 @@
 
 using namespace vulkat;
 
-bool debug{ false };
+Settings settings{};
 std::string helpMsg{
 	"Options:\n"
 	"\t-d :\tToggle Vulkan debug messages\n"
+	"\t-p <file> :\tWrite startup stage timings to <file> as JSON\n"
+	"\t-s :\tPrint CPU and GPU frame timings every second\n"
+	"\t-t <file> :\tRecord a Chrome trace, written to <file> on F12 and at exit\n"
+	"\t-z :\tRender a depth pre-pass before the main pass\n"
+	"\t-o :\tMeasure overdraw (fragments shaded per pixel, printed with -s)\n"
+	"\t-l <mode> :\tLatency mode: vsync, uncapped or low (frame limiter), defaults to the window's vsync setting\n"
+	"\t-f <fps> :\tFrame limiter target for -l low, defaults to the monitor's refresh rate\n"
+	"\t-n <count> :\tFrames in flight (1-4), defaults to 2\n"
+	"\t-m :\tPrint device memory usage per heap and category every second\n"
+	"\t-g <gpu> :\tUse the GPU with this index or (part of its) name instead of the best scoring one, also VULKAT_DEVICE\n"
+	"\t-c <target> :\tCapture every frame: - streams raw pixels to stdout (keep -d and -s off then), <name>.ppm writes PPM files, anything else raw files; %d in <target> becomes the frame number\n"
+	"\t-b <file> :\tRun the benchmark scenarios, fail if they regressed past the thresholds in baseline <file> (written if missing)\n"
+	"\t-u :\tWith -b, write the results as the new baseline\n"
+	"\t-e <count> :\tSimulate and draw up to <count> particles on the GPU\n"
+	"\t-x :\tCull occluded objects on the GPU against a Hi-Z pyramid of the depth pre-pass (implies -z), counts printed with -s\n"
+	"\t-i <count> :\tLight the scene with <count> moving point lights, binned into clusters on the GPU\n"
+	"\t-w :\tLight the scene with a sun casting cascaded shadows, cascades of static geometry are cached\n"
 	"\t-h :\tDisplay this help\n"
 };
 
@@ -20,10 +37,64 @@ int main(int argc, char* argv[]){
 	srand(time(nullptr));
 
 	int option;
-	while((option = getopt(argc, argv, "dh")) != -1) {
+	while((option = getopt(argc, argv, "dp:st:zol:f:n:mg:c:b:ue:xi:wh")) != -1) {
 		switch(option){
 		case 'd':
-			debug = true;
+			settings.debug = true;
+			break;
+		case 'p':
+			settings.startupProfilePath = optarg;
+			break;
+		case 's':
+			settings.printFrameStats = true;
+			break;
+		case 't':
+			settings.tracePath = optarg;
+			break;
+		case 'z':
+			settings.depthPrepass = true;
+			break;
+		case 'o':
+			settings.measureOverdraw = true;
+			break;
+		case 'l':
+			if (strcmp(optarg, "vsync") == 0) settings.latencyMode = LatencyMode::Vsync;
+			else if (strcmp(optarg, "uncapped") == 0) settings.latencyMode = LatencyMode::Uncapped;
+			else if (strcmp(optarg, "low") == 0) settings.latencyMode = LatencyMode::LowLatency;
+			else std::cout << "Unknown latency mode " << optarg << ", using the window's vsync setting\n";
+			break;
+		case 'f':
+			settings.targetFps = atof(optarg);
+			break;
+		case 'n':
+			settings.framesInFlight = uint32_t(std::min(std::max(atoi(optarg), 1), 4));
+			break;
+		case 'm':
+			settings.printMemoryStats = true;
+			break;
+		case 'g':
+			settings.device = optarg;
+			break;
+		case 'c':
+			settings.capturePath = optarg;
+			break;
+		case 'b':
+			settings.benchmarkBaseline = optarg;
+			break;
+		case 'u':
+			settings.updateBaseline = true;
+			break;
+		case 'e':
+			settings.particleCount = uint32_t(std::max(atoi(optarg), 0));
+			break;
+		case 'x':
+			settings.occlusionCulling = true;
+			break;
+		case 'i':
+			settings.lightCount = uint32_t(std::max(atoi(optarg), 0));
+			break;
+		case 'w':
+			settings.shadows = true;
 			break;
 		case 'h':
 		default:
@@ -33,10 +104,13 @@ int main(int argc, char* argv[]){
 	}
 
 	// Create a new core object on the heap
-	Core* pCore{ new Core{ Window{ "WindowName", 1280.f, 720.f }, debug } };
+	Core* pCore{ new Core{ Window{ "WindowName", 1280.f, 720.f }, settings } };
+
+	int result{ EXIT_SUCCESS };
 
 	try {
-		pCore->Run(); // Run the game loop
+		if (settings.benchmarkBaseline.empty()) pCore->Run(); // Run the game loop
+		else if (!pCore->RunBenchmark()) result = EXIT_FAILURE; // Regressed
 	}
 	catch (const std::exception& e) {
 		std::cerr << "Exception caught: '" << e.what() << "'/n";
@@ -45,5 +119,5 @@ int main(int argc, char* argv[]){
 
 	delete pCore;
 
-	return EXIT_SUCCESS;
+	return result;
 }
@@ -20,5 +20,8 @@
 #include <cstring>
 #include <algorithm>
 #include <fstream>
+#include <future>
+#include <chrono>
+#include <iomanip>
 
 #endif // PCH_HPP
@@ -0,0 +1,92 @@
+#version 450
+
+// shader.frag lit by point lights, only those light.comp binned into this fragment's cluster are looked at.
+// Built a second time with -DSHADOWS, which adds the sun and its cascaded shadow map
+layout(location = 0) in vec3 fragColor; // get color from verts
+layout(location = 0) out vec4 outColor;
+
+struct Light {
+	vec4 positionRadius; // xy in NDC, z depth, w radius in NDC heights
+	vec4 color; // rgb times intensity
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Lights {
+	Light lights[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer ClusterCounts {
+	uint clusterCounts[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer ClusterLights {
+	uint clusterLights[];
+};
+
+// Same block in light.comp
+layout(push_constant) uniform Constants {
+	vec2 viewportSize;
+	float tileSize;
+	float aspect;
+	uvec4 grid;
+	uint lightCount;
+	float time;
+	float ambient;
+	uint seed;
+} pc;
+
+#ifdef SHADOWS
+const uint CASCADE_COUNT = 4u;
+
+// Written by ShadowCascades whenever the light or the cascades change
+layout(std140, set = 1, binding = 1) uniform Cascades {
+	mat4 viewProjection[CASCADE_COUNT]; // World to shadow map clip space
+	vec4 splits; // Far depth of every cascade
+	vec4 params; // x depth bias, y texel size, z sun intensity
+} cascades;
+
+// One layer per cascade, compares against the reference depth
+layout(set = 1, binding = 0) uniform sampler2DArrayShadow shadowMap;
+
+float Shadow(vec3 position) {
+	uint cascade = 0u;
+	while (cascade < CASCADE_COUNT - 1u && position.z > cascades.splits[cascade]) ++cascade;
+
+	vec4 shadowPosition = cascades.viewProjection[cascade] * vec4(position, 1.0);
+	vec2 uv = shadowPosition.xy * 0.5 + 0.5;
+	float depth = shadowPosition.z - cascades.params.x;
+
+	// 3x3 PCF, nearest compares so it works on any depth format
+	float lit = 0.0;
+	for (int y = -1; y <= 1; ++y) {
+		for (int x = -1; x <= 1; ++x) {
+			lit += texture(shadowMap, vec4(uv + vec2(x, y) * cascades.params.y, float(cascade), depth));
+		}
+	}
+
+	return lit / 9.0;
+}
+#endif
+
+void main() {
+	uvec3 cluster = min(uvec3(uvec2(gl_FragCoord.xy / pc.tileSize), uint(gl_FragCoord.z * float(pc.grid.z))), pc.grid.xyz - 1u);
+	uint id = cluster.x + pc.grid.x * (cluster.y + pc.grid.y * cluster.z);
+
+	vec3 position = vec3(gl_FragCoord.xy / pc.viewportSize * 2.0 - 1.0, gl_FragCoord.z);
+	vec3 scale = vec3(pc.aspect, 1.0, 1.0);
+
+	vec3 light = vec3(pc.ambient);
+	uint count = clusterCounts[id];
+	for (uint i = 0; i < count; ++i) {
+		Light current = lights[clusterLights[id * pc.grid.w + i]];
+
+		float distance = length((current.positionRadius.xyz - position) * scale);
+		float falloff = clamp(1.0 - distance / current.positionRadius.w, 0.0, 1.0);
+		light += current.color.rgb * falloff * falloff;
+	}
+
+#ifdef SHADOWS
+	light += vec3(cascades.params.z * Shadow(position));
+#endif
+
+	outColor = vec4(fragColor * light, 1.0);
+}
@@ -0,0 +1,42 @@
+#version 450
+
+// Instanced quads, one per alive particle, pulled from the simulation buffers
+struct Particle {
+	vec4 positionVelocity;
+	vec4 color;
+	vec4 state; // x age, y lifetime, z size
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Particles {
+	Particle particles[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Lists {
+	uint lists[];
+};
+
+layout(push_constant) uniform Constants {
+	vec2 emitterPosition;
+	float deltaTime;
+	uint emitRequest;
+	uint capacity;
+	uint current; // Alive list the simulation just filled
+	uint seed;
+	float size;
+} pc;
+
+layout(location = 0) out vec3 fragColor;
+
+const vec2 CORNERS[6] = vec2[](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0),
+	vec2(-1.0, 1.0), vec2(1.0, -1.0), vec2(1.0, 1.0)
+);
+
+void main() {
+	Particle particle = particles[lists[pc.capacity * (1 + pc.current) + gl_InstanceIndex]];
+
+	gl_Position = vec4(particle.positionVelocity.xy + CORNERS[gl_VertexIndex] * particle.state.z, 0.0, 1.0);
+
+	// Blended additively, fading out is dimming
+	fragColor = particle.color.rgb * (1.0 - particle.state.x / particle.state.y);
+}
@@ -2,10 +2,14 @@
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
+layout(location = 2) in mat4 inModel; // Per instance, 2 to 5
 
 layout(location = 0) out vec3 fragColor;
 
+// The depth pre-pass and the main pass are separate pipelines, their depth has to match bit for bit for the EQUAL test
+invariant gl_Position;
+
 void main() {
-	gl_Position = vec4(inPosition, 0.0, 1.0);
+	gl_Position = inModel * vec4(inPosition, 0.0, 1.0);
 	fragColor = inColor;
 }
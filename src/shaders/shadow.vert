@@ -0,0 +1,13 @@
+#version 450
+
+// shader.vert for the shadow cascades, depth only
+layout(location = 0) in vec2 inPosition;
+layout(location = 2) in mat4 inModel; // Per instance, 2 to 5
+
+layout(push_constant) uniform Constants {
+	mat4 viewProjection; // Of the cascade being rendered
+} pc;
+
+void main() {
+	gl_Position = pc.viewProjection * inModel * vec4(inPosition, 0.0, 1.0);
+}